@@ -85,6 +85,7 @@ void* Arena::alloc(size_t bytes)
     if (first == nullptr) {
       first = page;
       curr = page;
+      firstSize = size;
     }
     else {
       *(uint8_t**)curr = page; // update next
@@ -122,6 +123,23 @@ void Arena::clear()
   curr = nullptr;
   fill = 0;
   size = 0;
+  firstSize = 0;
+}
+
+void Arena::reset()
+{
+  if (first == nullptr) return;
+
+  auto * c = *(uint8_t**)first;
+  while (c != nullptr) {
+    auto * n = *(uint8_t**)c;
+    free(c);
+    c = n;
+  }
+  *(uint8_t**)first = nullptr;
+  curr = first;
+  fill = sizeof(uint8_t*);
+  size = firstSize;
 }
 
 Map::~Map()
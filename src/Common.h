@@ -2,8 +2,10 @@
 #include <cstdint>
 #include <cstddef>
 #include <string>
+#include <vector>
 
 class Store;
+class Tessellator;
 
 struct Triangulation;
 
@@ -30,11 +32,15 @@ struct Arena
   uint8_t * curr = nullptr;
   size_t fill = 0;
   size_t size = 0;
+  size_t firstSize = 0;
 
   void* alloc(size_t bytes);
   void* dup(const void* src, size_t bytes);
   void clear();
 
+  // Like clear, but keeps the first page for reuse by scratch arenas.
+  void reset();
+
   template<typename T> T * alloc() { return new(alloc(sizeof(T))) T(); }
 };
 
@@ -102,21 +108,40 @@ struct StringInterning
   const char* intern(const char* str);  // null terminanted
 };
 
+// Names as UTF-8. Names that are not valid UTF-8 are taken to be in the ANSI
+// code page, CP936 where there is no system code page, and are converted once
+// and cached by pointer. Hence the names must be interned or otherwise stay
+// unchanged while the cache lives. Not thread-safe.
+struct Utf8Names
+{
+  Arena arena;
+  Map map;
+  unsigned converted = 0;
+
+  const char* get(const char* str);
+};
+
+bool isAscii(const char* str, size_t length);
+bool isValidUtf8(const char* str);
+void cp936ToUtf8(std::string& dst, const char* src, size_t length);
+
 uint64_t fnv_1a(const char* bytes, size_t l);
 uint64_t fnv_1a(const char* bytes, size_t l);
 
 
-bool flattenRegex(Store* store, Logger logger, const char* regex);
+bool flattenRegex(Store* store, Logger logger, const std::vector<std::string>& regexes);
 void connect(Store* store, Logger logger);
 void align(Store* store, Logger logger);
-bool exportJson(Store* store, Logger logger, const char* path);
+bool exportJson(Store* store, Logger logger, const char* path, bool lines);
 bool discardGroups(Store* store, Logger logger, const void* ptr, size_t size);
-bool exportRev(Store* store, Logger logger, const char* path);
-bool exportGLTF(Store* store, Logger logger, const char* path, size_t splitLevel, bool rotateZToY, bool centerModel, bool includeAttributes, bool mergeGeometries);
+bool exportRev(Store* store, Logger logger, const char* path, unsigned threads);
+bool exportGLTF(Store* store, Logger logger, const char* path, size_t splitLevel, bool rotateZToY, bool centerModel, bool includeAttributes, bool mergeGeometries, bool stitchSeams, bool parametric);
+bool exportTiles(Store* store, Logger logger, const char* path, float tolerance, float cullScale, unsigned leafSize);
 
 
-bool exportNamedPipe(Store* store, Logger logger, const std::string& pipename);
+bool exportNamedPipe(Store* store, Logger logger, const std::string& pipename, unsigned creditWindow, unsigned frameBuffers, unsigned threads);
 
 
 bool exportEWC(Store* store, Logger logger, const std::string& filename, 
-    const bool& delexistfile, const bool& geometryasmesh, const bool& compresszip,const std::string& outformat);
\ No newline at end of file
+    const bool& delexistfile, const bool& geometryasmesh, const bool& compresszip,const std::string& outformat,
+    const bool& analyze, const bool& vacuum, Tessellator* tessellator);
\ No newline at end of file
@@ -47,8 +47,6 @@ using namespace E5DZipUtils;
 
 #define NOTPARSESHAPE 0
 
-#define NOTSHAPE2BIN 0
-
 #define RVMPARSER_GLTF_PRETTY_PRINT (0)
 
 namespace rj = rapidjson;
@@ -131,6 +129,9 @@ namespace ExportEWC{
     int64_t GlobalShapeId = 0;
     int64_t GlobalMaterialId = 0;
 
+    // 较粗LOD的mesh id, 从所有shape id之后开始, 最细一级的mesh id仍等于shape id
+    int64_t GlobalLodMeshId = 0;
+
     //每次发送4M数据
     int PipeDataBufferLen = 1024 * 1024 * 4;
 
@@ -213,6 +214,8 @@ namespace ExportEWC{
     std::atomic< long long>  addinstns = 0;
     std::atomic< long long>  addassons = 0;
     std::atomic< long long>  addshapeinstns = 0;
+    std::atomic< long long>  addmodelns = 0;
+    std::atomic< long long>  addmaterialns = 0;
 
     std::atomic< long long>  sqliteopetimes = 0;
 
@@ -222,6 +225,7 @@ namespace ExportEWC{
     int instancenum = 0;
     int shapenum = 0;
     int materialnum = 0;
+    std::atomic<int> lodmeshnum = 0;
 
     std::vector< ModelData> model;
     std::vector<InstanceData> instances;
@@ -232,6 +236,15 @@ namespace ExportEWC{
 
     bool geometryasmesh = true;
 
+    // Serialized geometry of the current shape. Reused from shape to shape so
+    // it only allocates when it grows, and handed to AddMesh without a copy.
+    std::string geometryBinary;
+
+    // 非空时按需细分, 不使用预先细分好的geo->triangulation.
+    // 细分结果放在triangulations中, 每个shape细分前重置, 内存占用只取决于当前shape.
+    Tessellator* tessellator = nullptr;
+    Arena triangulations;
+
     bool centerModel = true;
     bool rotateZToY = true;
     bool includeAttributes = false;
@@ -239,42 +252,74 @@ namespace ExportEWC{
     bool mergeGeometries = true;
   };
 
-  bool IsValidUTF8(const char* str) {
-      while (*str) {
-          if ((*str & 0x80) == 0) str++; // ASCII字符跳过 
-          else if ((*str & 0xE0) == 0xC0) { // 2字节字符 
-              if ((str[1] & 0xC0) != 0x80) return false;
-              str += 2;
+  // ewc文件是一次性生成的, 写入过程中断则整个文件作废, 因此不需要回滚日志和同步写盘.
+  // synchronous, cache_size和mmap_size通过DataAccess的接口按SynchronousOff/CacheSize/MMapSize设置,
+  // DataAccess没有接口的PRAGMA在这里派生出来执行.
+  class BulkDataAccess : public E5D::Studio::DataAccess
+  {
+  public:
+      // 必须在事务开始前调用, 事务中无法修改journal_mode
+      void BeginBulkLoad(Logger logger)
+      {
+          if (!SetSynchronous(SynchronousOff ? E5D::Studio::SQLiteSynchronousType::OFF : E5D::Studio::SQLiteSynchronousType::NORMAL))
+          {
+              logger(1, "SetSynchronous failed: %s", GetLastError().c_str());
+          }
+          if (!SetCacheSize(CacheSize))
+          {
+              logger(1, "SetCacheSize(%lld) failed: %s", (long long)CacheSize, GetLastError().c_str());
+          }
+          if (!SetMMapSize(MMapSize))
+          {
+              logger(1, "SetMMapSize(%lld) failed: %s", (long long)MMapSize, GetLastError().c_str());
+          }
+
+          const std::string pragmas[] = {
+              "PRAGMA journal_mode=OFF",
+              "PRAGMA locking_mode=EXCLUSIVE",
+              "PRAGMA temp_store=MEMORY",
+          };
+          for (const auto& pragma : pragmas)
+          {
+              if (!ExecuteNonQuery(pragma))
+              {
+                  logger(1, "%s failed: %s", pragma.c_str(), GetLastError().c_str());
+              }
+          }
+
+          // 读回实际生效的值, 设置失败或被sqlite限制时可以从日志看出
+          logger(0, "BulkLoad: cache_size=%s, mmap_size=%s, journal_mode=%s",
+              PragmaValue("cache_size").c_str(), PragmaValue("mmap_size").c_str(), PragmaValue("journal_mode").c_str());
+      }
+
+      std::string PragmaValue(const char* name)
+      {
+          E5D::Studio::DataTable table = ExecuteQuery(std::string("PRAGMA ") + name);
+          if (table.empty() || table.front().empty())
+          {
+              return "?";
           }
-          else if ((*str & 0xF0) == 0xE0) { // 3字节字符
-              for (int i = 1; i <= 2; ++i)
-                  if ((str[i] & 0xC0) != 0x80) return false;
-              str += 3;
+          const E5D::Studio::DataValue& value = table.front().begin()->second;
+          if (const std::string* text = std::get_if<std::string>(&value))
+          {
+              return *text;
           }
-          else if ((*str & 0xF8) == 0xF0) { // 4字节字符 
-              for (int i = 1; i <= 3; ++i)
-                  if ((str[i] & 0xC0) != 0x80) return false;
-              str += 4;
+          if (const int* number = std::get_if<int>(&value))
+          {
+              return std::to_string(*number);
+          }
+          if (const double* number = std::get_if<double>(&value))
+          {
+              return std::to_string(*number);
           }
-          else return false;
+          return "?";
       }
-      return true;
-  }
 
-  // ANSI 转 UTF-8（需释放返回的 char* 内存）
-  char* ConvertToUTF8(const char* ansiStr) {
-      // Step 1: ANSI → WideChar
-      int wlen = MultiByteToWideChar(CP_ACP, 0, ansiStr, -1, NULL, 0);
-      wchar_t* wbuf = new wchar_t[wlen];
-      MultiByteToWideChar(CP_ACP, 0, ansiStr, -1, wbuf, wlen);
-      // Step 2: WideChar → UTF-8
-      int ulen = WideCharToMultiByte(CP_UTF8, 0, wbuf, -1, NULL, 0, NULL, NULL);
-      char* utf8Buf = new char[ulen];
-      WideCharToMultiByte(CP_UTF8, 0, wbuf, -1, utf8Buf, ulen, NULL, NULL);
-
-      delete[] wbuf;
-      return utf8Buf; // 调用者需 delete[] 释放
-  }
+      bool Execute(const std::string& sql)
+      {
+          return ExecuteNonQuery(sql);
+      }
+  };
 
   char* unicodeToUtf8(const WCHAR* zWideFilename) {
       int nByte = WideCharToMultiByte(CP_UTF8, 0, zWideFilename, -1, 0, 0, 0, 0);
@@ -302,7 +347,7 @@ namespace ExportEWC{
   std::wstring string_to_wstring(const std::string& str) {
 
       std::string utf8path;
-      if (!IsValidUTF8(str.data()))
+      if (!isValidUtf8(str.data()))
       {
           utf8path = AnsiToUTF8(str.data());
       }
@@ -563,25 +608,7 @@ namespace ExportEWC{
 
   bool SendModel(Context& ctx, E5D::Studio::DataAccess& da,  const Node* node, const char* modelname,int64_t & nodeId)
   {
-      const char* utf8Data = nullptr;
-      int utf8Len = 0;
-      bool needdelete = false;
-      if (modelname)
-      {
-          //
-            // 转换为 UTF-8
-          if (!IsValidUTF8(modelname))
-          {
-              utf8Data = ConvertToUTF8(modelname);
-              needdelete = true;
-          }
-          else
-          {
-              utf8Data = modelname;
-          }
-          utf8Len = strlen(utf8Data); // 获取字节长度 
-
-      }
+      const char* utf8Data = __store->utf8Names.get(modelname);
 
       nodeId = ++GlobalInstanceId;
 
@@ -590,12 +617,6 @@ namespace ExportEWC{
       if (utf8Data)
           utf8name = utf8Data;
 
-      if (needdelete)
-      {
-          delete[] utf8Data;
-          utf8Data = nullptr;
-      }
-
       utf8name = std::filesystem::path(utf8name).filename().string();
 
       //ModelData model;
@@ -640,6 +661,7 @@ namespace ExportEWC{
       long long e = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
 
       ctx.sqliteopens += e;
+      ctx.addmodelns += e;
       //ctx.sqliteopetimes++;
 
       return true;
@@ -648,30 +670,8 @@ namespace ExportEWC{
 
   bool SendInstance(Context& ctx, E5D::Studio::DataAccess& da, const BBox3f& bboxWorld, const char* instName,const std::vector<double> & matrix, const int64_t& parentId, int64_t& nodeId)
   {
-      const char* utf8Data = nullptr;
-      int utf8Len = 0;
-      bool needdelete = false;
-      bool isSignificant = false;
-      if (instName)
-      {
-          if (strlen(instName) > 0 && instName[0] == '/')
-          {
-              isSignificant = true;
-          }
-          //
-            // 转换为 UTF-8
-          if (!IsValidUTF8(instName))
-          {
-              utf8Data = ConvertToUTF8(instName);
-              needdelete = true;
-          }
-          else
-          {
-              utf8Data = instName;
-          }
-          utf8Len = strlen(utf8Data); // 获取字节长度 
-
-      }
+      const char* utf8Data = __store->utf8Names.get(instName);
+      bool isSignificant = instName && instName[0] == '/';
 
 
       nodeId = ++GlobalInstanceId;
@@ -682,13 +682,6 @@ namespace ExportEWC{
       if (utf8Data)
           utf8name = utf8Data;
 
-
-      if (needdelete)
-      {
-          delete[] utf8Data;
-          utf8Data = nullptr;
-      }
-
       //InstanceData inst;
       //inst.Id = nodeId;
       //inst.IsSignificant = isSignificant;
@@ -877,6 +870,7 @@ namespace ExportEWC{
           long long e = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
 
           ctx.sqliteopens += e;
+          ctx.addmaterialns += e;
           //ctx.sqliteopetimes++;
 
           //CustomMessageHeader pMsg;
@@ -1613,13 +1607,15 @@ namespace ExportEWC{
 #endif
 
 
-      size_t geosize = 0;
+      std::string& binstr = ctx.geometryBinary;
 
-      char* localgeometrystr = nullptr;
+      auto time1 = std::chrono::high_resolution_clock::now();
+
+      const Triangulation* tri = geo->triangulation;
 
       if (ctx.geometryasmesh)
       {
-          if (!__store->serializeGeometry(geo, localgeometrystr, geosize))
+          if (!Store::serializeGeometry(geo, binstr))
           {
               ctx.logger(1, "serialize error,%s", instName);
               return false;
@@ -1628,26 +1624,27 @@ namespace ExportEWC{
       else
       {
 
-          TriangulationMeshSerialize meshSerial(geo->triangulation);
-          uint8* buffer;
-          int32 bufsize;
-          meshSerial.Serialize(buffer, bufsize);
-          if (bufsize > 0)
+          if (ctx.tessellator)
           {
-              localgeometrystr = (char*)buffer;
-              geosize = bufsize;
+              ctx.triangulations.reset();
+              tri = ctx.tessellator->tessellate(&ctx.triangulations, geo);
           }
-          else
+          TriangulationMeshSerialize meshSerial(tri);
+          if (!meshSerial.SerializeTo(binstr))
           {
               ctx.logger(1, "serialize error,%s", instName);
           }
       }
 
+      size_t geosize = binstr.size();
+
+      ctx.shape2binns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time1)).count(), std::memory_order_relaxed);
+
       //{
       //    float scale = 1.f;
       //    //测试反序列化
       //    Geometry testgeo;
-      //    Store::deserializeGeometry(localgeometrystr, geosize, &testgeo, scale);
+      //    Store::deserializeGeometry(binstr.data(), geosize, &testgeo, scale);
       //    Store::DeleteFacetGroup(&testgeo);
       //}
 
@@ -1655,7 +1652,9 @@ namespace ExportEWC{
 
       ctx.shapeparsens.fetch_add(e, std::memory_order_relaxed);
 
-      std::string shapename = geoname + (instName ? std::string(instName) : "");
+      // The kind prefix is ASCII, so only the group name needs converting.
+      const char* utf8Inst = __store->utf8Names.get(instName);
+      std::string shapename = geoname + (utf8Inst ? std::string(utf8Inst) : "");
 
       //if (e > 3e6)
       //{
@@ -1688,54 +1687,13 @@ namespace ExportEWC{
 
       //shape->matrix
 
-      std::string binstr;
-
-
-      time0 = std::chrono::high_resolution_clock::now();
-
-#if !NOTSHAPE2BIN
-      binstr = std::string(localgeometrystr, geosize);
-      //Shape2Binary(shape, binstr);
-#endif
-
-
-      if (!ctx.geometryasmesh && localgeometrystr != nullptr)
-      {
-          delete[] localgeometrystr;
-          localgeometrystr = nullptr;
-      }
-
-      //Store管理不用delete
-      //if (localgeometrystr != nullptr)
-      //{
-      //    delete[] localgeometrystr;
-      //    localgeometrystr = nullptr;
-      //}
-
-      e = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
-
-      ctx.shape2binns.fetch_add(e, std::memory_order_relaxed);
-
       //if (e > 10e6)
       //{
       //    ctx.logger(1, "shape bin %s %lldms", shapename.c_str(), e / 1000000);
       //}
 
 
-      const char* utf8Data = nullptr;
-      int utf8Len = 0;
-      bool needdelete = false;
-
-      if (!IsValidUTF8(shapename.data()))
-      {
-          utf8Data = ConvertToUTF8(shapename.data());
-          needdelete = true;
-      }
-      else
-      {
-          utf8Data = shapename.data();
-      }
-      utf8Len = strlen(utf8Data); // 获取字节长度 
+      const char* utf8Data = shapename.data();
 
 
 
@@ -1747,13 +1705,6 @@ namespace ExportEWC{
       if (utf8Data)
           utf8name = utf8Data;
 
-
-      if (needdelete)
-      {
-          delete[] utf8Data;
-          utf8Data = nullptr;
-      }
-
       double Matrix[12] = {
         geo->M_3x4.m00,
         geo->M_3x4.m01,
@@ -1791,15 +1742,6 @@ namespace ExportEWC{
               doubleToString(Matrix[8]) + "," + doubleToString(Matrix[9]) + "," +
               doubleToString(Matrix[10]) + "," + doubleToString(Matrix[11]) +
               ",0,0,0,1]";
-
-          if (!IsValidUTF8(matrixstr.data()))
-          {
-              auto utf8matrix = ConvertToUTF8(matrixstr.data());
-
-              matrixstr = std::string(utf8matrix);
-
-              delete[] utf8matrix;
-          }
       }
 
       time0 = std::chrono::high_resolution_clock::now();
@@ -1947,6 +1889,39 @@ namespace ExportEWC{
 
               ctx.addmeshns.fetch_add(e1, std::memory_order_relaxed);
           }
+
+          // 较粗的细节层次(LOD)作为额外的mesh行写入, id按从细到粗递增
+          if (!ctx.geometryasmesh && tri != nullptr)
+          {
+              for (const Triangulation* lod = tri->coarser; lod; lod = lod->coarser)
+              {
+                  TriangulationMeshSerialize lodSerial(lod);
+                  if (!lodSerial.SerializeTo(binstr))
+                  {
+                      ctx.logger(1, "serialize lod error,%s", instName);
+                      break;
+                  }
+
+                  auto lodMeshId = ++GlobalLodMeshId;
+
+                  auto time01 = std::chrono::high_resolution_clock::now();
+                  if (!da.AddMesh(lodMeshId, shapeId, lod->triangles_n,
+                      geo->bboxLocal.min.x,
+                      geo->bboxLocal.min.y,
+                      geo->bboxLocal.min.z,
+                      geo->bboxLocal.max.x,
+                      geo->bboxLocal.max.y,
+                      geo->bboxLocal.max.z, binstr))
+                  {
+                      ctx.logger(2, "add lod mesh failed: %s", utf8name.c_str());
+                      return false;
+                  }
+                  auto e1 = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time01)).count();
+
+                  ctx.addmeshns.fetch_add(e1, std::memory_order_relaxed);
+                  ctx.lodmeshnum++;
+              }
+          }
 #endif
       }
 
@@ -2265,7 +2240,8 @@ namespace ExportEWC{
 using namespace ExportEWC;
 
 bool exportEWC(Store* store, Logger logger, const std::string& filename,const bool& delexistfile, 
-    const bool& geometryasmesh,const bool& compresszip,const std::string & outformat)
+    const bool& geometryasmesh,const bool& compresszip,const std::string & outformat,
+    const bool& analyze, const bool& vacuum, Tessellator* tessellator)
 {
 
     //{
@@ -2365,6 +2341,7 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
       .logger = logger,
       .geometryasmesh = geometryasmesh
     };
+    ctx.tessellator = tessellator;
 
     ctx.logger(0, "export: rotate-z-to-y=%u center=%u attributes=%u",
         ctx.rotateZToY ? 1 : 0,
@@ -2454,7 +2431,7 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
         ctx.logger(1, "文件初始大小: %zu bytes", static_cast<size_t>(TempDbFileSize));
     }
 
-    if(!IsValidUTF8(ewcfilename.data()))
+    if(!isValidUtf8(ewcfilename.data()))
     {
         ewcfilename = AnsiToUTF8(ewcfilename.data());
 
@@ -2479,12 +2456,17 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
         ctx.logger(1, "get page size : %d", clustersize);
     }
 
-    E5D::Studio::DataAccess da;
+    BulkDataAccess da;
     da.E5dDbPath =  ewcfilename;
     da.CreateIndex = false;
     da.AutoCommitNum = 0;
     da.WALMode = false;
+    da.TransactionWhenOpen = false;
     da.PageSize = clustersize;// 32 * 1024;
+    da.SynchronousOff = true;
+    // CacheSize保持DataAccess的默认值-256 * 1024 * 1024 KiB, 不再调小
+    // 写入结束后创建索引时需要读回全部表
+    da.MMapSize = 1024LL * 1024 * 1024;
 
     //ctx.logger(1, "OpenLocalDatabase");
 
@@ -2494,6 +2476,16 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
         return false;
     }
 
+    // 索引在全部写入后由CreateInitIndex统一创建
+    auto timePragma = std::chrono::high_resolution_clock::now();
+    da.BeginBulkLoad(logger);
+    if (!da.BeginForBatch())
+    {
+        ctx.logger(2, "开启ewc文件失败: %s", ewcfilename.c_str());
+        return false;
+    }
+    long long pragmans = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - timePragma)).count();
+
     //ctx.logger(1, "OpenLocalDatabase success");
 
     //da.SetCacheSize(4000000);
@@ -2548,6 +2540,9 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
 
     __store = store;
 
+    // 每个geometry最多一个shape id
+    GlobalLodMeshId = GlobalShapeId + store->geometryCountAllocated();
+
     float tolerance = 0.1f;
     int maxSamples = 100;
     auto factory = new TriangulationFactory(store, logger, tolerance, 6, maxSamples);
@@ -2791,8 +2786,17 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
         ctx.addinstns.load() / 1000000, ctx.addmeshns.load() / 1000000,
         ctx.addshapeinstns.load() / 1000000, ctx.addshapens.load() / 1000000);
 
+    ctx.logger(0, "addmodelns:%lldms,addmaterialns:%lldms,pragma:%lldms,models:%d,instances:%d,shapes:%d,materials:%lld",
+        ctx.addmodelns.load() / 1000000, ctx.addmaterialns.load() / 1000000, pragmans / 1000000,
+        ctx.modelnum, ctx.instancenum, ctx.shapenum, (long long)GlobalMaterialId);
+
     ctx.logger(0, "write log:%lldms", ctx.writelog/ 1000000);
 
+    if (ctx.lodmeshnum > 0)
+    {
+        ctx.logger(0, "lod meshes:%d", ctx.lodmeshnum.load());
+    }
+
     long long e = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
     logger(0, "processed  in %lldms", e / 1000000);
 
@@ -2822,6 +2826,28 @@ bool exportEWC(Store* store, Logger logger, const std::string& filename,const bo
         ctx.logger(2, "提交ewc文件失败: %s", ewcfilename.c_str());
         return false;
     }
+
+    // 在提交之后执行, VACUUM不能在事务中运行. 两者对大文件都较耗时, 默认关闭
+    if (analyze)
+    {
+        time0 = std::chrono::high_resolution_clock::now();
+        if (!da.Execute("ANALYZE"))
+        {
+            ctx.logger(1, "ANALYZE失败: %s", da.GetLastError().c_str());
+        }
+        e = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+        logger(0, "ANALYZE in %lldms", e / 1000000);
+    }
+    if (vacuum)
+    {
+        time0 = std::chrono::high_resolution_clock::now();
+        if (!da.Execute("VACUUM"))
+        {
+            ctx.logger(1, "VACUUM失败: %s", da.GetLastError().c_str());
+        }
+        e = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+        logger(0, "VACUUM in %lldms", e / 1000000);
+    }
     if (!da.CloseLocalDatabase())
     {
         ctx.logger(2, "关闭ewc文件失败: %s", ewcfilename.c_str());
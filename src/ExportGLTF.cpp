@@ -9,6 +9,7 @@
 #include <span>
 #include <memory>
 #include <cctype>
+#include <chrono>
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
@@ -17,18 +18,36 @@
 
 #include "Store.h"
 #include "LinAlgOps.h"
+#include "GltfParametric.h"
 
 #define RVMPARSER_GLTF_PRETTY_PRINT (0)
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RVMPARSER_BASE64_X86 (1)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RVMPARSER_TARGET(x)
+#else
+#define RVMPARSER_TARGET(x) __attribute__((target(x)))
+#endif
+#else
+#define RVMPARSER_BASE64_X86 (0)
+#endif
+
 namespace rj = rapidjson;
 
 namespace {
 
+  // Buffer data is only read when the file is written. Items added without
+  // copying point straight into triangulations, which must therefore outlive
+  // the export: exportGLTF runs on the triangulations in the store arena,
+  // never on a tessellator scratch arena or on-demand triangulations.
   struct DataItem
   {
     DataItem* next = nullptr;
     const void* ptr = nullptr;
-    uint32_t size = 0;
+    size_t size = 0;
   };
 
   // Temporary state gathered prior to writing a GLTF file
@@ -43,13 +62,15 @@ namespace {
     rj::Value rjMaterials = rj::Value(rj::kArrayType);
     rj::Value rjBuffers = rj::Value(rj::kArrayType);
 
-    uint32_t dataBytes = 0;
+    size_t dataBytes = 0;
     ListHeader<DataItem> dataItems{};
     Arena arena;
 
     Map definedMaterials;
 
     Vec3f origin = makeVec3f(0.f);
+
+    bool lodUsed = false;   // Set if any node got MSFT_lod levels of detail
   };
 
   struct GeometryItem
@@ -58,6 +79,14 @@ namespace {
     const Geometry* geo;
   };
 
+  // Vertices of a geometry in a merged primitive
+  struct GeometryRange
+  {
+    const Geometry* geo;
+    uint32_t first;
+    uint32_t count;
+  };
+
   struct Context {
     Logger logger = nullptr;
     
@@ -69,6 +98,10 @@ namespace {
     std::vector<Vec3f> tmp3f_2;
     std::vector<uint32_t> tmp32ui;
     std::vector<GeometryItem> tmpGeos;
+    std::vector<GeometryRange> tmpRanges;
+    std::vector<uint32_t> tmpRemap;
+    std::vector<uint32_t> tmpSeam[2];
+    std::vector<ParametricRecord> tmpRecords;
 
     struct {
       size_t level = 0;   // Level to do splitting, 0 for no splitting
@@ -82,13 +115,18 @@ namespace {
     bool includeAttributes = false;
     bool glbContainer = false;
     bool mergeGeometries = true;
+    bool stitchSeams = false;
+    bool parametric = false;  // Write parametric primitives as records instead of triangles
+
+    size_t stitchedSeams = 0;
+    size_t stitchedVertices = 0;
+    size_t parametricRecords = 0;
   };
 
 
-  uint32_t addDataItem(Context& /*ctx*/, Model& model, const void* ptr, size_t size, bool copy)
+  size_t addDataItem(Context& /*ctx*/, Model& model, const void* ptr, size_t size, bool copy)
   {
     assert((size % 4) == 0);
-    assert(model.dataBytes + size <= std::numeric_limits<uint32_t>::max());
 
     if (copy) {
       void* copied_ptr = model.arena.alloc(size);
@@ -99,56 +137,193 @@ namespace {
     DataItem* item = model.arena.alloc<DataItem>();
     model.dataItems.insert(item);
     item->ptr = ptr;
-    item->size = static_cast<uint32_t>(size);
+    item->size = size;
 
-    uint32_t offset = model.dataBytes;
+    size_t offset = model.dataBytes;
     model.dataBytes += item->size;
 
     return offset;
   }
 
-  void encodeBase64(Context& ctx, const uint8_t* data, size_t byteLength)
+  // Base64 table from RFC4648
+  const char rfc4648[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  static_assert(sizeof(rfc4648) == 65);
+
+  // Encodes triples of bytes into quads of characters, returns the number of
+  // input bytes consumed (always a multiple of three). The SIMD variants may
+  // read up to four bytes beyond the last consumed triple, so they leave the
+  // tail of the input to the scalar variant.
+  typedef size_t(*Base64Encoder)(char* dst, const uint8_t* src, size_t byteLength);
+
+  size_t encodeBase64Scalar(char* dst, const uint8_t* src, size_t byteLength)
   {
-    // Base64 table from RFC4648
-    static const char rfc4648[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    static_assert(sizeof(rfc4648) == 65);
+    size_t i = 0;
+    for (; i + 3 <= byteLength; i += 3) {
+      const uint32_t d = (uint32_t(src[i + 0]) << 16) | (uint32_t(src[i + 1]) << 8) | uint32_t(src[i + 2]);
+      *dst++ = rfc4648[(d >> 18) & 0x3f];
+      *dst++ = rfc4648[(d >> 12) & 0x3f];
+      *dst++ = rfc4648[(d >> 6) & 0x3f];
+      *dst++ = rfc4648[d & 0x3f];
+    }
+    return i;
+  }
 
-    static const char prefix[] = "data:application/octet-stream;base64,";
-    static const size_t prefixLength = sizeof(prefix) - 1;
+#if RVMPARSER_BASE64_X86
+
+  // Vectorized encoding as described by Wojciech Mula and Daniel Lemire in
+  // "Faster Base64 Encoding and Decoding Using AVX2 Instructions" (2018):
+  // Shuffle each triple into a 32-bit lane, move the four 6-bit fields into
+  // separate bytes using multiplies, and map 6-bit values to ASCII by adding
+  // an offset picked with pshufb.
+
+  RVMPARSER_TARGET("ssse3")
+  inline __m128i base64SplitSSSE3(__m128i in)
+  {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+  }
+
+  RVMPARSER_TARGET("ssse3")
+  inline __m128i base64LookupSSSE3(__m128i indices)
+  {
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i shift = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    shift = _mm_or_si128(shift, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i shiftLUT = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(shiftLUT, shift), indices);
+  }
 
-    // Add data prefix
-    const size_t totalLength = prefixLength + 4 * ((byteLength + 2) / 3);
-    ctx.tmpBase64.resize(totalLength);
-    std::memcpy(ctx.tmpBase64.data(), prefix, prefixLength);
-    size_t o = prefixLength;
+  RVMPARSER_TARGET("ssse3")
+  size_t encodeBase64SSSE3(char* dst, const uint8_t* src, size_t byteLength)
+  {
+    size_t i = 0;
+    for (; i + 16 <= byteLength; i += 12) {
+      const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), base64LookupSSSE3(base64SplitSSSE3(in)));
+      dst += 16;
+    }
+    return i;
+  }
 
-    // Handle range that is a multiple of three
+  RVMPARSER_TARGET("avx2")
+  size_t encodeBase64AVX2(char* dst, const uint8_t* src, size_t byteLength)
+  {
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shiftLUT = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                              '/' - 63, 'A', 0, 0,
+                                              'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                              '/' - 63, 'A', 0, 0);
     size_t i = 0;
-    while (3 * i + 2 < byteLength) {
-      const size_t i3 = 3 * i;
-      const size_t i4 = 4 * i;
-      const uint8_t d0 = data[i3 + 0];
-      const uint8_t d1 = data[i3 + 1];
-      const uint8_t d2 = data[i3 + 2];
-      ctx.tmpBase64[o + i4 + 0] = rfc4648[(d0 >> 2)];
-      ctx.tmpBase64[o + i4 + 1] = rfc4648[((d0 << 4) & 0x30) | (d1 >> 4)];
-      ctx.tmpBase64[o + i4 + 2] = rfc4648[((d1 << 2) & 0x3c) | (d2 >> 6)];
-      ctx.tmpBase64[o + i4 + 3] = rfc4648[d2 & 0x3f];
-      i++;
+    for (; i + 28 <= byteLength; i += 24) {
+      const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+      __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+      in = _mm256_shuffle_epi8(in, shuffle);
+      const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+      const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+      const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+      const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+      const __m256i indices = _mm256_or_si256(t1, t3);
+
+      __m256i shift = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+      const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+      shift = _mm256_or_si256(shift, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+      const __m256i out = _mm256_add_epi8(_mm256_shuffle_epi8(shiftLUT, shift), indices);
+
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), out);
+      dst += 32;
     }
+    return i;
+  }
+
+  void cpuid(int info[4], int leaf, int subleaf)
+  {
+#ifdef _MSC_VER
+    __cpuidex(info, leaf, subleaf);
+#else
+    unsigned a, b, c, d;
+    __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(subleaf));
+    info[0] = int(a); info[1] = int(b); info[2] = int(c); info[3] = int(d);
+#endif
+  }
+
+#endif
+
+  // Pick the widest encoder the running CPU supports.
+  Base64Encoder selectBase64Encoder(const char*& name)
+  {
+#if RVMPARSER_BASE64_X86
+    int info[4];
+    cpuid(info, 0, 0);
+    const int maxLeaf = info[0];
+    cpuid(info, 1, 0);
+    const bool ssse3 = (info[2] & (1 << 9)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    bool avx2 = false;
+    if (7 <= maxLeaf && osxsave && avx) {
+#ifdef _MSC_VER
+      const unsigned long long xcr0 = _xgetbv(0);
+#else
+      unsigned lo, hi;
+      __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      const unsigned long long xcr0 = (uint64_t(hi) << 32) | lo;
+#endif
+      if ((xcr0 & 0x6) == 0x6) {  // OS saves XMM and YMM state
+        cpuid(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+      }
+    }
+
+    if (avx2) {
+      name = "avx2";
+      return encodeBase64AVX2;
+    }
+    if (ssse3) {
+      name = "ssse3";
+      return encodeBase64SSSE3;
+    }
+#endif
+    name = "scalar";
+    return encodeBase64Scalar;
+  }
+
+  const char* base64EncoderName = nullptr;
+  const Base64Encoder base64Encoder = selectBase64Encoder(base64EncoderName);
+
+  // Encode byteLength bytes into dst, including any end padding. Returns the
+  // number of characters written, which is 4 * ((byteLength + 2) / 3).
+  size_t encodeBase64(char* dst, const uint8_t* data, size_t byteLength)
+  {
+    size_t i = base64Encoder(dst, data, byteLength);
+    size_t o = 4 * (i / 3);
+    i += encodeBase64Scalar(dst + o, data + i, byteLength - i);
+    o = 4 * (i / 3);
 
     // Handle end if byteLength is not a multiple of three
-    if (3 * i < byteLength) { // End padding
-      const size_t i3 = 3 * i;
-      const size_t i4 = 4 * i;
-      const bool two = (i3 + 1 < byteLength);  // one or two extra bytes (three would go into loop above)?
-      const uint8_t d0 = data[i3 + 0];
-      const uint8_t d1 = two ? data[i3 + 1] : 0;
-      ctx.tmpBase64[o + i4 + 0] = rfc4648[(d0 >> 2)];
-      ctx.tmpBase64[o + i4 + 1] = rfc4648[((d0 << 4) & 0x30) | (d1 >> 4)];
-      ctx.tmpBase64[o + i4 + 2] = two ? rfc4648[((d1 << 2) & 0x3c)] : '=';
-      ctx.tmpBase64[o + i4 + 3] = '=';
+    if (i < byteLength) { // End padding
+      const bool two = (i + 1 < byteLength);  // one or two extra bytes (three would go into loop above)?
+      const uint8_t d0 = data[i + 0];
+      const uint8_t d1 = two ? data[i + 1] : 0;
+      dst[o + 0] = rfc4648[(d0 >> 2)];
+      dst[o + 1] = rfc4648[((d0 << 4) & 0x30) | (d1 >> 4)];
+      dst[o + 2] = two ? rfc4648[((d1 << 2) & 0x3c)] : '=';
+      dst[o + 3] = '=';
+      o += 4;
     }
+    return o;
   }
 
   uint32_t createBufferView(Context& ctx, Model& model, const void* data, size_t count, size_t byte_stride, uint32_t target, bool copy)
@@ -157,7 +332,7 @@ namespace {
     rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
 
     uint32_t bufferIndex = 0;
-    uint32_t byteOffset = 0;
+    size_t byteOffset = 0;
     size_t byteLength = byte_stride * count;
 
     // For GLB, we have one large buffer containing everything that we make later
@@ -165,27 +340,28 @@ namespace {
       byteOffset = addDataItem(ctx, model, data, byteLength, copy);
     }
 
-    // For GLTF, buffer data is base64-encoded in the URI
+    // For GLTF, buffer data is base64-encoded in the URI. Encoding is deferred
+    // until the file is written, where it is streamed directly to the file.
     else {
-
-      encodeBase64(ctx, static_cast<const uint8_t*>(data), byteLength);
-      rj::Value rjData(ctx.tmpBase64.data(), static_cast<rapidjson::SizeType>(ctx.tmpBase64.size()), alloc);
+      addDataItem(ctx, model, data, byteLength, copy);
 
       rj::Value rjBuffer(rj::kObjectType);
-      rjBuffer.AddMember("uri", rjData, alloc);
       rjBuffer.AddMember("byteLength", static_cast<uint64_t>(byteLength), alloc);
-      bufferIndex = model.rjBufferViews.Size();
+      bufferIndex = model.rjBuffers.Size();
       model.rjBuffers.PushBack(rjBuffer, alloc);
     }
 
     rj::Value rjBufferView(rj::kObjectType);
     rjBufferView.AddMember("buffer", bufferIndex, alloc);
     if (byteOffset) {
-      rjBufferView.AddMember("byteOffset", byteOffset, alloc);
+      rjBufferView.AddMember("byteOffset", static_cast<uint64_t>(byteOffset), alloc);
     }
     rjBufferView.AddMember("byteLength", static_cast<uint64_t>(byteLength), alloc);
 
-    rjBufferView.AddMember("target", target, alloc);
+    // Data that is not vertex attributes or indices has no target
+    if (target) {
+      rjBufferView.AddMember("target", target, alloc);
+    }
 
     uint32_t view_ix = model.rjBufferViews.Size();
     model.rjBufferViews.PushBack(rjBufferView, alloc);
@@ -317,7 +493,68 @@ namespace {
     model.rjNodes.PushBack(rjChildNode, model.rjAlloc);
   }
 
-  void addGeometryPrimitive(Context& ctx, Model& model, rj::Value& rjPrimitivesNode, const Geometry* geo)
+  // Number of levels of detail of a geometry, lines and geometries without triangulation have one
+  unsigned levelOfDetailCount(const Geometry* geo)
+  {
+    unsigned levels = 1;
+    if (geo->kind != Geometry::Kind::Line && geo->triangulation) {
+      for (const Triangulation* tri = geo->triangulation->coarser; tri; tri = tri->coarser) {
+        levels++;
+      }
+    }
+    return levels;
+  }
+
+  // Triangulation of a level of detail, clamped to the coarsest available level
+  const Triangulation* getLevelOfDetail(const Geometry* geo, unsigned lod)
+  {
+    const Triangulation* tri = geo->triangulation;
+    for (; tri && tri->coarser && lod; lod--) {
+      tri = tri->coarser;
+    }
+    return tri;
+  }
+
+  uint32_t addMesh(Model& model, rj::Value& rjPrimitives)
+  {
+    rj::Value mesh(rj::kObjectType);
+    mesh.AddMember("primitives", rjPrimitives, model.rjAlloc);
+    uint32_t meshIndex = model.rjMeshes.Size();
+    model.rjMeshes.PushBack(mesh, model.rjAlloc);
+    return meshIndex;
+  }
+
+  // Add a node with the given mesh and transform outside of the hierarchy that
+  // serves as a coarser level of detail of some node.
+  void addLevelOfDetailNode(Model& model, rj::Value& rjLodIds, rj::Value& rjPrimitives, const char* transformKey, const rj::Value& transform)
+  {
+    rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
+
+    rj::Value lodNode(rj::kObjectType);
+    lodNode.AddMember("mesh", addMesh(model, rjPrimitives), alloc);
+    lodNode.AddMember(rj::StringRef(transformKey), rj::Value(transform, alloc), alloc);
+
+    rjLodIds.PushBack(model.rjNodes.Size(), alloc);
+    model.rjNodes.PushBack(lodNode, alloc);
+  }
+
+  void setLevelsOfDetail(Model& model, rj::Value& node, rj::Value& rjLodIds)
+  {
+    if (rjLodIds.Empty()) return;
+
+    rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
+
+    rj::Value rjLod(rj::kObjectType);
+    rjLod.AddMember("ids", rjLodIds, alloc);
+
+    rj::Value rjExtensions(rj::kObjectType);
+    rjExtensions.AddMember("MSFT_lod", rjLod, alloc);
+    node.AddMember("extensions", rjExtensions, alloc);
+
+    model.lodUsed = true;
+  }
+
+  void addGeometryPrimitive(Context& ctx, Model& model, rj::Value& rjPrimitivesNode, const Geometry* geo, unsigned lod = 0)
   {
     rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
     if (geo->kind == Geometry::Kind::Line) {
@@ -339,7 +576,7 @@ namespace {
       rjPrimitive.AddMember("material", material_ix, alloc);
     }
     else {
-      Triangulation* tri = geo->triangulation;
+      const Triangulation* tri = getLevelOfDetail(geo, lod);
       if (tri == nullptr) {
         ctx.logger(1, "exportGLTF: Geometry node missing triangulation, ignoring.");
         return;
@@ -358,14 +595,23 @@ namespace {
         uint32_t accessor_ix = createAccessorVec3f(ctx, model, (Vec3f*)tri->vertices, tri->vertices_n, false);
         rjAttributes.AddMember("POSITION", accessor_ix, alloc);
       }
+      else if (tri->hasVertices()) {
+        std::vector<Vec3f>& tmpVertices = ctx.tmp3f_2;
+        tmpVertices.resize(tri->vertices_n);
+        for (size_t i = 0; i < tri->vertices_n; i++) {
+          tmpVertices[i] = tri->vertex(i);
+        }
+        uint32_t accessor_ix = createAccessorVec3f(ctx, model, tmpVertices.data(), tri->vertices_n, true);
+        rjAttributes.AddMember("POSITION", accessor_ix, alloc);
+      }
 
-      if (tri->normals) {
+      if (tri->hasNormals()) {
 
         // Make sure that normal vectors are of unit length
         std::vector<Vec3f>& tmpNormals = ctx.tmp3f_1;
         tmpNormals.resize(tri->vertices_n * 3);
         for (size_t i = 0; i < tri->vertices_n; i++) {
-          Vec3f n = normalize(makeVec3f(tri->normals + 3 * i));
+          Vec3f n = normalize(tri->normal(i));
           if (!std::isfinite(n.x) || !std::isfinite(n.y) || !std::isfinite(n.z)) {
             n = makeVec3f(1.f, 0.f, 0.f);
           }
@@ -383,6 +629,15 @@ namespace {
         uint32_t accessor_ix = createAccessorUint32(ctx, model, tri->indices, 3 * tri->triangles_n, false);
         rjPrimitive.AddMember("indices", accessor_ix, alloc);
       }
+      else if (tri->hasIndices()) {
+        std::vector<uint32_t>& tmpIndices = ctx.tmp32ui;
+        tmpIndices.resize(3 * size_t(tri->triangles_n));
+        for (size_t i = 0; i < tmpIndices.size(); i++) {
+          tmpIndices[i] = tri->index(i);
+        }
+        uint32_t accessor_ix = createAccessorUint32(ctx, model, tmpIndices.data(), tmpIndices.size(), true);
+        rjPrimitive.AddMember("indices", accessor_ix, alloc);
+      }
 
       rjPrimitive.AddMember("material", createOrGetColor(ctx, model, geo), alloc);
 
@@ -401,12 +656,7 @@ namespace {
     if (rjPrimitives.Empty()) return false;
 
     // Create mesh
-    rj::Value mesh(rj::kObjectType);
-    mesh.AddMember("primitives", rjPrimitives, alloc);
-    uint32_t meshIndex = model.rjMeshes.Size();
-    model.rjMeshes.PushBack(mesh, alloc);
-
-    node.AddMember("mesh", meshIndex, alloc);
+    node.AddMember("mesh", addMesh(model, rjPrimitives), alloc);
 
     rj::Value matrix(rj::kArrayType);
     for (size_t c = 0; c < 3; c++) {
@@ -420,6 +670,18 @@ namespace {
     }
     matrix.PushBack(1.f, alloc);
 
+    // Coarser levels of detail, if any, are added as MSFT_lod nodes
+    if (unsigned levels = levelOfDetailCount(geo); 1 < levels) {
+      rj::Value rjLodIds(rj::kArrayType);
+      for (unsigned lod = 1; lod < levels; lod++) {
+        rj::Value rjLodPrimitives(rj::kArrayType);
+        addGeometryPrimitive(ctx, model, rjLodPrimitives, geo, lod);
+        if (rjLodPrimitives.Empty()) break;
+        addLevelOfDetailNode(model, rjLodIds, rjLodPrimitives, "matrix", matrix);
+      }
+      setLevelsOfDetail(model, node, rjLodIds);
+    }
+
     node.AddMember("matrix", matrix, alloc);
 
     return true;
@@ -466,7 +728,117 @@ namespace {
     return true;  // We did add geometry
   }
 
-  bool addPrimitiveForTriangulations(Context& ctx, Model& model, rj::Value& rjPrimitives, const std::span<const GeometryItem>& geos, const Vec3d& localOrigin)
+  // Collects the vertices of a range that lie in the plane of a connection and
+  // are not cap vertices, that is, the seam ring.
+  void findSeamVertices(std::vector<uint32_t>& seam, const std::vector<Vec3f>& V, const std::vector<Vec3f>& N,
+                        const GeometryRange& range, const Vec3f& p, const Vec3f& d, float epsilon)
+  {
+    seam.clear();
+    for (uint32_t i = range.first; i < range.first + range.count; i++) {
+      if (std::abs(dot(V[i] - p, d)) <= epsilon && std::abs(dot(N[i], d)) < 0.9f) {
+        seam.push_back(i);
+      }
+    }
+  }
+
+  // Makes connected geometries in a merged primitive share the vertices of
+  // their common seam ring. Only done where both sides sample the seam with
+  // the same number of vertices that pairwise coincide in position and normal,
+  // then the duplicates are dropped and indices rewritten. Returns the new
+  // vertex count.
+  size_t stitchSeams(Context& ctx, std::vector<Vec3f>& V, std::vector<Vec3f>& N, std::vector<uint32_t>& I,
+                     size_t vertexCount, size_t indexCount, const Vec3d& localOrigin)
+  {
+    std::vector<GeometryRange>& ranges = ctx.tmpRanges;
+    std::sort(ranges.begin(), ranges.end(), [](const GeometryRange& a, const GeometryRange& b) { return a.geo < b.geo; });
+    auto findRange = [&](const Geometry* geo) -> const GeometryRange* {
+      auto it = std::lower_bound(ranges.begin(), ranges.end(), geo, [](const GeometryRange& a, const Geometry* b) { return a.geo < b; });
+      return it != ranges.end() && it->geo == geo ? &(*it) : nullptr;
+    };
+
+    // Same epsilon as connect() uses to match anchors.
+    const float epsilon = 0.001f;
+
+    std::vector<uint32_t>& remap = ctx.tmpRemap;
+    remap.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+      remap[i] = static_cast<uint32_t>(i);
+    }
+
+    size_t stitched = 0;
+    for (const GeometryRange& a : ranges) {
+      for (const Connection* con : a.geo->connections) {
+        if (!con || con->geo[0] != a.geo || con->flags != Connection::Flags::HasCircularSide) continue;
+        const GeometryRange* b = findRange(con->geo[1]);
+        if (!b) continue;
+
+        Vec3f p = makeVec3f(static_cast<float>(con->p.x - localOrigin.x),
+                            static_cast<float>(con->p.y - localOrigin.y),
+                            static_cast<float>(con->p.z - localOrigin.z));
+        findSeamVertices(ctx.tmpSeam[0], V, N, a, p, con->d, epsilon);
+        findSeamVertices(ctx.tmpSeam[1], V, N, *b, p, con->d, epsilon);
+        const std::vector<uint32_t>& sa = ctx.tmpSeam[0];
+        const std::vector<uint32_t>& sb = ctx.tmpSeam[1];
+        if (sa.empty() || sa.size() != sb.size()) continue;
+
+        // Both rings are short, a quadratic search is fine.
+        bool matched = true;
+        for (uint32_t j : sb) {
+          uint32_t match = ~0u;
+          float best = epsilon * epsilon;
+          for (uint32_t i : sa) {
+            float dd = distanceSquared(V[i], V[j]);
+            if (dd <= best && 0.999f < dot(N[i], N[j])) {
+              best = dd;
+              match = i;
+            }
+          }
+          if (match == ~0u) {
+            matched = false;
+            break;
+          }
+          while (remap[match] != match) match = remap[match];
+          if (match != j) remap[j] = match;
+        }
+        if (!matched) {
+          for (uint32_t j : sb) {
+            remap[j] = j;
+          }
+          continue;
+        }
+        stitched += sb.size();
+        ctx.stitchedSeams++;
+      }
+    }
+    if (stitched == 0) return vertexCount;
+
+    // Seams of one geometry may have been merged into another before the
+    // geometry was itself merged, so resolve chains before compacting.
+    for (size_t i = 0; i < vertexCount; i++) {
+      uint32_t r = remap[i];
+      while (remap[r] != r) r = remap[r];
+      remap[i] = r;
+    }
+
+    // Move the vertices that are still in use to the front.
+    std::vector<uint32_t>& compacted = ctx.tmpSeam[0];
+    compacted.resize(vertexCount);
+    uint32_t n = 0;
+    for (size_t i = 0; i < vertexCount; i++) {
+      if (remap[i] == i) {
+        V[n] = V[i];
+        N[n] = N[i];
+        compacted[i] = n++;
+      }
+    }
+    for (size_t i = 0; i < indexCount; i++) {
+      I[i] = compacted[remap[I[i]]];
+    }
+    ctx.stitchedVertices += vertexCount - n;
+    return n;
+  }
+
+  bool addPrimitiveForTriangulations(Context& ctx, Model& model, rj::Value& rjPrimitives, const std::span<const GeometryItem>& geos, const Vec3d& localOrigin, unsigned lod)
   {
     assert(!geos.empty());
     std::vector<Vec3f>& V = ctx.tmp3f_1;  // No need to clear, they get resized before written to
@@ -474,11 +846,13 @@ namespace {
     std::vector<uint32_t>& I = ctx.tmp32ui;
     size_t vertexOffset = 0;
     size_t indexOffset = 0;
+    ctx.tmpRanges.clear();
 
     for (const GeometryItem& item : geos) {
       const Geometry* geo = item.geo;
       assert(geo->kind != Geometry::Kind::Line);
-      if (!geo->triangulation) continue;  // Skip missing triangulations
+      const Triangulation* tri = getLevelOfDetail(geo, lod);
+      if (!tri) continue;  // Skip missing triangulations
 
       // Matrix that transform from local transform to cog
       Mat3x4d M = makeMat3x4d(geo->M_3x4.data);
@@ -488,16 +862,16 @@ namespace {
 
       const Mat3f T = makeMat3f(geo->M_3x4.data);
 
-      size_t vertexCount = geo->triangulation->vertices_n;
-      size_t indexCount = 3 * geo->triangulation->triangles_n;
+      size_t vertexCount = tri->vertices_n;
+      size_t indexCount = 3 * tri->triangles_n;
 
       // Transform vertices and normals into new frame
       V.resize(vertexOffset + vertexCount);
       N.resize(vertexOffset + vertexCount);
 
       for (size_t i = 0; i < vertexCount; i++) {
-        ctx.tmp3f_1[vertexOffset + i] = makeVec3f(mul(M, makeVec3d(geo->triangulation->vertices + 3 * i)));
-        Vec3f n = normalize(mul(T, makeVec3f(geo->triangulation->normals + 3 * i)));
+        ctx.tmp3f_1[vertexOffset + i] = makeVec3f(mul(M, makeVec3d(tri->vertex(i).data)));
+        Vec3f n = normalize(mul(T, tri->normal(i)));
         if (!std::isfinite(n.x) || !std::isfinite(n.y) || !std::isfinite(n.z)) {
           n = makeVec3f(1.f, 0.f, 0.f);
         }
@@ -507,13 +881,20 @@ namespace {
       // Transform indices
       I.resize(indexOffset + indexCount);
       for (size_t i = 0; i < indexCount; i++) {
-        I[indexOffset + i] = static_cast<uint32_t>(vertexOffset + geo->triangulation->indices[i]);
+        I[indexOffset + i] = static_cast<uint32_t>(vertexOffset + tri->index(i));
       }
 
+      if (ctx.stitchSeams) {
+        ctx.tmpRanges.push_back(GeometryRange{ geo, static_cast<uint32_t>(vertexOffset), static_cast<uint32_t>(vertexCount) });
+      }
       vertexOffset += vertexCount;
       indexOffset += indexCount;
     }
 
+    if (ctx.stitchSeams && 1 < ctx.tmpRanges.size()) {
+      vertexOffset = stitchSeams(ctx, V, N, I, vertexOffset, indexOffset, localOrigin);
+    }
+
     //ctx.logger(2, "exportGLTF: merged %zu meshes, vertexCount=%zu, indexCount=%zu", geos.size(), vertexOffset, indexOffset);
     if (vertexOffset != 0 && indexOffset != 0) {
       uint32_t positionAccessorIx = createAccessorVec3f(ctx, model, V.data(), vertexOffset, true);
@@ -540,6 +921,26 @@ namespace {
     return false; // No geometry added
   }
 
+  // Build primitives of geos, which must be sorted on sort key
+  void addMergedPrimitives(Context& ctx, Model& model, rj::Value& rjPrimitives, const std::vector<GeometryItem>& geos, const Vec3d& avg, unsigned lod)
+  {
+    // Break down into ranges of fixed sort key (fixed material and primitive type)
+    for (size_t a = 0, n = geos.size(); a < n; ) {
+      size_t b = a + 1;
+      while (b < n && geos[a].sortKey == geos[b].sortKey) { b++; }
+
+      // build primitive containing range
+      std::span<const GeometryItem> span(geos.data() + a, b - a);
+      if (geos[a].geo->kind == Geometry::Kind::Line) {
+        addPrimitiveForLines(ctx, model, rjPrimitives, span, avg);
+      }
+      else {
+        addPrimitiveForTriangulations(ctx, model, rjPrimitives, span, avg, lod);
+      }
+      a = b;
+    }
+  }
+
   bool insertMergedGeometriesIntoNode(Context& ctx, Model& model, rj::Value& node, std::vector<GeometryItem>& geos)
   {
     // Calc average pos and count number of vertices
@@ -557,7 +958,7 @@ namespace {
         }
         else if (geo->triangulation) {
           for (size_t i = 0; i < geo->triangulation->vertices_n; i++) {
-            avg = avg + mul(M, makeVec3d(geo->triangulation->vertices + 3 * i));
+            avg = avg + mul(M, makeVec3d(geo->triangulation->vertex(i).data));
           }
           nv += geo->triangulation->vertices_n;
         }
@@ -567,22 +968,8 @@ namespace {
 
     rj::Value rjPrimitives(rj::kArrayType);
 
-    // Break down into ranges of fixed sort key (fixed material and primitive type)    
     std::sort(geos.begin(), geos.end(), [](const GeometryItem& a, const GeometryItem& b) { return a.sortKey < b.sortKey; });
-    for (size_t a = 0, n = geos.size(); a < n; ) {
-      size_t b = a + 1;
-      while (b < n && geos[a].sortKey == geos[b].sortKey) { b++; }
-
-      // build primitive containing range
-      std::span<const GeometryItem> span(geos.data() + a, b - a);
-      if (geos[a].geo->kind == Geometry::Kind::Line) {
-        addPrimitiveForLines(ctx, model, rjPrimitives, span, avg);
-      }
-      else {
-        addPrimitiveForTriangulations(ctx, model, rjPrimitives, span, avg);
-      }
-      a = b;
-    }
+    addMergedPrimitives(ctx, model, rjPrimitives, geos, avg, 0);
 
     if (rjPrimitives.Empty()) {
       return false; // No primitives
@@ -590,17 +977,30 @@ namespace {
 
     rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
 
-    rj::Value mesh(rj::kObjectType);
-    mesh.AddMember("primitives", rjPrimitives, alloc);
-    uint32_t meshIndex = model.rjMeshes.Size();
-    model.rjMeshes.PushBack(mesh, alloc);
-
-    node.AddMember("mesh", meshIndex, alloc);
+    node.AddMember("mesh", addMesh(model, rjPrimitives), alloc);
 
     rj::Value translation(rj::kArrayType);
     for (size_t r = 0; r < 3; r++) {
       translation.PushBack(avg[r] - model.origin[r], alloc);
     }
+
+    // Coarser levels of detail, where geometries without that many levels
+    // contribute with their coarsest level.
+    unsigned levels = 1;
+    for (const GeometryItem& item : geos) {
+      levels = std::max(levels, levelOfDetailCount(item.geo));
+    }
+    if (1 < levels) {
+      rj::Value rjLodIds(rj::kArrayType);
+      for (unsigned lod = 1; lod < levels; lod++) {
+        rj::Value rjLodPrimitives(rj::kArrayType);
+        addMergedPrimitives(ctx, model, rjLodPrimitives, geos, avg, lod);
+        if (rjLodPrimitives.Empty()) break;
+        addLevelOfDetailNode(model, rjLodIds, rjLodPrimitives, "translation", translation);
+      }
+      setLevelsOfDetail(model, node, rjLodIds);
+    }
+
     node.AddMember("translation", translation, alloc);
 
     return true;
@@ -678,6 +1078,28 @@ namespace {
     }
   }
 
+  void addParametricRecords(Context& ctx, Model& model, rj::Value& rjNode, const std::vector<ParametricRecord>& records)
+  {
+    rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
+
+    uint32_t view_ix = createBufferView(ctx, model, records.data(), records.size(), sizeof(ParametricRecord), 0, true);
+
+    rj::Value rjParametric(rj::kObjectType);
+    rjParametric.AddMember("bufferView", view_ix, alloc);
+    rjParametric.AddMember("count", static_cast<uint32_t>(records.size()), alloc);
+    rjParametric.AddMember("byteStride", static_cast<uint32_t>(sizeof(ParametricRecord)), alloc);
+
+    // Attributes may already have created the extras object
+    auto it = rjNode.FindMember("extras");
+    if (it == rjNode.MemberEnd()) {
+      rjNode.AddMember("extras", rj::Value(rj::kObjectType), alloc);
+      it = rjNode.FindMember("extras");
+    }
+    it->value.AddMember("rvm-parametric", rjParametric, alloc);
+
+    ctx.parametricRecords += records.size();
+  }
+
   uint32_t processNode(Context& ctx, Model& model, const Node* node, size_t level)
   {
     rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc = model.rjAlloc;
@@ -720,16 +1142,31 @@ namespace {
 
         if(node->group.geometries.first != nullptr) {
 
-          // Collect all geometries
+          // Collect all geometries, in parametric mode all but lines and
+          // facet groups become records instead
           std::vector<GeometryItem>& geos = ctx.tmpGeos;
+          std::vector<ParametricRecord>& records = ctx.tmpRecords;
           geos.clear();
+          records.clear();
           for (Geometry* geo = node->group.geometries.first; geo; geo = geo->next) {
-            size_t sortKey = (static_cast<size_t>(createOrGetColor(ctx, model, geo)) << 1) | (geo->kind == Geometry::Kind::Line ? 1 : 0);
+            uint32_t material = createOrGetColor(ctx, model, geo);
+            if (ctx.parametric && isParametric(geo)) {
+              encodeParametric(records.emplace_back(), geo, material, model.origin);
+              continue;
+            }
+            size_t sortKey = (static_cast<size_t>(material) << 1) | (geo->kind == Geometry::Kind::Line ? 1 : 0);
             geos.push_back({ .sortKey = sortKey, .geo = geo });
           }
 
+          // Records are in the frame of this node, so it must keep its identity transform
+          if (!records.empty()) {
+            addParametricRecords(ctx, model, rjNode, records);
+          }
+
           // Add geometries under node
-          addGeometries(ctx, model, rjNode, children, geos, node->children.first == nullptr);
+          if (!geos.empty()) {
+            addGeometries(ctx, model, rjNode, children, geos, node->children.first == nullptr && records.empty());
+          }
 
         }
       }
@@ -851,7 +1288,7 @@ namespace {
     if (ctx.glbContainer) {
       assert(model.rjBuffers.Empty());
       rj::Value rjGlbBuffer(rj::kObjectType);
-      rjGlbBuffer.AddMember("byteLength", model.dataBytes, alloc);
+      rjGlbBuffer.AddMember("byteLength", static_cast<uint64_t>(model.dataBytes), alloc);
       model.rjBuffers.PushBack(rjGlbBuffer, alloc);
     }
 
@@ -869,6 +1306,12 @@ namespace {
     rjDoc.AddMember("bufferViews", model.rjBufferViews, alloc);
     rjDoc.AddMember("buffers", model.rjBuffers, alloc);
 
+    if (model.lodUsed) {
+      rj::Value rjExtensionsUsed(rj::kArrayType);
+      rjExtensionsUsed.PushBack("MSFT_lod", alloc);
+      rjDoc.AddMember("extensionsUsed", rjExtensionsUsed, alloc);
+    }
+
     return rjDoc;
   }
 
@@ -895,7 +1338,7 @@ namespace {
       8 + model.dataBytes;              // BVIN header and payload
 
     if (std::numeric_limits<uint32_t>::max() < total_size) {
-      ctx.logger(2, "%s: File would be %zu bytes, a number too large to store in 32 bits in the GLB header.");
+      ctx.logger(2, "%s: File would be %zu bytes, a number too large to store in 32 bits in the GLB header.", path, total_size);
       return false;
     }
     uint32_t header[3] = {
@@ -937,7 +1380,7 @@ namespace {
 
     // -------- write BIN chunk ------------------------------------------------
     uint32_t binChunkHeader[2] = {
-      model.dataBytes,  // length of chunk data
+      static_cast<uint32_t>(model.dataBytes),  // length of chunk data
       0x004E4942            // chunk type (BIN)
     };
 
@@ -947,10 +1390,10 @@ namespace {
       return false;
     }
 
-    uint32_t offset = 0;
+    size_t offset = 0;
     for (DataItem* item = model.dataItems.first; item; item = item->next) {
       if (fwrite(item->ptr, item->size, 1, out) != 1) {
-        ctx.logger(2, "%s: Error writing BIN chunk data at offset %u", path, offset);
+        ctx.logger(2, "%s: Error writing BIN chunk data at offset %zu", path, offset);
         fclose(out);
         return false;
       }
@@ -964,8 +1407,70 @@ namespace {
     return true;
   }
 
-  bool writeAsGLTF(Context& ctx, FILE* out, const char* path, const rj::Document& rjDoc)
+  template<typename Writer>
+  void writeBase64Uri(Context& ctx, Writer& writer, rj::FileWriteStream& os, FILE* out, const DataItem* item)
   {
+    static const char prefix[] = "data:application/octet-stream;base64,";
+    static const size_t prefixLength = sizeof(prefix) - 1;
+
+    // Let the writer emit any separator, then bypass it to write the string
+    // contents directly, it contains no characters that need escaping.
+    writer.RawValue("", 0, rj::kStringType);
+    os.Put('"');
+    for (size_t i = 0; i < prefixLength; i++) {
+      os.Put(prefix[i]);
+    }
+    os.Flush();
+
+    // Encode chunks of a multiple of three bytes into the reusable buffer
+    const size_t chunkBytes = 3 * 0x4000;
+    ctx.tmpBase64.resize(4 * (chunkBytes / 3));
+
+    const uint8_t* data = static_cast<const uint8_t*>(item->ptr);
+    for (size_t o = 0; o < item->size; o += chunkBytes) {
+      size_t n = encodeBase64(ctx.tmpBase64.data(), data + o, std::min(chunkBytes, item->size - o));
+      if (fwrite(ctx.tmpBase64.data(), 1, n, out) != n) {
+        // Error is picked up by ferror when closing the file
+        break;
+      }
+    }
+    os.Put('"');
+  }
+
+  template<typename Writer>
+  bool writeGLTFDocument(Context& ctx, Model& model, Writer& writer, rj::FileWriteStream& os, FILE* out, const rj::Document& rjDoc)
+  {
+    // Buffers are written separately to stream base64-encoded data straight
+    // to the file, the rest is passed on to the writer.
+    writer.StartObject();
+    for (auto it = rjDoc.MemberBegin(); it != rjDoc.MemberEnd(); ++it) {
+      writer.Key(it->name.GetString(), it->name.GetStringLength());
+      if (it->name == "buffers") {
+        rj::SizeType n = 0;
+        writer.StartArray();
+        for (const DataItem* item = model.dataItems.first; item; item = item->next, n++) {
+          writer.StartObject();
+          writer.Key("uri");
+          writeBase64Uri(ctx, writer, os, out, item);
+          writer.Key("byteLength");
+          writer.Uint64(item->size);
+          writer.EndObject();
+        }
+        assert(n == it->value.Size());
+        (void)n;
+        writer.EndArray();
+      }
+      else if (!it->value.Accept(writer)) {
+        return false;
+      }
+    }
+    return writer.EndObject();
+  }
+
+  bool writeAsGLTF(Context& ctx, Model& model, FILE* out, const char* path, const rj::Document& rjDoc)
+  {
+    auto time0 = std::chrono::high_resolution_clock::now();
+
     std::vector<char> writeBuffer(0x10000);
     rj::FileWriteStream os(out, writeBuffer.data(), writeBuffer.size());
 #if RVMPARSER_GLTF_PRETTY_PRINT == 1
@@ -975,10 +1480,19 @@ namespace {
 #else
     rj::Writer<rj::FileWriteStream> writer(os);
 #endif
-    if (!rjDoc.Accept(writer)) {
+    if (!writeGLTFDocument(ctx, model, writer, os, out, rjDoc)) {
       ctx.logger(2, "%s: Failed to write json", path);
       return false;
     }
+    os.Flush();
+    if (ferror(out)) {
+      ctx.logger(2, "%s: Error writing file", path);
+      return false;
+    }
+
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+    ctx.logger(0, "exportGLTF: Wrote %s with %zu KB of buffer data base64-encoded (%s) in %lldms",
+               path, (model.dataBytes + 1023) / 1024, base64EncoderName, ms);
     return true;
   }
 
@@ -1014,7 +1528,7 @@ namespace {
       success = writeAsGLB(ctx, model, out, path, rjDoc);
     }
     else {
-      success = writeAsGLTF(ctx, out, path, rjDoc);
+      success = writeAsGLTF(ctx, model, out, path, rjDoc);
     }
 
     fclose(out);
@@ -1025,14 +1539,16 @@ namespace {
 }
 
 
-bool exportGLTF(Store* store, Logger logger, const char* path, size_t splitLevel, bool rotateZToY, bool centerModel, bool includeAttributes, bool mergeGeometries)
+bool exportGLTF(Store* store, Logger logger, const char* path, size_t splitLevel, bool rotateZToY, bool centerModel, bool includeAttributes, bool mergeGeometries, bool stitchSeams, bool parametric)
 {
   Context ctx{
     .logger = logger,
     .centerModel = centerModel,
     .rotateZToY = rotateZToY,
     .includeAttributes = includeAttributes,
-    .mergeGeometries = mergeGeometries
+    .mergeGeometries = mergeGeometries,
+    .stitchSeams = stitchSeams,
+    .parametric = parametric
   };
   ctx.split.level = splitLevel;
 
@@ -1104,6 +1620,13 @@ bool exportGLTF(Store* store, Logger logger, const char* path, size_t splitLevel
     ctx.split.choose++;
   } while (ctx.split.choose < ctx.split.index);
 
+  if (ctx.stitchSeams) {
+    ctx.logger(0, "exportGLTF: Stitched %zu seams, sharing %zu vertices", ctx.stitchedSeams, ctx.stitchedVertices);
+  }
+  if (ctx.parametric) {
+    ctx.logger(0, "exportGLTF: Wrote %zu parametric primitives as records", ctx.parametricRecords);
+  }
+
 
   return true;
 }
@@ -1,5 +1,4 @@
-#include <rapidjson/document.h>
-#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
 #include <rapidjson/prettywriter.h>
 #include <rapidjson/filewritestream.h>
 
@@ -12,87 +11,125 @@ namespace rj = rapidjson;
 
 namespace {
 
+  // Writes straight from the store through the SAX interface, strings are
+  // emitted in-place and nothing is copied into an intermediate DOM.
 
-  void process(rj::MemoryPoolAllocator<>& alloc, rj::Value& jParentArray, Logger logger, Node* group)
+  template<typename Writer>
+  void writeGroup(Writer& writer, Node* group)
   {
     assert(group->kind == Node::Kind::Group);
 
-    rj::Value jGroup(rj::kObjectType);
-    jGroup.AddMember("name", rj::Value(group->group.name, alloc), alloc);
-    jGroup.AddMember("material", group->group.material, alloc);
+    writer.Key("name");
+    writer.String(group->group.name);
+    writer.Key("material");
+    writer.Uint(group->group.material);
 
     if (isNotEmpty(group->group.bboxWorld)) {
-      rj::Value bbox(rj::kArrayType);
+      writer.Key("bbox");
+      writer.StartArray();
       for (unsigned k = 0; k < 6; k++) {
-        bbox.PushBack(rj::Value(group->group.bboxWorld.data[k]), alloc);
+        writer.Double(group->group.bboxWorld.data[k]);
       }
-      jGroup.AddMember("bbox", bbox, alloc);
+      writer.EndArray();
     }
 
     if (group->attributes.first) {
-      rj::Value jAttributes(rj::kObjectType);
-
+      writer.Key("attributes");
+      writer.StartObject();
       for (auto * att = group->attributes.first; att; att = att->next) {
-        jAttributes.AddMember(rj::GenericStringRef(att->key), rj::Value(att->val, alloc), alloc);
+        writer.Key(att->key);
+        writer.String(att->val);
       }
-      jGroup.AddMember("attributes", jAttributes, alloc);
+      writer.EndObject();
     }
 
     if (group->children.first) {
-      rj::Value jChildren(rj::kArrayType);
+      writer.Key("children");
+      writer.StartArray();
       for (auto * child = group->children.first; child; child = child->next) {
-        process(alloc, jChildren, logger, child);
+        writer.StartObject();
+        writeGroup(writer, child);
+        writer.EndObject();
       }
-      jGroup.AddMember("children", jChildren, alloc);
+      writer.EndArray();
     }
-    jParentArray.PushBack(jGroup, alloc);
   }
 
-}
-
-
-
-bool exportJson(Store* store, Logger logger, const char* path)
-{
-
-  rj::Document d;
-  d.SetArray();
-  auto & alloc = d.GetAllocator();
+  void writeHierarchy(rj::FileWriteStream& os, Store* store)
+  {
+    rj::PrettyWriter<rj::FileWriteStream> writer(os);
+    writer.SetIndent(' ', 2);
+    writer.SetMaxDecimalPlaces(4);
+
+    writer.StartArray();
+    for (auto * root = store->getFirstRoot(); root != nullptr; root = root->next) {
+      assert(root->kind == Node::Kind::File);
+      writer.StartObject();
+      writer.Key("info"); writer.String(root->file.info);
+      writer.Key("note"); writer.String(root->file.note);
+      writer.Key("date"); writer.String(root->file.date);
+      writer.Key("user"); writer.String(root->file.user);
+
+      if (root->children.first) {
+        writer.Key("children");
+        writer.StartArray();
+        for (auto * model = root->children.first; model != nullptr; model = model->next) {
+          assert(model->kind == Node::Kind::Model);
+          writer.StartObject();
+          writer.Key("project"); writer.String(model->model.project);
+          writer.Key("name"); writer.String(model->model.name);
+
+          if (model->children.first) {
+            writer.Key("children");
+            writer.StartArray();
+            for (auto * group = model->children.first; group != nullptr; group = group->next) {
+              writer.StartObject();
+              writeGroup(writer, group);
+              writer.EndObject();
+            }
+            writer.EndArray();
+          }
+          writer.EndObject();
+        }
+        writer.EndArray();
+      }
+      writer.EndObject();
+    }
+    writer.EndArray();
+  }
 
-  for (auto * root = store->getFirstRoot(); root != nullptr; root = root->next) {
-    assert(root->kind == Node::Kind::File);
-    rj::Value jRoot(rj::kObjectType);
-    jRoot.AddMember("info", rj::Value(root->file.info, alloc), alloc);
-    jRoot.AddMember("note", rj::Value(root->file.note, alloc), alloc);
-    jRoot.AddMember("date", rj::Value(root->file.date, alloc), alloc);
-    jRoot.AddMember("user", rj::Value(root->file.user, alloc), alloc);
+  // One line per top-level group, tagged with the file and model it belongs
+  // to, so that consumers can split the file on newlines and load in parallel.
+  void writeLines(rj::FileWriteStream& os, Store* store)
+  {
+    rj::Writer<rj::FileWriteStream> writer(os);
+    writer.SetMaxDecimalPlaces(4);
 
-    if (root->children.first) {
-      rj::Value jRootChildren(rj::kArrayType);
+    unsigned fileIndex = 0;
+    for (auto * root = store->getFirstRoot(); root != nullptr; root = root->next, fileIndex++) {
+      assert(root->kind == Node::Kind::File);
       for (auto * model = root->children.first; model != nullptr; model = model->next) {
-
         assert(model->kind == Node::Kind::Model);
-        rj::Value jModel(rj::kObjectType);
-        jModel.AddMember("project", rj::Value(model->model.project, alloc), alloc);
-        jModel.AddMember("name", rj::Value(model->model.name, alloc), alloc);
-
-        if (model->children.first) {
-          rj::Value jModelChildren(rj::kArrayType);
-          for (auto * group = model->children.first; group != nullptr; group = group->next) {
-            process(alloc, jModelChildren, logger, group);
-          }
-          jModel.AddMember("children", jModelChildren, alloc);
+        for (auto * group = model->children.first; group != nullptr; group = group->next) {
+          writer.StartObject();
+          writer.Key("file"); writer.Uint(fileIndex);
+          writer.Key("project"); writer.String(model->model.project);
+          writer.Key("model"); writer.String(model->model.name);
+          writeGroup(writer, group);
+          writer.EndObject();
+          os.Put('\n');
+          writer.Reset(os);
         }
-
-        jRootChildren.PushBack(jModel, alloc);
       }
-      jRoot.AddMember("children", jRootChildren, alloc);
     }
-
-    d.GetArray().PushBack(jRoot, alloc);
   }
 
+}
+
 
+
+bool exportJson(Store* store, Logger logger, const char* path, bool lines)
+{
 #ifdef _WIN32
   FILE* out = nullptr;
   auto err = fopen_s(&out, path, "w");
@@ -114,10 +151,18 @@ bool exportJson(Store* store, Logger logger, const char* path)
 
   char writeBuffer[0x10000];
   rj::FileWriteStream os(out, writeBuffer, sizeof(writeBuffer));
-  rj::PrettyWriter<rj::FileWriteStream> writer(os);
-  writer.SetIndent(' ', 2);
-  writer.SetMaxDecimalPlaces(4);
-  d.Accept(writer);
-  fclose(out);
-  return true;
+  if (lines) {
+    writeLines(os, store);
+  }
+  else {
+    writeHierarchy(os, store);
+  }
+  os.Flush();
+
+  bool ok = ferror(out) == 0;
+  if (fclose(out) != 0) ok = false;
+  if (!ok) {
+    logger(2, "Failed to write %s.", path);
+  }
+  return ok;
 }
@@ -9,6 +9,12 @@
 #include <span>
 #include <memory>
 #include <cctype>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
@@ -23,8 +29,12 @@
 #include <cstdint> 
 #include <e5d_Shape.h>
 
+#include "PipeTransport.h"
+
+#ifdef _WIN32
 #define NOMINMAX
 #include "windows.h"
+#endif
 
 
 
@@ -134,6 +144,30 @@ namespace ExportNamedPipe{
     const Geometry* geo;
   };
 
+  struct FrameSender;
+
+  // Shape records are the expensive part of the walk: tessellation, building
+  // and serializing the e5d shape, and converting the name. They are encoded
+  // ahead of the walk in batches, workers appending complete records to their
+  // own chunk. The walk copies each record into the frame and fills in the
+  // ids, so ids and framing are the same as when encoding inline.
+  struct ShapeJob
+  {
+    Geometry* geo = nullptr;
+    const char* instName = nullptr;
+    int GeoIndex = 0;
+    unsigned worker = 0;  // Worker whose chunk holds the record
+    size_t offset = 0;
+    size_t size = 0;      // Zero if the geometry did not produce a shape
+  };
+
+  struct ShapeWorker
+  {
+    TriangulationFactory* factory = nullptr;
+    Arena arena;          // Triangulations missing from the store, cleared each batch
+    std::vector<char> chunk;
+  };
+
   struct Context {
     Logger logger = nullptr;
     
@@ -158,51 +192,39 @@ namespace ExportNamedPipe{
     bool includeAttributes = false;
     bool glbContainer = false;
     bool mergeGeometries = true;
-  };
 
-  bool IsValidUTF8(const char* str) {
-      while (*str) {
-          if ((*str & 0x80) == 0) str++; // ASCIIַ 
-          else if ((*str & 0xE0) == 0xC0) { // 2ַֽ 
-              if ((str[1] & 0xC0) != 0x80) return false;
-              str += 2;
-          }
-          else if ((*str & 0xF0) == 0xE0) { // 3ַֽ
-              for (int i = 1; i <= 2; ++i)
-                  if ((str[i] & 0xC0) != 0x80) return false;
-              str += 3;
-          }
-          else if ((*str & 0xF8) == 0xF0) { // 4ַֽ 
-              for (int i = 1; i <= 3; ++i)
-                  if ((str[i] & 0xC0) != 0x80) return false;
-              str += 4;
-          }
-          else return false;
-      }
-      return true;
-  }
+    unsigned creditWindow = 0;  // Frames the consumer initially grants, 0 disables flow control
+    unsigned credits = 0;       // Frames we may still send before waiting for a credit message
+    bool failed = false;        // Set on the first transport error, nothing is sent after that
 
-  // ANSI ת UTF-8ͷŷص char* ڴ棩
-  char* ConvertToUTF8(const char* ansiStr) {
-      // Step 1: ANSI  WideChar
-      int wlen = MultiByteToWideChar(CP_ACP, 0, ansiStr, -1, NULL, 0);
-      wchar_t* wbuf = new wchar_t[wlen];
-      MultiByteToWideChar(CP_ACP, 0, ansiStr, -1, wbuf, wlen);
-      // Step 2: WideChar  UTF-8
-      int ulen = WideCharToMultiByte(CP_UTF8, 0, wbuf, -1, NULL, 0, NULL, NULL);
-      char* utf8Buf = new char[ulen];
-      WideCharToMultiByte(CP_UTF8, 0, wbuf, -1, utf8Buf, ulen, NULL, NULL);
-
-      delete[] wbuf;
-      return utf8Buf; //  delete[] ͷ
-  }
+    FrameSender* sender = nullptr;
 
-  std::wstring string_to_wstring(const std::string& str) {
-      int size_needed = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), NULL, 0);
-      std::wstring result(size_needed, 0);
-      MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), &result[0], size_needed);
-      return result;
-  }
+    std::vector<ShapeJob> shapeJobs;  // Shapes in walk order
+    std::vector<ShapeWorker> shapeWorkers;
+    size_t shapeNext = 0;             // Next job to be sequenced
+    size_t shapeEncoded = 0;          // Jobs before this have been encoded
+  };
+
+  // Frames are filled by the tree walk and written by a dedicated sender
+  // thread, so the walk only stalls when every buffer is queued or in flight.
+  // producerStall is time the walk waited for a free buffer, and senderIdle
+  // time the sender waited for a filled frame. A large producerStall means
+  // the consumer is the bottleneck, more buffers only help if it is bursty.
+  struct FrameSender
+  {
+      std::vector<char*> buffers;
+      std::vector<char*> freeBuffers;
+      std::deque<std::pair<char*, size_t>> queued;
+      std::mutex mutex;
+      std::condition_variable cond;
+      std::thread thread;
+      bool finished = false;
+
+      unsigned frames = 0;
+      std::chrono::high_resolution_clock::duration producerStall{};
+      std::chrono::high_resolution_clock::duration senderIdle{};
+      std::chrono::high_resolution_clock::duration writing{};
+  };
 
   //uint32_t addDataItem(Context& /*ctx*/, Model& model, const void* ptr, size_t size, bool copy)
   //{
@@ -270,42 +292,119 @@ namespace ExportNamedPipe{
     }
   }
 
-  void processNode(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos, TriangulationFactory* factory, const Node* node, size_t level, const int64_t& parentId);
+  void processNode(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, const Node* node, size_t level, const int64_t& parentId);
 
-  void processChildren(Context& ctx, HANDLE hPipe, char* PipeDataBuffer,size_t& PipeDataBufferPos, TriangulationFactory* factory, const Node* firstChild, size_t level, const int64_t& parentId)
+  void processChildren(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, const Node* firstChild, size_t level, const int64_t& parentId)
   {
     size_t nextLevel = level + 1;
     for (const Node* child = firstChild; child; child = child->next) {
-        processNode(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, factory, child, nextLevel, parentId);
+        processNode(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, child, nextLevel, parentId);
     }
   }
 
-  bool ReadWaiting(Context& ctx, HANDLE hPipe)
+  // Credit based flow control, replacing the per-frame ack. With a credit
+  // window of zero frames are written freely, which is what consumers that
+  // never reply expect. Otherwise the consumer has initially granted
+  // creditWindow frames, and replies with a 888 message whose contentLength is
+  // the number of frames it has made room for. A contentLength of 0 counts as
+  // one, so a consumer sending a plain ack per frame works with a window of 1.
+  bool AcquireCredit(Context& ctx, PipeTransport* pipe)
   {
+      if (ctx.creditWindow == 0) return true;
+
+      while (ctx.credits == 0) {
+          CustomMessageHeader header;
+          if (!pipe->read(&header, sizeof(header))) {
+              return false;
+          }
+          if (header.msgType != 888) {
+              ctx.logger(2, "exportNamedPipe: expected credit message 888, got %d", header.msgType);
+              return false;
+          }
+          ctx.credits += unsigned(std::max(1, header.contentLength));
+      }
+      ctx.credits--;
       return true;
-      //// 3. ͨѭ 
-      //DWORD bytesRead;
-      //CustomMessageHeader header;
-      //BOOL success = ReadFile(hPipe, &header, sizeof(header), &bytesRead, NULL);
-
-      //if (!success) {
-      //    DWORD err = GetLastError();
-      //    if (err == ERROR_BROKEN_PIPE || err == ERROR_NO_DATA) {
-      //        // ͻѶϿ [3]()
-
-      //        ctx.logger(2, "ѶϿ...");
-      //    }
-      //    return false;
-      //}
-
-      //if (header.msgType == 888)
-      //    return true;
-      //return false;
   }
 
 
 
-  void SendPipeDataBuffer(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos)
+  void SenderLoop(Context& ctx, PipeTransport* pipe)
+  {
+      FrameSender& sender = *ctx.sender;
+      std::unique_lock<std::mutex> lock(sender.mutex);
+      while (true) {
+          auto time0 = std::chrono::high_resolution_clock::now();
+          sender.cond.wait(lock, [&sender] { return !sender.queued.empty() || sender.finished; });
+          sender.senderIdle += std::chrono::high_resolution_clock::now() - time0;
+          if (sender.queued.empty()) break;
+
+          auto frame = sender.queued.front();
+          sender.queued.pop_front();
+          lock.unlock();
+
+          // After a failure, frames are only recycled so the producer does not block.
+          auto time1 = std::chrono::high_resolution_clock::now();
+          if (!ctx.failed) {
+              if (!AcquireCredit(ctx, pipe) || !pipe->write(frame.first, frame.second)) {
+                  ctx.failed = true;
+              }
+          }
+          auto time2 = std::chrono::high_resolution_clock::now();
+
+          lock.lock();
+          sender.writing += time2 - time1;
+          sender.freeBuffers.push_back(frame.first);
+          sender.cond.notify_all();
+      }
+  }
+
+  void StartSender(Context& ctx, PipeTransport* pipe, unsigned frameBuffers)
+  {
+      ctx.sender = new FrameSender();
+      for (unsigned i = 0; i < std::max(2u, frameBuffers); i++) {
+          ctx.sender->buffers.push_back((char*)malloc(PipeDataBufferLen));
+      }
+      ctx.sender->freeBuffers = ctx.sender->buffers;
+      ctx.sender->thread = std::thread(SenderLoop, std::ref(ctx), pipe);
+  }
+
+  char* AcquireBuffer(Context& ctx)
+  {
+      FrameSender& sender = *ctx.sender;
+      std::unique_lock<std::mutex> lock(sender.mutex);
+      auto time0 = std::chrono::high_resolution_clock::now();
+      sender.cond.wait(lock, [&sender] { return !sender.freeBuffers.empty(); });
+      sender.producerStall += std::chrono::high_resolution_clock::now() - time0;
+
+      char* buffer = sender.freeBuffers.back();
+      sender.freeBuffers.pop_back();
+      return buffer;
+  }
+
+  void StopSender(Context& ctx)
+  {
+      FrameSender* sender = ctx.sender;
+      {
+          std::lock_guard<std::mutex> lock(sender->mutex);
+          sender->finished = true;
+          sender->cond.notify_all();
+      }
+      sender->thread.join();
+
+      auto ms = [](std::chrono::high_resolution_clock::duration d) { return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+      ctx.logger(0, "exportNamedPipe: %u frames through %zu buffers, producer stalled %lldms, sender idle %lldms, writing %lldms",
+                 sender->frames, sender->buffers.size(), ms(sender->producerStall), ms(sender->senderIdle), ms(sender->writing));
+
+      for (char* buffer : sender->buffers) {
+          free(buffer);
+      }
+      delete sender;
+      ctx.sender = nullptr;
+  }
+
+  // Terminates the frame, hands it to the sender thread and continues in the next free buffer.
+  void SendPipeDataBuffer(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos)
   {
       char* CurrentBufferAddress = PipeDataBuffer + PipeDataBufferPos;
 
@@ -314,43 +413,29 @@ namespace ExportNamedPipe{
       CustomMessageHeader& pMsg = *(new (CurrentBufferAddress)CustomMessageHeader());
       pMsg.msgType = 777;
 
-      DWORD bytesWritten;
-      WriteFile(hPipe, PipeDataBuffer, PipeDataBufferPos, &bytesWritten, NULL);
-
-      ReadWaiting(ctx, hPipe);
+      {
+          std::lock_guard<std::mutex> lock(ctx.sender->mutex);
+          ctx.sender->queued.emplace_back(PipeDataBuffer, PipeDataBufferPos);
+          ctx.sender->frames++;
+          ctx.sender->cond.notify_all();
+      }
 
+      PipeDataBuffer = AcquireBuffer(ctx);
       PipeDataBufferPos = 0;
   }
 
 
-  void SendModel(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos, const Node* node, const char* modelname,int64_t & nodeId)
+  void SendModel(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, const Node* node, const char* modelname,int64_t & nodeId)
   {
-      const char* utf8Data = nullptr;
-      int utf8Len = 0;
-      bool needdelete = false;
-      if (modelname)
-      {
-          //
-            // תΪ UTF-8
-          if (!IsValidUTF8(modelname))
-          {
-              utf8Data = ConvertToUTF8(modelname);
-              needdelete = true;
-          }
-          else
-          {
-              utf8Data = modelname;
-          }
-          utf8Len = strlen(utf8Data); // ȡֽڳ 
-
-      }
+      const char* utf8Data = __store->utf8Names.get(modelname);
+      int utf8Len = utf8Data ? strlen(utf8Data) : 0; // ȡֽڳ 
 
       int buffersize = sizeof(int64_t) + sizeof(double) * 6 + utf8Len;;
 
       if (PipeDataBufferPos + buffersize + sizeof(CustomMessageHeader) >= PipeDataBufferLen)
       {
           //ｫPipeDataBufferͣȻ
-          SendPipeDataBuffer(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos);
+          SendPipeDataBuffer(ctx, pipe, PipeDataBuffer, PipeDataBufferPos);
       }
 
       char* CurrentBufferAddress = PipeDataBuffer + PipeDataBufferPos;
@@ -423,41 +508,14 @@ namespace ExportNamedPipe{
       //WriteFile(hPipe, worldMin, sizeof(worldMin), &bytesWritten, NULL);
       //WriteFile(hPipe, worldMax, sizeof(worldMax), &bytesWritten, NULL);
       //WriteFile(hPipe, utf8Data, utf8Len, &bytesWritten, NULL);
-
-
-      if (needdelete)
-      {
-          delete[] utf8Data;
-      }
   }
 
 
-  void SendInstance(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos, const BBox3f& bboxWorld, const char* instName,const std::vector<double> & matrix, const int64_t& parentId, int64_t& nodeId)
+  void SendInstance(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, const BBox3f& bboxWorld, const char* instName,const std::vector<double> & matrix, const int64_t& parentId, int64_t& nodeId)
   {
-      const char* utf8Data = nullptr;
-      int utf8Len = 0;
-      bool needdelete = false;
-      bool isSignificant = false;
-      if (instName)
-      {
-          if (strlen(instName) > 0 && instName[0] == '/')
-          {
-              isSignificant = true;
-          }
-          //
-            // תΪ UTF-8
-          if (!IsValidUTF8(instName))
-          {
-              utf8Data = ConvertToUTF8(instName);
-              needdelete = true;
-          }
-          else
-          {
-              utf8Data = instName;
-          }
-          utf8Len = strlen(utf8Data); // ȡֽڳ 
-
-      }
+      const char* utf8Data = __store->utf8Names.get(instName);
+      int utf8Len = utf8Data ? strlen(utf8Data) : 0; // ȡֽڳ 
+      bool isSignificant = instName && instName[0] == '/';
 
 
       int buffersize = sizeof(int64_t) + sizeof(int64_t) + sizeof(bool) + sizeof(double) * 6 + utf8Len;
@@ -465,7 +523,7 @@ namespace ExportNamedPipe{
       if (PipeDataBufferPos + buffersize + sizeof(CustomMessageHeader) >= PipeDataBufferLen)
       {
           //ｫPipeDataBufferͣȻ
-          SendPipeDataBuffer(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos);
+          SendPipeDataBuffer(ctx, pipe, PipeDataBuffer, PipeDataBufferPos);
 
 
           PipeDataBufferPos = 0;
@@ -561,12 +619,6 @@ namespace ExportNamedPipe{
       //WriteFile(hPipe, worldMin, sizeof(worldMin), &bytesWritten, NULL);
       //WriteFile(hPipe, worldMax, sizeof(worldMax), &bytesWritten, NULL);
       //WriteFile(hPipe, utf8Data, utf8Len, &bytesWritten, NULL);
-
-
-      if (needdelete)
-      {
-          delete[] utf8Data;
-      }
   }
 
   bool Shape2Binary(std::shared_ptr< e5d_Shape>& shape, std::string& binary)
@@ -603,7 +655,7 @@ namespace ExportNamedPipe{
       return matId;
   }
 
-  bool SendMaterial(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos, Geometry* geo, int64_t& matId)
+  bool SendMaterial(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, Geometry* geo, int64_t& matId)
   {
       bool created = false;
       matId = createOrGetColor(ctx, geo, created);
@@ -636,7 +688,7 @@ namespace ExportNamedPipe{
           if (PipeDataBufferPos + buffersize + sizeof(CustomMessageHeader) >= PipeDataBufferLen)
           {
               //ｫPipeDataBufferͣȻ
-              SendPipeDataBuffer(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos);
+              SendPipeDataBuffer(ctx, pipe, PipeDataBuffer, PipeDataBufferPos);
 
               PipeDataBufferPos = 0;
           }
@@ -787,20 +839,24 @@ namespace ExportNamedPipe{
   }
 
 
-  bool SendShape(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos, TriangulationFactory* factory, const char* instName, const int& GeoIndex, Geometry* geo, const int64_t& instanceId)
+  // Runs on a worker thread, must only touch the job, the worker and the geometry.
+  void EncodeShape(ShapeWorker& worker, ShapeJob& job)
   {
-      if (geo->kind == Geometry::Kind::Line)
-          return false;
+      Geometry* geo = job.geo;
+      const char* instName = job.instName;
+      const int& GeoIndex = job.GeoIndex;
+      TriangulationFactory* factory = worker.factory;
+
+      job.size = 0;
 
       int TriangleCount = 0;
-      int64_t  matId = 0;
-      if (SendMaterial(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, geo, matId))
-      {
-          //ReadWaiting(ctx, hPipe);
-      }
 
       std::string geoname;
 
+      // Triangulations are only used for the triangle count and facet group
+      // meshes, so missing ones go to the worker arena instead of the store.
+      Triangulation* tri = geo->triangulation;
+
       auto scale = getScale(geo->M_3x4);
 
       std::shared_ptr< e5d_Shape> shape = nullptr;
@@ -817,10 +873,10 @@ namespace ExportNamedPipe{
           subshape->offset[1] = geo->pyramid.offset[1];
           subshape->height = geo->pyramid.height;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->pyramid(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->pyramid(&worker.arena, geo, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -836,10 +892,10 @@ namespace ExportNamedPipe{
           subshape->lengthy = geo->box.lengths[1];
           subshape->lengthz = geo->box.lengths[2];
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->box(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->box(&worker.arena, geo, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
           //TriangleCount = 12;
 
           shape = subshape;
@@ -858,10 +914,10 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->rectangularTorus(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->rectangularTorus(&worker.arena, geo, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -876,10 +932,10 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->sphereBasedShape(&__store->arenaTriangulation, geo, 0.5f * geo->sphere.diameter, pi, 0.f, 1.f, scale);
+          if (tri == nullptr)
+              tri = factory->sphereBasedShape(&worker.arena, geo, 0.5f * geo->sphere.diameter, pi, 0.f, 1.f, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -893,35 +949,37 @@ namespace ExportNamedPipe{
 
       {
           auto scale = getScale(geo->M_3x4);
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->facetGroup(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->facetGroup(&worker.arena, geo, scale);
           std::shared_ptr<e5d_Mesh> subshape = std::make_shared<e5d_Mesh>();
-          for (size_t i = 0; i < geo->triangulation->vertices_n; i++)
+          for (size_t i = 0; i < tri->vertices_n; i++)
           {
               {
                   std::shared_ptr<e5d_Vector> vt = std::make_shared<e5d_Vector>();
-                  vt->x = geo->triangulation->vertices[i * 3];
-                  vt->y = geo->triangulation->vertices[i * 3 + 1];
-                  vt->z = geo->triangulation->vertices[i * 3 + 2];
+                  Vec3f p = tri->vertex(i);
+                  vt->x = p.x;
+                  vt->y = p.y;
+                  vt->z = p.z;
                   subshape->postions.push_back(vt);
               }
               {
                   std::shared_ptr<e5d_Vector> vt = std::make_shared<e5d_Vector>();
-                  vt->x = geo->triangulation->normals[i * 3];
-                  vt->y = geo->triangulation->normals[i * 3 + 1];
-                  vt->z = geo->triangulation->normals[i * 3 + 2];
+                  Vec3f n = tri->normal(i);
+                  vt->x = n.x;
+                  vt->y = n.y;
+                  vt->z = n.z;
                   subshape->normals.push_back(vt);
               }
           }
-          for (size_t i = 0; i < geo->triangulation->triangles_n; i++)
+          for (size_t i = 0; i < tri->triangles_n; i++)
           {
-              subshape->faces.push_back(geo->triangulation->indices[i * 3]);
-              subshape->faces.push_back(geo->triangulation->indices[i * 3 + 1]);
-              subshape->faces.push_back(geo->triangulation->indices[i * 3 + 2]);
+              subshape->faces.push_back(tri->index(i * 3));
+              subshape->faces.push_back(tri->index(i * 3 + 1));
+              subshape->faces.push_back(tri->index(i * 3 + 2));
           }
 
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
           //TriangleCount = subshape->faces.size();
 
           shape = subshape;
@@ -946,10 +1004,10 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->snout(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->snout(&worker.arena, geo, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -966,11 +1024,11 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->sphereBasedShape(&__store->arenaTriangulation, geo,
+          if (tri == nullptr)
+              tri = factory->sphereBasedShape(&worker.arena, geo,
                   geo->ellipticalDish.baseRadius, half_pi, 0.f, geo->ellipticalDish.height / geo->ellipticalDish.baseRadius, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -988,7 +1046,7 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
+          if (tri == nullptr)
           {
               float r_circ = geo->sphericalDish.baseRadius;
               auto h = geo->sphericalDish.height;
@@ -996,10 +1054,10 @@ namespace ExportNamedPipe{
               float sinval = std::min(1.f, std::max(-1.f, r_circ / r_sphere));
               float arc = asin(sinval);
               if (r_circ < h) { arc = pi - arc; }
-              geo->triangulation = factory->sphereBasedShape(&__store->arenaTriangulation, geo, r_sphere, arc, h - r_sphere, 1.f, scale);
+              tri = factory->sphereBasedShape(&worker.arena, geo, r_sphere, arc, h - r_sphere, 1.f, scale);
           }
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -1016,10 +1074,10 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->cylinder(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->cylinder(&worker.arena, geo, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -1039,10 +1097,10 @@ namespace ExportNamedPipe{
 
           subshape->scale = scale;
 
-          if (geo->triangulation == nullptr)
-              geo->triangulation = factory->circularTorus(&__store->arenaTriangulation, geo, scale);
+          if (tri == nullptr)
+              tri = factory->circularTorus(&worker.arena, geo, scale);
 
-          TriangleCount = geo->triangulation->triangles_n;
+          TriangleCount = tri->triangles_n;
 
           shape = subshape;
 
@@ -1057,7 +1115,7 @@ namespace ExportNamedPipe{
       }
 
       if (shape == nullptr)
-          return false;
+          return;
 
 
       if (TriangleCount == 0)
@@ -1065,11 +1123,11 @@ namespace ExportNamedPipe{
           bool debug = true;
       }
 
-      if (geo->triangulation == nullptr)
+      if (tri == nullptr)
       {
           bool debug = true;
       }
-      else if (geo->triangulation->triangles_n == 0)
+      else if (tri->triangles_n == 0)
       {
           bool debug = true;
       }
@@ -1081,37 +1139,24 @@ namespace ExportNamedPipe{
 
       Shape2Binary(shape, binstr);
 
+      // The kind prefix is ASCII and instName is already UTF-8.
       std::string shapename = geoname + (instName ? std::string(instName) : "");
 
-
-      const char* utf8Data = nullptr;
-      int utf8Len = 0;
-      bool needdelete = false;
-
-      if (!IsValidUTF8(shapename.data()))
-      {
-          utf8Data = ConvertToUTF8(shapename.data());
-          needdelete = true;
-      }
-      else
-      {
-          utf8Data = shapename.data();
-      }
-      utf8Len = strlen(utf8Data); // ȡֽڳ 
+      const char* utf8Data = shapename.data();
+      int utf8Len = int(shapename.size());
 
 
 
       int buffersize = sizeof(int64_t) * 4 +
           sizeof(double) * 24 + sizeof(int) * 3 + binstr.length() + utf8Len;
 
-      if (PipeDataBufferPos + buffersize + sizeof(CustomMessageHeader) >= PipeDataBufferLen)
-      {
-          //ｫPipeDataBufferͣȻ
-          SendPipeDataBuffer(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos);
-
+      // Packed at the end of the chunk, the ids are filled in when sequenced.
+      job.offset = worker.chunk.size();
+      job.size = sizeof(CustomMessageHeader) + buffersize;
+      worker.chunk.resize(job.offset + job.size);
 
-          PipeDataBufferPos = 0;
-      }
+      char* PipeDataBuffer = worker.chunk.data();
+      size_t PipeDataBufferPos = job.offset;
 
       char* CurrentBufferAddress = PipeDataBuffer + PipeDataBufferPos;
 
@@ -1121,7 +1166,7 @@ namespace ExportNamedPipe{
       pMsg.msgType = 3;
       pMsg.contentLength = buffersize;
 
-      auto shapeId = ++GlobalShapeId;
+      const int64_t shapeId = 0;
       {
           CurrentBufferAddress = PipeDataBuffer + PipeDataBufferPos;
 
@@ -1131,7 +1176,9 @@ namespace ExportNamedPipe{
 
           memcpy(id, &shapeId, sizeof(shapeId));
       }
-      auto shapeInstanceId = ++GlobalInstanceId;
+      const int64_t shapeInstanceId = 0;
+      const int64_t instanceId = 0;
+      const int64_t matId = 0;
       {
           CurrentBufferAddress = PipeDataBuffer + PipeDataBufferPos;
 
@@ -1331,18 +1378,89 @@ namespace ExportNamedPipe{
       //WriteFile(hPipe, &TriangleCount, sizeof(int), &bytesWritten, NULL);
       //WriteFile(hPipe, binstr.data(), binstr.length(), &bytesWritten, NULL);
 
+      assert(PipeDataBufferPos == job.offset + job.size);
+  }
+
+  void CollectShapes(Context& ctx, const Node* node)
+  {
+      if (node->kind == Node::Kind::Group) {
+          int GeoIndex = 0;
+          for (Geometry* geo = node->group.geometries.first; geo; geo = geo->next) {
+              ++GeoIndex;
+              if (geo->kind != Geometry::Kind::Line) {
+                  ctx.shapeJobs.push_back(ShapeJob{ .geo = geo, .instName = __store->utf8Names.get(node->group.name), .GeoIndex = GeoIndex });
+              }
+          }
+      }
+      for (const Node* child = node->children.first; child; child = child->next) {
+          CollectShapes(ctx, child);
+      }
+  }
 
-      if (needdelete)
+  void EncodeShapeBatch(Context& ctx)
+  {
+      const size_t workers_n = ctx.shapeWorkers.size();
+      const size_t end = std::min(ctx.shapeJobs.size(), ctx.shapeEncoded + 256 * workers_n);
+
+      std::atomic<size_t> next = ctx.shapeEncoded;
+      auto work = [&ctx, &next, end](unsigned k) {
+          ShapeWorker& worker = ctx.shapeWorkers[k];
+          worker.chunk.clear();
+          worker.arena.clear();
+          for (size_t i = next++; i < end; i = next++) {
+              ctx.shapeJobs[i].worker = k;
+              EncodeShape(worker, ctx.shapeJobs[i]);
+          }
+      };
+
+      std::vector<std::thread> threads;
+      for (unsigned k = 1; k < std::min(workers_n, end - ctx.shapeEncoded); k++) {
+          threads.emplace_back(work, k);
+      }
+      work(0);
+      for (auto& thread : threads) {
+          thread.join();
+      }
+      ctx.shapeEncoded = end;
+  }
+
+  bool SendShape(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, Geometry* geo, const int64_t& instanceId)
+  {
+      if (geo->kind == Geometry::Kind::Line)
+          return false;
+
+      int64_t  matId = 0;
+      if (SendMaterial(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, geo, matId))
+      {
+          //ReadWaiting(ctx, hPipe);
+      }
+
+      if (ctx.shapeNext == ctx.shapeEncoded) {
+          EncodeShapeBatch(ctx);
+      }
+      const ShapeJob& job = ctx.shapeJobs[ctx.shapeNext++];
+      assert(job.geo == geo);
+      if (job.size == 0)
+          return false;
+
+      if (PipeDataBufferPos + job.size >= PipeDataBufferLen)
       {
-          delete[] utf8Data;
-          utf8Data = nullptr;
+          //ｫPipeDataBufferͣȻ
+          SendPipeDataBuffer(ctx, pipe, PipeDataBuffer, PipeDataBufferPos);
       }
 
+      char* record = PipeDataBuffer + PipeDataBufferPos;
+      memcpy(record, ctx.shapeWorkers[job.worker].chunk.data() + job.offset, job.size);
+      PipeDataBufferPos += job.size;
+
+      const int64_t ids[4] = { ++GlobalShapeId, ++GlobalInstanceId, instanceId, matId };
+      memcpy(record + sizeof(CustomMessageHeader), ids, sizeof(ids));
+
       return true;
   }
 
 
-  void SendPipeDataVersion(Context& ctx, HANDLE hPipe)
+  void SendPipeDataVersion(Context& ctx, PipeTransport* pipe)
   {
 
       CustomMessageHeader pMsg;
@@ -1351,13 +1469,14 @@ namespace ExportNamedPipe{
 
 
       // ݿ
-      DWORD bytesWritten;
-      WriteFile(hPipe, &pMsg, sizeof(CustomMessageHeader), &bytesWritten, NULL);
+      if (!pipe->write(&pMsg, sizeof(CustomMessageHeader))) {
+          ctx.failed = true;
+      }
 
 
   }
 
-  void processNode(Context& ctx, HANDLE hPipe, char* PipeDataBuffer, size_t& PipeDataBufferPos, TriangulationFactory* factory, const Node* node, size_t level, const int64_t& parentId)
+  void processNode(Context& ctx, PipeTransport* pipe, char*& PipeDataBuffer, size_t& PipeDataBufferPos, const Node* node, size_t level, const int64_t& parentId)
   {
 
       int64_t nodeId = 0;
@@ -1370,7 +1489,7 @@ namespace ExportNamedPipe{
               //
 
           }
-          SendModel(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, node, node->file.path, nodeId);
+          SendModel(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, node, node->file.path, nodeId);
           //ReadWaiting(ctx, hPipe);
           //if (includeContent) {
           //  addAttributes(ctx, model, rjNode, node);
@@ -1378,7 +1497,7 @@ namespace ExportNamedPipe{
           break;
 
       case Node::Kind::Model:
-          SendInstance(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, node->bboxWorld, node->model.name, matrix, parentId, nodeId);
+          SendInstance(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, node->bboxWorld, node->model.name, matrix, parentId, nodeId);
           //ReadWaiting(ctx, hPipe);
           //if (includeContent) {
           //  addAttributes(ctx, model, rjNode, node);
@@ -1409,7 +1528,7 @@ namespace ExportNamedPipe{
           //    matrix.push_back(0.0);
           //    matrix.push_back(1.0);
           //}
-          SendInstance(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, node->bboxWorld, node->group.name, matrix, parentId, nodeId);
+          SendInstance(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, node->bboxWorld, node->group.name, matrix, parentId, nodeId);
           //ReadWaiting(ctx, hPipe);
 
           //bool debugname = false;
@@ -1441,7 +1560,7 @@ namespace ExportNamedPipe{
                       //SendInstance(ctx, hPipe, node->group.bboxWorld, geoname.c_str(), matrix, nodeId, shapeNodeId);
                       //ReadWaiting(ctx, hPipe);
 
-                      if (SendShape(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, factory, node->group.name, GeoIndex, geo, nodeId))
+                      if (SendShape(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, geo, nodeId))
                       {
                           //ReadWaiting(ctx, hPipe);
                       }
@@ -1463,7 +1582,7 @@ namespace ExportNamedPipe{
       if (nodeId > 0)
       {
           // And recurse into children
-          processChildren(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, factory, node->children.first, level, nodeId);
+          processChildren(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, node->children.first, level, nodeId);
 
       }
 
@@ -1507,27 +1626,27 @@ namespace ExportNamedPipe{
 
 using namespace ExportNamedPipe;
 
-bool exportNamedPipe(Store* store, Logger logger, const std::string& pipename)
+bool exportNamedPipe(Store* store, Logger logger, const std::string& pipename, unsigned creditWindow, unsigned frameBuffers, unsigned threads)
 {
     Context ctx{
       .logger = logger
     };
+    ctx.creditWindow = creditWindow;
+    ctx.credits = creditWindow;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
 
-    ctx.logger(0, "exportNamedPipe: rotate-z-to-y=%u center=%u attributes=%u",
+    ctx.logger(0, "exportNamedPipe: rotate-z-to-y=%u center=%u attributes=%u credits=%u threads=%u",
         ctx.rotateZToY ? 1 : 0,
         ctx.centerModel ? 1 : 0,
-        ctx.includeAttributes ? 1 : 0);
-
-    std::wstring fullpipename = L"\\\\.\\pipe\\";
-
-    fullpipename = fullpipename + string_to_wstring(pipename);
+        ctx.includeAttributes ? 1 : 0,
+        ctx.creditWindow,
+        threads);
 
-    HANDLE hPipe = CreateFile(
-        fullpipename.c_str(),
-        GENERIC_READ | GENERIC_WRITE,
-        0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    PipeTransport* pipe = createPipeTransport(logger, pipename);
 
-    if (hPipe != INVALID_HANDLE_VALUE) {
+    if (pipe != nullptr) {
 
         //// ȡǰʱ 
         //COMMTIMEOUTS timeouts;
@@ -1572,9 +1691,7 @@ bool exportNamedPipe(Store* store, Logger logger, const std::string& pipename)
         return false;
     }
 
-    SendPipeDataVersion(ctx, hPipe);
-
-    ReadWaiting(ctx, hPipe);
+    SendPipeDataVersion(ctx, pipe);
 
     //HANDLE hPipe = CreateNamedPipe(
     //    fullpipename.c_str(),         // ܵ 
@@ -1592,37 +1709,47 @@ bool exportNamedPipe(Store* store, Logger logger, const std::string& pipename)
 
     float tolerance = 0.1f;
     int maxSamples = 100;
-    auto factory = new TriangulationFactory(store, logger, tolerance, 6, maxSamples);
+    ctx.shapeWorkers = std::vector<ShapeWorker>(threads);
+    for (ShapeWorker& worker : ctx.shapeWorkers) {
+        worker.factory = new TriangulationFactory(store, logger, tolerance, 6, maxSamples);
+    }
+    // Group names are converted here, the shape workers must not touch the cache.
+    for (const Node* root = store->getFirstRoot(); root; root = root->next) {
+        CollectShapes(ctx, root);
+    }
+
+    StartSender(ctx, pipe, frameBuffers);
 
-    //64Kڴ
-    char* PipeDataBuffer = (char*)malloc(PipeDataBufferLen);// new char[PipeDataBufferLen];
+    char* PipeDataBuffer = AcquireBuffer(ctx);
     
     size_t PipeDataBufferPos = 0;
 
-    processChildren(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos, factory, store->getFirstRoot(), 0, 0);
+    processChildren(ctx, pipe, PipeDataBuffer, PipeDataBufferPos, store->getFirstRoot(), 0, 0);
 
     if (PipeDataBufferPos > 0)
     {
-        SendPipeDataBuffer(ctx, hPipe, PipeDataBuffer, PipeDataBufferPos);
+        SendPipeDataBuffer(ctx, pipe, PipeDataBuffer, PipeDataBufferPos);
     }
 
-    //PipeDataBuffer[PipeDataBufferLen - 1] = '\0';
+    StopSender(ctx);
 
-    free(PipeDataBuffer);
-
-    delete factory;
+    for (ShapeWorker& worker : ctx.shapeWorkers) {
+        delete worker.factory;
+    }
 
     CustomMessageHeader pMsg;
     pMsg.msgType = 999;
     pMsg.contentLength = 0;
 
     // ݿ
-    DWORD bytesWritten;
-    WriteFile(hPipe, &pMsg, sizeof(CustomMessageHeader), &bytesWritten, NULL);
+    if (!ctx.failed && !pipe->write(&pMsg, sizeof(CustomMessageHeader))) {
+        ctx.failed = true;
+    }
+
+    ctx.logger(ctx.failed ? 2 : 0, "exportNamedPipe: %s after %zu bytes", ctx.failed ? "connection lost" : "done", pipe->bytesWritten);
 
     // 4. Դ 
-    DisconnectNamedPipe(hPipe);
-    CloseHandle(hPipe);
+    delete pipe;
 
-    return true;
+    return !ctx.failed;
 }
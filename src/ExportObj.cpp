@@ -1,9 +1,14 @@
 #include <cassert>
 #include <cstdio>
+#include <cstdarg>
+#include <cstring>
 #include <string>
 #include <algorithm>
+#include <charconv>
+#include <thread>
 #include "ExportObj.h"
 #include "Store.h"
+#include "Tessellator.h"
 #include "LinAlgOps.h"
 
 namespace {
@@ -28,22 +33,124 @@ namespace {
     return false;
   }
 
-  void wireBoundingBox(FILE* out, unsigned& off_v, const BBox3f& bbox)
+  // Output is formatted into memory with std::to_chars and written in large
+  // chunks. By default floats are formatted exactly like printf's %f, so the
+  // output is identical to formatting with fprintf.
+
+  constexpr size_t maxNumberLength = 64;  // Enough for %f of FLT_MAX and shortest round-trip.
+  constexpr size_t flushJobCount = 16384;
+  constexpr size_t flushTextSize = 8 * 1024 * 1024;
+
+  inline char* putFloat(char* p, float value, bool shortest)
+  {
+    if (shortest) {
+      return std::to_chars(p, p + maxNumberLength, value).ptr;
+    }
+    return std::to_chars(p, p + maxNumberLength, double(value), std::chars_format::fixed, 6).ptr;
+  }
+
+  inline char* putUint(char* p, unsigned value)
+  {
+    return std::to_chars(p, p + maxNumberLength, value).ptr;
+  }
+
+  // Same as printf's %#x
+  inline char* putHex(char* p, unsigned value)
+  {
+    if (value == 0) {
+      *p++ = '0';
+      return p;
+    }
+    *p++ = '0';
+    *p++ = 'x';
+    return std::to_chars(p, p + maxNumberLength, value, 16).ptr;
+  }
+
+  inline void append(std::vector<char>& buf, const char* a, const char* b)
+  {
+    buf.insert(buf.end(), a, b);
+  }
+
+  inline void append(std::vector<char>& buf, const char* str)
+  {
+    append(buf, str, str + strlen(str));
+  }
+
+  // For the odd header line where speed does not matter
+  void appendf(std::vector<char>& buf, const char* fmt, ...)
+  {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(nullptr, 0, fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+
+    size_t o = buf.size();
+    buf.resize(o + n + 1);
+    va_start(args, fmt);
+    vsnprintf(buf.data() + o, n + 1, fmt, args);
+    va_end(args);
+    buf.resize(o + n);
+  }
+
+  // Append a line of a prefix followed by space-separated floats
+  void appendFloats(std::vector<char>& buf, const char* prefix, const float* values, unsigned n, bool shortest)
+  {
+    char line[8 + 3 * (maxNumberLength + 1)];
+    assert(n <= 3);
+    char* p = line;
+    while (*prefix) *p++ = *prefix++;
+    for (unsigned i = 0; i < n; i++) {
+      *p++ = ' ';
+      p = putFloat(p, values[i], shortest);
+    }
+    *p++ = '\n';
+    append(buf, line, p);
+  }
+
+  // Append a line of a prefix followed by space-separated unsigned integers
+  void appendUints(std::vector<char>& buf, const char* prefix, const unsigned* values, unsigned n)
+  {
+    char line[8 + 5 * (maxNumberLength + 1)];
+    assert(n <= 5);
+    char* p = line;
+    while (*prefix) *p++ = *prefix++;
+    for (unsigned i = 0; i < n; i++) {
+      *p++ = ' ';
+      p = putUint(p, values[i]);
+    }
+    *p++ = '\n';
+    append(buf, line, p);
+  }
+
+  void appendUsemtl(std::vector<char>& buf, unsigned colorId)
+  {
+    char line[16 + maxNumberLength];
+    char* p = line;
+    for (const char* q = "usemtl "; *q; q++) *p++ = *q;
+    p = putHex(p, colorId);
+    *p++ = '\n';
+    append(buf, line, p);
+  }
+
+  void wireBoundingBox(std::vector<char>& out, unsigned& off_v, const BBox3f& bbox, bool shortest)
   {
     for (unsigned i = 0; i < 8; i++) {
-      float px = (i & 1) ? bbox.min[0] : bbox.min[3];
-      float py = (i & 2) ? bbox.min[1] : bbox.min[4];
-      float pz = (i & 4) ? bbox.min[2] : bbox.min[5];
-      fprintf(out, "v %f %f %f\n", px, py, pz);
+      float p[3] = {
+        (i & 1) ? bbox.min[0] : bbox.min[3],
+        (i & 2) ? bbox.min[1] : bbox.min[4],
+        (i & 4) ? bbox.min[2] : bbox.min[5]
+      };
+      appendFloats(out, "v", p, 3, shortest);
+    }
+    unsigned a[5] = { off_v + 0, off_v + 1, off_v + 3, off_v + 2, off_v + 0 };
+    appendUints(out, "l", a, 5);
+    unsigned b[5] = { off_v + 4, off_v + 5, off_v + 7, off_v + 6, off_v + 4 };
+    appendUints(out, "l", b, 5);
+    for (unsigned i = 0; i < 4; i++) {
+      unsigned c[2] = { off_v + i, off_v + i + 4 };
+      appendUints(out, "l", c, 2);
     }
-    fprintf(out, "l %d %d %d %d %d\n",
-            off_v + 0, off_v + 1, off_v + 3, off_v + 2, off_v + 0);
-    fprintf(out, "l %d %d %d %d %d\n",
-            off_v + 4, off_v + 5, off_v + 7, off_v + 6, off_v + 4);
-    fprintf(out, "l %d %d\n", off_v + 0, off_v + 4);
-    fprintf(out, "l %d %d\n", off_v + 1, off_v + 5);
-    fprintf(out, "l %d %d\n", off_v + 2, off_v + 6);
-    fprintf(out, "l %d %d\n", off_v + 3, off_v + 7);
     off_v += 8;
   }
 
@@ -53,6 +160,7 @@ namespace {
 ExportObj::~ExportObj()
 {
   if (out) {
+    flush();
     fclose(out);
   }
   if (mtl) {
@@ -71,7 +179,7 @@ bool ExportObj::open(const char* path_obj, const char* path_mtl)
     mtllib = mtllib.substr(l + 1);
   }
 
-  fprintf(out, "mtllib %s\n", mtllib.c_str());
+  appendf(text, "mtllib %s\n", mtllib.c_str());
 
   if (groupBoundingBoxes) {
     fprintf(mtl, "newmtl group_bbox\n");
@@ -107,31 +215,32 @@ void ExportObj::init(class Store& store_)
       fprintf(mtl, "Kd %f %f %f\n", r, g, b);
       fprintf(mtl, "Ks 0.5 0.5 0.5\n");
     }
-    fprintf(out, "usemtl %#x\n", colorId);
+    appendUsemtl(text, colorId);
 
-    fprintf(out, "v %f %f %f\n", line->a[0], line->a[1], line->a[2]);
-    fprintf(out, "v %f %f %f\n", line->b[0], line->b[1], line->b[2]);
-    fprintf(out, "l -1 -2\n");
+    appendFloats(text, "v", line->a, 3, shortestFloats);
+    appendFloats(text, "v", line->b, 3, shortestFloats);
+    append(text, "l -1 -2\n");
     off_v += 2;
   }
 }
 
 void ExportObj::beginFile(Node* group)
 {
-  fprintf(out, "# %s\n", group->file.info);
-  fprintf(out, "# %s\n", group->file.note);
-  fprintf(out, "# %s\n", group->file.date);
-  fprintf(out, "# %s\n", group->file.user);
+  appendf(text, "# %s\n", group->file.info);
+  appendf(text, "# %s\n", group->file.note);
+  appendf(text, "# %s\n", group->file.date);
+  appendf(text, "# %s\n", group->file.user);
 }
 
 void ExportObj::endFile()
 {
-  fprintf(out, "# End of file\n");
+  append(text, "# End of file\n");
+  flush();
 }
 
 void ExportObj::beginModel(Node* group)
 {
-  fprintf(out, "# Model project=%s, name=%s\n", group->model.project, group->model.name);
+  appendf(text, "# Model project=%s, name=%s\n", group->model.project, group->model.name);
 }
 
 void ExportObj::endModel() { }
@@ -142,19 +251,19 @@ void ExportObj::beginGroup(Node* group)
 
   stack[stack_p++] = group->group.name;
 
-  fprintf(out, "o %s", stack[0]);
+  appendf(text, "o %s", stack[0]);
   for (unsigned i = 1; i < stack_p; i++) {
-    fprintf(out, "/%s", stack[i]);
+    appendf(text, "/%s", stack[i]);
   }
-  fprintf(out, "\n");
+  append(text, "\n");
  
 
 //  fprintf(out, "o %s\n", group->group.name);
 
 
   if (groupBoundingBoxes && !isEmpty(group->group.bboxWorld)) {
-    fprintf(out, "usemtl group_bbox\n");
-    wireBoundingBox(out, off_v, group->group.bboxWorld);
+    append(text, "usemtl group_bbox\n");
+    wireBoundingBox(text, off_v, group->group.bboxWorld, shortestFloats);
   }
 
 }
@@ -204,63 +313,162 @@ void ExportObj::geometry(struct Geometry* geometry)
       fprintf(mtl, "d %f\n", std::max(0.0, std::min(1.0, 1.0 - (1.0 / 100.0) * geometry->transparency)));
     }
   }
-  fprintf(out, "usemtl %#x\n", colorId);
+  appendUsemtl(text, colorId);
 
   float scale = 1.f;
   if (geometry->kind == Geometry::Kind::Line) {
     auto a = scale * mul(geometry->M_3x4, makeVec3f(geometry->line.a, 0, 0));
     auto b = scale * mul(geometry->M_3x4, makeVec3f(geometry->line.b, 0, 0));
-    fprintf(out, "v %f %f %f\n", a.x, a.y, a.z);
-    fprintf(out, "v %f %f %f\n", b.x, b.y, b.z);
-    fprintf(out, "l -1 -2\n");
+    appendFloats(text, "v", a.data, 3, shortestFloats);
+    appendFloats(text, "v", b.data, 3, shortestFloats);
+    append(text, "l -1 -2\n");
     off_v += 2;
   }
   else {
-    assert(geometry->triangulation);
-    auto * tri = geometry->triangulation;
+    const Triangulation* tri = geometry->triangulation;
+    if (tessellator) {
+      tri = tessellator->tessellate(&triangulations, geometry);
+    }
+    assert(tri);
+
+    if (tri->hasIndices()) {
+      jobs.push_back({
+        .geometry = geometry,
+        .tri = tri,
+        .textEnd = text.size(),
+        .off_v = off_v,
+        .off_n = off_n,
+        .off_t = off_t
+      });
 
-    if (tri->indices != 0) {
-      //fprintf(out, "g\n");
-      if (geometry->triangulation->error != 0.f) {
-        fprintf(out, "# error=%f\n", geometry->triangulation->error);
-      }
-      for (size_t i = 0; i < 3 * tri->vertices_n; i += 3) {
+      off_v += tri->vertices_n;
+      off_n += tri->vertices_n;
+      off_t += tri->vertices_n;
+    }
+  }
 
-        auto p = scale * mul(geometry->M_3x4, makeVec3f(tri->vertices + i));
-        Vec3f n = normalize(mul(makeMat3f(geometry->M_3x4.data), makeVec3f(tri->normals + i)));
-        if (!std::isfinite(n.x) || !std::isfinite(n.y) || !std::isfinite(n.z)) {
-          n = makeVec3f(1.f, 0.f, 0.f);
-        }
-        fprintf(out, "v %f %f %f\n", p.x, p.y, p.z);
-        fprintf(out, "vn %f %f %f\n", n.x, n.y, n.z);
+  if (flushJobCount <= jobs.size() || flushTextSize <= text.size()) {
+    flush();
+  }
+}
+
+void ExportObj::formatJobs(std::vector<char>& buffer, size_t jobBegin, size_t jobEnd)
+{
+  float scale = 1.f;
+  size_t textBegin = jobBegin ? jobs[jobBegin - 1].textEnd : 0;
+  for (size_t j = jobBegin; j < jobEnd; j++) {
+    const Job& job = jobs[j];
+    append(buffer, text.data() + textBegin, text.data() + job.textEnd);
+    textBegin = job.textEnd;
+
+    const Geometry* geometry = job.geometry;
+    const Triangulation* tri = job.tri;
+
+    //fprintf(out, "g\n");
+    if (tri->error != 0.f) {
+      append(buffer, "# error=");
+      char num[maxNumberLength];
+      append(buffer, num, putFloat(num, tri->error, shortestFloats));
+      append(buffer, "\n");
+    }
+    for (size_t i = 0; i < tri->vertices_n; i++) {
+
+      auto p = scale * mul(geometry->M_3x4, tri->vertex(i));
+      Vec3f n = normalize(mul(makeMat3f(geometry->M_3x4.data), tri->normal(i)));
+      if (!std::isfinite(n.x) || !std::isfinite(n.y) || !std::isfinite(n.z)) {
+        n = makeVec3f(1.f, 0.f, 0.f);
       }
-      if (tri->texCoords) {
-        for (size_t i = 0; i < tri->vertices_n; i++) {
-          const Vec2f vt = makeVec2f(tri->texCoords + 2 * i);
-          fprintf(out, "vt %f %f\n", vt.x, vt.y);
-        }
+      appendFloats(buffer, "v", p.data, 3, shortestFloats);
+      appendFloats(buffer, "vn", n.data, 3, shortestFloats);
+    }
+    if (tri->texCoords) {
+      for (size_t i = 0; i < tri->vertices_n; i++) {
+        appendFloats(buffer, "vt", tri->texCoords + 2 * i, 2, shortestFloats);
+      }
+    }
+    else {
+      for (size_t i = 0; i < tri->vertices_n; i++) {
+        auto p = scale * mul(geometry->M_3x4, tri->vertex(i));
+        float vt[2] = { 0 * p.x, 0 * p.y };
+        appendFloats(buffer, "vt", vt, 2, shortestFloats);
       }
-      else {
-        for (size_t i = 0; i < tri->vertices_n; i++) {
-          auto p = scale * mul(geometry->M_3x4, makeVec3f(tri->vertices + 3*i));
-          fprintf(out, "vt %f %f\n", 0*p.x, 0*p.y);
-        }
 
-        for (size_t i = 0; i < 3 * tri->triangles_n; i += 3) {
-          auto a = tri->indices[i + 0];
-          auto b = tri->indices[i + 1];
-          auto c = tri->indices[i + 2];
-          fprintf(out, "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                  a + off_v, a + off_t, a + off_n,
-                  b + off_v, b + off_t, b + off_n,
-                  c + off_v, c + off_t, c + off_n);
+      for (size_t i = 0; i < 3 * tri->triangles_n; i += 3) {
+        char line[4 + 9 * (maxNumberLength + 1)];
+        char* q = line;
+        *q++ = 'f';
+        for (size_t k = 0; k < 3; k++) {
+          auto a = tri->index(i + k);
+          *q++ = ' ';
+          q = putUint(q, a + job.off_v);
+          *q++ = '/';
+          q = putUint(q, a + job.off_t);
+          *q++ = '/';
+          q = putUint(q, a + job.off_n);
         }
+        *q++ = '\n';
+        append(buffer, line, q);
       }
-
-      off_v += tri->vertices_n;
-      off_n += tri->vertices_n;
-      off_t += tri->vertices_n;
     }
   }
+}
 
+void ExportObj::write(const std::vector<char>& buffer, size_t begin, size_t end)
+{
+  if (begin == end || writeError) return;
+  if (fwrite(buffer.data() + begin, 1, end - begin, out) != end - begin) {
+    fprintf(stderr, "Error writing obj file.\n");
+    writeError = true;
+  }
+}
+
+void ExportObj::flush()
+{
+  if (!jobs.empty()) {
+
+    // Split jobs into ranges of roughly equal vertex counts, format each
+    // range into a separate buffer and write the buffers in order.
+    unsigned n = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    n = static_cast<unsigned>(std::min(size_t(n), (jobs.size() + 255) / 256));
+    buffers.resize(std::max(size_t(n), buffers.size()));
+
+    size_t totalVertices = 0;
+    for (const Job& job : jobs) {
+      totalVertices += job.tri->vertices_n;
+    }
+
+    std::vector<size_t> splits(n + 1, jobs.size());
+    splits[0] = 0;
+    size_t vertices = 0;
+    for (size_t j = 0, k = 1; j < jobs.size() && k < n; j++) {
+      vertices += jobs[j].tri->vertices_n;
+      if ((totalVertices * k) / n <= vertices) {
+        splits[k++] = j + 1;
+      }
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned k = 1; k < n; k++) {
+      workers.emplace_back([this, &splits, k]() {
+        buffers[k].clear();
+        formatJobs(buffers[k], splits[k], splits[k + 1]);
+      });
+    }
+    buffers[0].clear();
+    formatJobs(buffers[0], splits[0], splits[1]);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    for (unsigned k = 0; k < n; k++) {
+      write(buffers[k], 0, buffers[k].size());
+    }
+    write(text, jobs.back().textEnd, text.size());
+  }
+  else {
+    write(text, 0, text.size());
+  }
+  jobs.clear();
+  text.clear();
+  triangulations.reset();
 }
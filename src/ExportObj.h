@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdio>
+#include <vector>
 
 #include "Common.h"
 #include "StoreVisitor.h"
@@ -8,6 +9,9 @@ class ExportObj : public StoreVisitor
 {
 public:
   bool groupBoundingBoxes = false;
+  bool shortestFloats = false;  // Shortest round-trip float formatting instead of printf's %f.
+  unsigned threads = 1;         // Number of threads formatting geometry, 0 uses all cores.
+  class Tessellator* tessellator = nullptr;  // If set, tessellate on demand instead of using pre-tessellated geometry.
 
   ~ExportObj();
 
@@ -30,6 +34,27 @@ public:
   void geometry(struct Geometry* geometry) override;
 
 private:
+  // Triangulated geometry whose formatting is deferred until flush, with
+  // the literal text that precedes it in the output.
+  struct Job
+  {
+    struct Geometry* geometry;
+    const struct Triangulation* tri;
+    size_t textEnd;
+    unsigned off_v;
+    unsigned off_n;
+    unsigned off_t;
+  };
+
+  std::vector<char> text;
+  std::vector<Job> jobs;
+  std::vector<std::vector<char>> buffers; // One per formatting thread.
+  Arena triangulations;                   // On demand triangulations of the jobs, reset by flush.
+
+  void formatJobs(std::vector<char>& buffer, size_t jobBegin, size_t jobEnd);
+  void write(const std::vector<char>& buffer, size_t begin, size_t end);
+  void flush();
+
   FILE* out = nullptr;
   FILE* mtl = nullptr;
   Map definedColors;
@@ -45,5 +70,6 @@ private:
   bool anchors = false;
   bool primitiveBoundingBoxes = false;
   bool compositeBoundingBoxes = false;
+  bool writeError = false;
 
 };
\ No newline at end of file
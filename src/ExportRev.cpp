@@ -4,34 +4,135 @@
 #include <cstdio>
 #include <cstring>
 #include <cassert>
+#include <cmath>
+#include <charconv>
+#include <vector>
+#include <thread>
+#include <atomic>
 
 namespace {
 
+  // Text is formatted into memory and written in large chunks. Numbers use
+  // custom formatters that produce exactly the same bytes as printf's %6u and
+  // %14.5f, so output is unchanged from when this exporter used fprintf.
+
+  constexpr size_t flushSize = 4 * 1024 * 1024;
+
   struct Context {
     Store* store = nullptr;
     Logger logger = nullptr;
     FILE* out = nullptr;
+    std::vector<char> buffer;
+    bool writeError = false;
   };
 
+  void flush(Context* ctx)
+  {
+    if (!ctx->buffer.empty() && !ctx->writeError) {
+      if (fwrite(ctx->buffer.data(), 1, ctx->buffer.size(), ctx->out) != ctx->buffer.size()) {
+        ctx->logger(2, "exportRev: Error writing output");
+        ctx->writeError = true;
+      }
+    }
+    ctx->buffer.clear();
+  }
+
+  void writeString(Context* ctx, const char* str)
+  {
+    if (str == nullptr) str = "(null)";  // Matches printf
+    ctx->buffer.insert(ctx->buffer.end(), str, str + strlen(str));
+    ctx->buffer.push_back('\n');
+  }
+
+  // Right-justify [a,b) in a field of given width, like printf does.
+  char* padLeft(char* dst, const char* a, const char* b, size_t width)
+  {
+    size_t n = b - a;
+    for (; n < width; width--) {
+      *dst++ = ' ';
+    }
+    std::memcpy(dst, a, n);
+    return dst + n;
+  }
+
+  // Same as printf's %6u
+  char* formatUint(char* dst, uint32_t x)
+  {
+    char tmp[16];
+    char* e = std::to_chars(tmp, tmp + sizeof(tmp), x).ptr;
+    return padLeft(dst, tmp, e, 6);
+  }
+
+  // Same as printf's %14.5f. The common case of moderately sized numbers
+  // that are not close to a rounding tie is handled with integer math, the
+  // rest is passed to std::to_chars which rounds exactly like printf.
+  char* formatFloat(char* dst, float x)
+  {
+    char tmp[64];
+    char* e = tmp;
+
+    double v = std::abs(double(x));
+    double s = v * 100000.0;
+    double r = std::nearbyint(s);
+    if (std::isfinite(x) && v < 1e12 && std::abs(std::abs(s - r) - 0.5) > 1e-3) {
+      uint64_t i = static_cast<uint64_t>(r);
+      uint64_t whole = i / 100000;
+      uint32_t frac = static_cast<uint32_t>(i % 100000);
+
+      if (std::signbit(x)) *e++ = '-';
+      e = std::to_chars(e, tmp + sizeof(tmp), whole).ptr;
+      *e++ = '.';
+      for (int k = 4; 0 <= k; k--) {
+        e[k] = char('0' + frac % 10);
+        frac /= 10;
+      }
+      e += 5;
+    }
+    else {
+      e = std::to_chars(tmp, tmp + sizeof(tmp), double(x), std::chars_format::fixed, 5).ptr;
+    }
+    return padLeft(dst, tmp, e, 14);
+  }
+
+  void writeFloats(Context* ctx, const float* values, unsigned n)
+  {
+    char line[5 * 64 + 1];
+    assert(n <= 5);
+    char* p = line;
+    for (unsigned i = 0; i < n; i++) {
+      p = formatFloat(p, values[i]);
+    }
+    *p++ = '\n';
+    ctx->buffer.insert(ctx->buffer.end(), line, p);
+  }
 
   void writeUint(Context* ctx, uint32_t x)
   {
-    fprintf(ctx->out, "%6u\n", x);
+    char line[32];
+    char* p = formatUint(line, x);
+    *p++ = '\n';
+    ctx->buffer.insert(ctx->buffer.end(), line, p);
   }
 
   void writeUint2(Context* ctx, uint32_t x, uint32_t y)
   {
-    fprintf(ctx->out, "%6u%6u\n", x, y);
+    char line[32];
+    char* p = formatUint(line, x);
+    p = formatUint(p, y);
+    *p++ = '\n';
+    ctx->buffer.insert(ctx->buffer.end(), line, p);
   }
 
   void writeVec2f(Context* ctx, float x, float y)
   {
-    fprintf(ctx->out, "%14.5f%14.5f\n", x, y);
+    float v[2] = { x, y };
+    writeFloats(ctx, v, 2);
   }
 
   void writeVec3f(Context* ctx, float x, float y, float z)
   {
-    fprintf(ctx->out, "%14.5f%14.5f%14.5f\n", x, y, z);
+    float v[3] = { x, y, z };
+    writeFloats(ctx, v, 3);
   }
 
   void writeVec3f(Context* ctx, const float* ptr)
@@ -41,7 +142,8 @@ namespace {
 
   void writeVec4f(Context* ctx, float x, float y, float z, float w)
   {
-    fprintf(ctx->out, "%14.5f%14.5f%14.5f%14.5f\n", x, y, z, w);
+    float v[4] = { x, y, z, w };
+    writeFloats(ctx, v, 4);
   }
 
   void writeVec4f(Context* ctx, const float* ptr)
@@ -51,13 +153,13 @@ namespace {
 
   void writeVec5f(Context* ctx, float x, float y, float z, float w, float q)
   {
-    fprintf(ctx->out, "%14.5f%14.5f%14.5f%14.5f%14.5f\n", x, y, z, w, q);
+    float v[5] = { x, y, z, w, q };
+    writeFloats(ctx, v, 5);
   }
 
   void writeChunkHeader(Context* ctx, const char* id, uint32_t unknown0 = 1, uint32_t unknown1 = 1)
   {
-    fputs(id, ctx->out);
-    fputc('\n', ctx->out);
+    writeString(ctx, id);
     writeUint2(ctx, unknown0, unknown1);
   }
 
@@ -121,7 +223,7 @@ namespace {
     default:
       assert(false);
     }
-    fprintf(ctx->out, "%6u\n", kind);
+    writeUint(ctx, kind);
     for (size_t k = 0; k < 3; k++) {
       writeVec4f(ctx,
                  geometry->M_3x4.data[k + 0],
@@ -186,7 +288,6 @@ namespace {
                  geometry->cylinder.height);
       break;
     case Geometry::Kind::Sphere:
-      fflush(ctx->out);
       assert(false && "Unhandled primitive type 9");
       break;
     case Geometry::Kind::Line:
@@ -221,13 +322,13 @@ namespace {
   {
     assert(group->kind == Node::Kind::Group);
     writeChunkHeader(ctx, "CNTB");
-    fprintf(ctx->out, "%s\n", group->group.name);
+    writeString(ctx, group->group.name);
    
     writeVec3f(ctx,
                1000.f * group->group.translation[0],
                1000.f * group->group.translation[1],
                1000.f * group->group.translation[2]);
-    fprintf(ctx->out, "%6u\n", group->group.material);
+    writeUint(ctx, group->group.material);
 
     for (Node* child = group->children.first; child; child = child->next) {
       writeGroup(ctx, child);
@@ -238,40 +339,91 @@ namespace {
     }
 
     writeChunkHeader(ctx, "CNTE");
+
+    // Contexts of parallel workers have no file, their buffers are written
+    // in order by writeGroupsParallel.
+    if (ctx->out && flushSize <= ctx->buffer.size()) {
+      flush(ctx);
+    }
   }
 
-  void writeModel(Context* ctx, Node* model)
+  // Top-level groups of a model are independent subtrees. They are formatted
+  // in batches, each group into its own buffer, and written in order.
+  void writeGroupsParallel(Context* ctx, Node* firstGroup, unsigned threads)
+  {
+    std::vector<Node*> groups;
+    std::vector<Context> subs;
+    for (Node* group = firstGroup; group; ) {
+
+      groups.clear();
+      for (; group && groups.size() < 4 * threads; group = group->next) {
+        groups.push_back(group);
+      }
+      subs.resize(std::max(subs.size(), groups.size()));
+
+      std::atomic<size_t> next = 0;
+      auto work = [ctx, &groups, &subs, &next]() {
+        for (size_t i = next++; i < groups.size(); i = next++) {
+          Context& sub = subs[i];
+          sub.store = ctx->store;
+          sub.logger = ctx->logger;
+          sub.buffer.clear();
+          writeGroup(&sub, groups[i]);
+        }
+      };
+
+      std::vector<std::thread> workers;
+      for (unsigned k = 1; k < std::min(size_t(threads), groups.size()); k++) {
+        workers.emplace_back(work);
+      }
+      work();
+      for (auto& worker : workers) {
+        worker.join();
+      }
+
+      flush(ctx);
+      for (size_t i = 0; i < groups.size(); i++) {
+        ctx->buffer.swap(subs[i].buffer);
+        flush(ctx);
+      }
+    }
+  }
+
+  void writeModel(Context* ctx, Node* model, unsigned threads)
   {
     assert(model->kind == Node::Kind::Model);
     
     writeChunkHeader(ctx, "MODL");
-    fprintf(ctx->out, "%s\n%s\n",
-            model->model.project,
-            model->model.name);
-    for (Node* group = model->children.first; group; group = group->next) {
-      writeGroup(ctx, group);
+    writeString(ctx, model->model.project);
+    writeString(ctx, model->model.name);
+    if (1 < threads) {
+      writeGroupsParallel(ctx, model->children.first, threads);
+    }
+    else {
+      for (Node* group = model->children.first; group; group = group->next) {
+        writeGroup(ctx, group);
+      }
     }
   }
 
-  void writeFile(Context* ctx, Node* file)
+  void writeFile(Context* ctx, Node* file, unsigned threads)
   {
     assert(file->kind == Node::Kind::File);
 
     writeChunkHeader(ctx, "HEAD");
-    fprintf(ctx->out, "%s\n%s\n%s\n%s\n",
-            file->file.info,
-            file->file.note,
-            file->file.date,
-            file->file.user);
+    writeString(ctx, file->file.info);
+    writeString(ctx, file->file.note);
+    writeString(ctx, file->file.date);
+    writeString(ctx, file->file.user);
     for (Node* model = file->children.first; model; model = model->next) {
-      writeModel(ctx, model);
+      writeModel(ctx, model, threads);
     }
     writeChunkHeader(ctx, "END:");
   }
 
 }
 
-bool exportRev(Store* store, Logger logger, const char* path)
+bool exportRev(Store* store, Logger logger, const char* path, unsigned threads)
 {
   Context ctx;
   ctx.store = store;
@@ -296,11 +448,15 @@ bool exportRev(Store* store, Logger logger, const char* path)
     return false;
   }
 #endif
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
   logger(0, "exportRev: Writing %s...", path);
   for (Node* file = store->getFirstRoot(); file; file = file->next) {
-    writeFile(&ctx, file);
+    writeFile(&ctx, file, threads);
   }
+  flush(&ctx);
   logger(0, "exportRev: Writing %s... done", path);
   fclose(ctx.out);
-  return true;
+  return !ctx.writeError;
 }
\ No newline at end of file
@@ -0,0 +1,580 @@
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/filewritestream.h>
+
+#include "Store.h"
+#include "Tessellator.h"
+#include "LinAlgOps.h"
+
+// Spatial tiling of the model into a 3D Tiles tileset.
+//
+// A bounding volume hierarchy is built over the world bounds of geometries,
+// splitting at the median along the longest axis until a tile holds at most
+// leafSize geometries. Leaf tiles contain all their geometries tessellated at
+// the requested tolerance. An interior tile replaces its children with a
+// coarse version of the same geometries, where both the tolerance and the
+// culling follow the Tessellator's rules: the tolerance doubles for each
+// level above the leaves, and geometries or groups with a diagonal smaller
+// than cullScale times that tolerance are omitted. The size of the largest
+// omitted feature is the geometric error of the tile.
+
+namespace rj = rapidjson;
+
+namespace {
+
+  struct TileItem
+  {
+    const Geometry* geo;
+    float groupDiagonal;  // Error induced if the group of the geometry is omitted.
+    Vec3f center;         // Center of world bounds, used when splitting.
+  };
+
+  struct Tile
+  {
+    BBox3f bbox;
+    size_t begin = 0;     // Range of items in and below this tile.
+    size_t end = 0;
+    uint32_t children[2] = { ~0u, ~0u };
+    unsigned height = 0;  // Levels below this tile, zero for leaf tiles.
+    bool hasContent = false;
+  };
+
+  struct ContentItem
+  {
+    uint64_t materialKey;
+    const Geometry* geo;
+    const Triangulation* tri;
+  };
+
+  struct Context
+  {
+    Logger logger = nullptr;
+    Store* store = nullptr;
+    const char* path = nullptr;
+
+    float tolerance = 0.1f;
+    float cullScale = 10.f;
+    unsigned leafSize = 500;
+    unsigned maxSamples = 100;
+
+    std::vector<TileItem> items;
+    std::vector<Tile> tiles;
+    std::vector<TriangulationFactory*> factories; // Indexed by tile height.
+
+    Arena arena;  // Triangulations of current tile, cleared between tiles.
+
+    std::vector<ContentItem> content;
+    std::vector<Vec3f> V;
+    std::vector<Vec3f> N;
+    std::vector<uint32_t> I;
+
+    size_t contentTiles = 0;
+    uint64_t triangles = 0;
+    uint64_t bytes = 0;
+  };
+
+  void collectItems(Context& ctx, const Node* node)
+  {
+    for (; node; node = node->next) {
+      if (node->kind == Node::Kind::Group) {
+        // Groups without bounds are never culled as a whole.
+        float groupDiagonal = isEmpty(node->group.bboxWorld) ? std::numeric_limits<float>::max() : diagonal(node->group.bboxWorld);
+        for (const Geometry* geo = node->group.geometries.first; geo; geo = geo->next) {
+          if (geo->kind == Geometry::Kind::Line || isEmpty(geo->bboxWorld)) continue;
+          ctx.items.push_back({
+            .geo = geo,
+            .groupDiagonal = groupDiagonal,
+            .center = 0.5f * (geo->bboxWorld.min + geo->bboxWorld.max)
+          });
+        }
+      }
+      collectItems(ctx, node->children.first);
+    }
+  }
+
+  uint32_t buildTile(Context& ctx, size_t begin, size_t end, unsigned depth)
+  {
+    uint32_t index = static_cast<uint32_t>(ctx.tiles.size());
+    ctx.tiles.emplace_back();
+
+    BBox3f bbox = createEmptyBBox3f();
+    BBox3f centers = createEmptyBBox3f();
+    for (size_t i = begin; i < end; i++) {
+      engulf(bbox, ctx.items[i].geo->bboxWorld);
+      engulf(centers, ctx.items[i].center);
+    }
+
+    Tile tile;
+    tile.bbox = bbox;
+    tile.begin = begin;
+    tile.end = end;
+
+    // Guard against runaway recursion when many geometries share the same center.
+    if (ctx.leafSize < end - begin && depth < 32 && 0.f < maxSideLength(centers)) {
+      Vec3f extent = centers.max - centers.min;
+      unsigned axis = 0;
+      if (extent[axis] < extent[1]) axis = 1;
+      if (extent[axis] < extent[2]) axis = 2;
+
+      size_t mid = begin + (end - begin) / 2;
+      std::nth_element(ctx.items.begin() + begin, ctx.items.begin() + mid, ctx.items.begin() + end,
+                       [axis](const TileItem& a, const TileItem& b) { return a.center[axis] < b.center[axis]; });
+
+      tile.children[0] = buildTile(ctx, begin, mid, depth + 1);
+      tile.children[1] = buildTile(ctx, mid, end, depth + 1);
+      tile.height = 1 + std::max(ctx.tiles[tile.children[0]].height, ctx.tiles[tile.children[1]].height);
+    }
+
+    ctx.tiles[index] = tile;
+    return index;
+  }
+
+  float tileTolerance(const Context& ctx, const Tile& tile)
+  {
+    return std::ldexp(ctx.tolerance, static_cast<int>(tile.height));
+  }
+
+  // Error induced by rendering this tile instead of its children.
+  float tileGeometricError(const Context& ctx, const Tile& tile)
+  {
+    return tile.height ? ctx.cullScale * tileTolerance(ctx, tile) : 0.f;
+  }
+
+  TriangulationFactory* getFactory(Context& ctx, const Tile& tile)
+  {
+    while (ctx.factories.size() <= tile.height) {
+      float tolerance = std::ldexp(ctx.tolerance, static_cast<int>(ctx.factories.size()));
+      ctx.factories.push_back(new TriangulationFactory(ctx.store, ctx.logger, tolerance, 3, ctx.maxSamples));
+    }
+    return ctx.factories[tile.height];
+  }
+
+  uint32_t addMaterial(rj::Value& rjMaterials, rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc, const Geometry* geo)
+  {
+    uint32_t color = geo->color;
+    uint8_t transparency = static_cast<uint8_t>(geo->transparency);
+
+    rj::Value rjColor(rj::kArrayType);
+    rjColor.PushBack((1.f / 255.f) * ((color >> 16) & 0xff), alloc);
+    rjColor.PushBack((1.f / 255.f) * ((color >>  8) & 0xff), alloc);
+    rjColor.PushBack((1.f / 255.f) * ((color      ) & 0xff), alloc);
+    rjColor.PushBack(std::min(1.f, std::max(0.f, 1.f - (1.f / 100.f) * transparency)), alloc);
+
+    rj::Value rjPbrMetallicRoughness(rj::kObjectType);
+    rjPbrMetallicRoughness.AddMember("baseColorFactor", rjColor, alloc);
+    rjPbrMetallicRoughness.AddMember("metallicFactor", 0.5f, alloc);
+    rjPbrMetallicRoughness.AddMember("roughnessFactor", 0.5f, alloc);
+
+    rj::Value material(rj::kObjectType);
+    if (geo->colorName) {
+      material.AddMember("name", rj::Value(geo->colorName, alloc), alloc);
+    }
+    material.AddMember("pbrMetallicRoughness", rjPbrMetallicRoughness, alloc);
+    if (transparency != 0) {
+      material.AddMember("alphaMode", "BLEND", alloc);
+    }
+
+    uint32_t materialIndex = rjMaterials.Size();
+    rjMaterials.PushBack(material, alloc);
+    return materialIndex;
+  }
+
+  void addBufferView(rj::Value& rjBufferViews, rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc, size_t byteOffset, size_t byteLength, uint32_t target)
+  {
+    rj::Value rjBufferView(rj::kObjectType);
+    rjBufferView.AddMember("buffer", 0, alloc);
+    rjBufferView.AddMember("byteOffset", static_cast<uint64_t>(byteOffset), alloc);
+    rjBufferView.AddMember("byteLength", static_cast<uint64_t>(byteLength), alloc);
+    rjBufferView.AddMember("target", target, alloc);
+    rjBufferViews.PushBack(rjBufferView, alloc);
+  }
+
+  uint32_t addAccessor(rj::Value& rjAccessors, rj::MemoryPoolAllocator<rj::CrtAllocator>& alloc, uint32_t bufferView, size_t byteOffset, size_t count, uint32_t componentType, const char* type)
+  {
+    rj::Value rjAccessor(rj::kObjectType);
+    rjAccessor.AddMember("bufferView", bufferView, alloc);
+    rjAccessor.AddMember("byteOffset", static_cast<uint64_t>(byteOffset), alloc);
+    rjAccessor.AddMember("componentType", componentType, alloc);
+    rjAccessor.AddMember("count", static_cast<uint64_t>(count), alloc);
+    rjAccessor.AddMember("type", rj::StringRef(type), alloc);
+
+    uint32_t accessorIndex = rjAccessors.Size();
+    rjAccessors.PushBack(rjAccessor, alloc);
+    return accessorIndex;
+  }
+
+  bool writeGLB(Context& ctx, const char* path, const rj::Document& rjDoc, const void* const* chunks, const size_t* chunkSizes, size_t chunkCount)
+  {
+    rj::StringBuffer buffer;
+    rj::Writer<rj::StringBuffer> writer(buffer);
+    rjDoc.Accept(writer);
+    size_t jsonByteSize = buffer.GetSize();
+    size_t jsonPaddingSize = (4 - (jsonByteSize % 4)) % 4;
+
+    size_t binByteSize = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+      assert((chunkSizes[i] % 4) == 0);
+      binByteSize += chunkSizes[i];
+    }
+
+    size_t totalSize = 12 + 8 + jsonByteSize + jsonPaddingSize + 8 + binByteSize;
+    if (std::numeric_limits<uint32_t>::max() < totalSize) {
+      ctx.logger(2, "exportTiles: %s would be %zu bytes, a number too large to store in 32 bits in the GLB header.", path, totalSize);
+      return false;
+    }
+
+#ifdef _WIN32
+    FILE* out = nullptr;
+    if (fopen_s(&out, path, "wb") != 0) {
+      out = nullptr;
+    }
+#else
+    FILE* out = fopen(path, "wb");
+#endif
+    if (out == nullptr) {
+      ctx.logger(2, "exportTiles: Failed to open %s for writing.", path);
+      return false;
+    }
+
+    uint32_t header[3] = { 0x46546C67 /* magic */, 2 /* version */, static_cast<uint32_t>(totalSize) };
+    uint32_t jsonChunkHeader[2] = { static_cast<uint32_t>(jsonByteSize + jsonPaddingSize), 0x4E4F534A /* JSON */ };
+    uint32_t binChunkHeader[2] = { static_cast<uint32_t>(binByteSize), 0x004E4942 /* BIN */ };
+
+    bool success =
+      fwrite(header, sizeof(header), 1, out) == 1 &&
+      fwrite(jsonChunkHeader, sizeof(jsonChunkHeader), 1, out) == 1 &&
+      fwrite(buffer.GetString(), jsonByteSize, 1, out) == 1 &&
+      (jsonPaddingSize == 0 || fwrite("   ", jsonPaddingSize, 1, out) == 1) &&
+      fwrite(binChunkHeader, sizeof(binChunkHeader), 1, out) == 1;
+    for (size_t i = 0; success && i < chunkCount; i++) {
+      success = chunkSizes[i] == 0 || fwrite(chunks[i], chunkSizes[i], 1, out) == 1;
+    }
+    fclose(out);
+
+    if (!success) {
+      ctx.logger(2, "exportTiles: Error writing %s", path);
+      return false;
+    }
+    ctx.bytes += totalSize;
+    return true;
+  }
+
+  // Tessellate the visible geometries of a tile and write them as a GLB with
+  // one primitive per material. Returns false on error, and sets hasContent
+  // if anything was written.
+  bool writeTileContent(Context& ctx, uint32_t tileIndex, const std::string& path)
+  {
+    Tile& tile = ctx.tiles[tileIndex];
+
+    float cullThreshold = tile.height ? ctx.cullScale * tileTolerance(ctx, tile) : -1.f;
+    TriangulationFactory* factory = getFactory(ctx, tile);
+
+    ctx.arena.clear();
+    ctx.content.clear();
+    for (size_t i = tile.begin; i < tile.end; i++) {
+      const TileItem& item = ctx.items[i];
+      if (item.groupDiagonal < cullThreshold || diagonal(item.geo->bboxWorld) < cullThreshold) continue;
+
+      const Geometry* geo = item.geo;
+      const Triangulation* tri = factory->geometry(&ctx.arena, geo, getScale(geo->M_3x4));
+      if (tri == nullptr || tri->triangles_n == 0) continue;
+
+      uint64_t materialKey = (uint64_t(geo->color) << 8) | uint64_t(geo->transparency & 0xff);
+      ctx.content.push_back({ .materialKey = materialKey, .geo = geo, .tri = tri });
+    }
+    if (ctx.content.empty()) return true;
+
+    std::sort(ctx.content.begin(), ctx.content.end(), [](const ContentItem& a, const ContentItem& b) { return a.materialKey < b.materialKey; });
+
+    // Positions are relative to the tile center to retain float precision.
+    // GLTF is +Y up while the model and tileset are +Z up, so rotate (x,y,z) -> (x,z,-y).
+    const Vec3f center = 0.5f * (tile.bbox.min + tile.bbox.max);
+
+    rj::Document rjDoc(rj::kObjectType);
+    auto& alloc = rjDoc.GetAllocator();
+    rj::Value rjPrimitives(rj::kArrayType);
+    rj::Value rjMaterials(rj::kArrayType);
+    rj::Value rjAccessors(rj::kArrayType);
+
+    std::vector<Vec3f>& V = ctx.V;
+    std::vector<Vec3f>& N = ctx.N;
+    std::vector<uint32_t>& I = ctx.I;
+    V.clear();
+    N.clear();
+    I.clear();
+
+    for (size_t a = 0, n = ctx.content.size(); a < n; ) {
+      size_t b = a + 1;
+      while (b < n && ctx.content[a].materialKey == ctx.content[b].materialKey) { b++; }
+
+      size_t vertexOffset = V.size();
+      size_t indexOffset = I.size();
+      BBox3f bounds = createEmptyBBox3f();
+      for (size_t k = a; k < b; k++) {
+        const Geometry* geo = ctx.content[k].geo;
+        const Triangulation* tri = ctx.content[k].tri;
+
+        Mat3x4d M = makeMat3x4d(geo->M_3x4.data);
+        M.m03 -= center.x;
+        M.m13 -= center.y;
+        M.m23 -= center.z;
+        const Mat3f T = makeMat3f(geo->M_3x4.data);
+
+        uint32_t base = static_cast<uint32_t>(V.size() - vertexOffset);
+        for (size_t i = 0; i < tri->vertices_n; i++) {
+          Vec3f p = makeVec3f(mul(M, makeVec3d(tri->vertex(i).data)));
+          Vec3f m = normalize(mul(T, tri->normal(i)));
+          if (!std::isfinite(m.x) || !std::isfinite(m.y) || !std::isfinite(m.z)) {
+            m = makeVec3f(1.f, 0.f, 0.f);
+          }
+          p = makeVec3f(p.x, p.z, -p.y);
+          engulf(bounds, p);
+          V.push_back(p);
+          N.push_back(makeVec3f(m.x, m.z, -m.y));
+        }
+        for (size_t i = 0; i < 3 * size_t(tri->triangles_n); i++) {
+          I.push_back(base + tri->index(i));
+        }
+        ctx.triangles += tri->triangles_n;
+      }
+
+      size_t vertexCount = V.size() - vertexOffset;
+      uint32_t positionAccessorIx = addAccessor(rjAccessors, alloc, 0, sizeof(Vec3f) * vertexOffset, vertexCount, 0x1406 /* GL_FLOAT */, "VEC3");
+      uint32_t normalAccessorIx = addAccessor(rjAccessors, alloc, 1, sizeof(Vec3f) * vertexOffset, vertexCount, 0x1406 /* GL_FLOAT */, "VEC3");
+      uint32_t indicesAccessorIx = addAccessor(rjAccessors, alloc, 2, sizeof(uint32_t) * indexOffset, I.size() - indexOffset, 0x1405 /* GL_UNSIGNED_INT */, "SCALAR");
+
+      rj::Value rjMin(rj::kArrayType);
+      rj::Value rjMax(rj::kArrayType);
+      for (size_t r = 0; r < 3; r++) {
+        rjMin.PushBack(bounds.min[r], alloc);
+        rjMax.PushBack(bounds.max[r], alloc);
+      }
+      rjAccessors[positionAccessorIx].AddMember("min", rjMin, alloc);
+      rjAccessors[positionAccessorIx].AddMember("max", rjMax, alloc);
+
+      rj::Value rjAttributes(rj::kObjectType);
+      rjAttributes.AddMember("POSITION", positionAccessorIx, alloc);
+      rjAttributes.AddMember("NORMAL", normalAccessorIx, alloc);
+
+      rj::Value rjPrimitive(rj::kObjectType);
+      rjPrimitive.AddMember("mode", 0x0004 /* GL_TRIANGLES */, alloc);
+      rjPrimitive.AddMember("attributes", rjAttributes, alloc);
+      rjPrimitive.AddMember("indices", indicesAccessorIx, alloc);
+      rjPrimitive.AddMember("material", addMaterial(rjMaterials, alloc, ctx.content[a].geo), alloc);
+      rjPrimitives.PushBack(rjPrimitive, alloc);
+
+      a = b;
+    }
+
+    size_t positionBytes = sizeof(Vec3f) * V.size();
+    size_t normalBytes = sizeof(Vec3f) * N.size();
+    size_t indexBytes = sizeof(uint32_t) * I.size();
+
+    rj::Value rjBufferViews(rj::kArrayType);
+    addBufferView(rjBufferViews, alloc, 0, positionBytes, 0x8892 /* GL_ARRAY_BUFFER */);
+    addBufferView(rjBufferViews, alloc, positionBytes, normalBytes, 0x8892 /* GL_ARRAY_BUFFER */);
+    addBufferView(rjBufferViews, alloc, positionBytes + normalBytes, indexBytes, 0x8893 /* GL_ELEMENT_ARRAY_BUFFER */);
+
+    rj::Value rjBuffer(rj::kObjectType);
+    rjBuffer.AddMember("byteLength", static_cast<uint64_t>(positionBytes + normalBytes + indexBytes), alloc);
+    rj::Value rjBuffers(rj::kArrayType);
+    rjBuffers.PushBack(rjBuffer, alloc);
+
+    rj::Value rjMesh(rj::kObjectType);
+    rjMesh.AddMember("primitives", rjPrimitives, alloc);
+    rj::Value rjMeshes(rj::kArrayType);
+    rjMeshes.PushBack(rjMesh, alloc);
+
+    rj::Value rjTranslation(rj::kArrayType);
+    rjTranslation.PushBack(center.x, alloc);
+    rjTranslation.PushBack(center.z, alloc);
+    rjTranslation.PushBack(-center.y, alloc);
+
+    rj::Value rjNode(rj::kObjectType);
+    rjNode.AddMember("mesh", 0, alloc);
+    rjNode.AddMember("translation", rjTranslation, alloc);
+    rj::Value rjNodes(rj::kArrayType);
+    rjNodes.PushBack(rjNode, alloc);
+
+    rj::Value rjSceneNodes(rj::kArrayType);
+    rjSceneNodes.PushBack(0, alloc);
+    rj::Value rjScene(rj::kObjectType);
+    rjScene.AddMember("nodes", rjSceneNodes, alloc);
+    rj::Value rjScenes(rj::kArrayType);
+    rjScenes.PushBack(rjScene, alloc);
+
+    rj::Value rjAsset(rj::kObjectType);
+    rjAsset.AddMember("version", "2.0", alloc);
+    rjAsset.AddMember("generator", "rvmparser", alloc);
+
+    rjDoc.AddMember("asset", rjAsset, alloc);
+    rjDoc.AddMember("scene", 0, alloc);
+    rjDoc.AddMember("scenes", rjScenes, alloc);
+    rjDoc.AddMember("nodes", rjNodes, alloc);
+    rjDoc.AddMember("meshes", rjMeshes, alloc);
+    rjDoc.AddMember("materials", rjMaterials, alloc);
+    rjDoc.AddMember("accessors", rjAccessors, alloc);
+    rjDoc.AddMember("bufferViews", rjBufferViews, alloc);
+    rjDoc.AddMember("buffers", rjBuffers, alloc);
+
+    const void* chunks[3] = { V.data(), N.data(), I.data() };
+    size_t chunkSizes[3] = { positionBytes, normalBytes, indexBytes };
+    if (!writeGLB(ctx, path.c_str(), rjDoc, chunks, chunkSizes, 3)) {
+      return false;
+    }
+
+    tile.hasContent = true;
+    ctx.contentTiles++;
+    return true;
+  }
+
+  bool writeTiles(Context& ctx, const std::filesystem::path& dir)
+  {
+    for (uint32_t i = 0; i < ctx.tiles.size(); i++) {
+      std::string path = (dir / "tiles" / (std::to_string(i) + ".glb")).string();
+      if (!writeTileContent(ctx, i, path)) {
+        return false;
+      }
+    }
+    ctx.arena.clear();
+    return true;
+  }
+
+  rj::Value buildTileJson(Context& ctx, rj::MemoryPoolAllocator<>& alloc, uint32_t tileIndex)
+  {
+    const Tile& tile = ctx.tiles[tileIndex];
+
+    // Oriented bounding box given as center followed by the three half-axes.
+    const Vec3f center = 0.5f * (tile.bbox.min + tile.bbox.max);
+    const Vec3f halfSize = 0.5f * (tile.bbox.max - tile.bbox.min);
+    rj::Value rjBox(rj::kArrayType);
+    for (size_t r = 0; r < 3; r++) {
+      rjBox.PushBack(center[r], alloc);
+    }
+    for (size_t c = 0; c < 3; c++) {
+      for (size_t r = 0; r < 3; r++) {
+        rjBox.PushBack(r == c ? halfSize[r] : 0.f, alloc);
+      }
+    }
+    rj::Value rjBoundingVolume(rj::kObjectType);
+    rjBoundingVolume.AddMember("box", rjBox, alloc);
+
+    rj::Value rjTile(rj::kObjectType);
+    rjTile.AddMember("boundingVolume", rjBoundingVolume, alloc);
+    rjTile.AddMember("geometricError", tileGeometricError(ctx, tile), alloc);
+    if (tileIndex == 0) {
+      rjTile.AddMember("refine", "REPLACE", alloc);
+    }
+    if (tile.hasContent) {
+      rj::Value rjContent(rj::kObjectType);
+      rjContent.AddMember("uri", rj::Value(("tiles/" + std::to_string(tileIndex) + ".glb").c_str(), alloc), alloc);
+      rjTile.AddMember("content", rjContent, alloc);
+    }
+    if (tile.height) {
+      rj::Value rjChildren(rj::kArrayType);
+      for (uint32_t child : tile.children) {
+        rjChildren.PushBack(buildTileJson(ctx, alloc, child), alloc);
+      }
+      rjTile.AddMember("children", rjChildren, alloc);
+    }
+    return rjTile;
+  }
+
+  bool writeTileset(Context& ctx, const std::filesystem::path& dir)
+  {
+    rj::Document rjDoc(rj::kObjectType);
+    auto& alloc = rjDoc.GetAllocator();
+
+    rj::Value rjAsset(rj::kObjectType);
+    rjAsset.AddMember("version", "1.0", alloc);
+    rjAsset.AddMember("generator", "rvmparser", alloc);
+    rjDoc.AddMember("asset", rjAsset, alloc);
+
+    // Error of omitting the whole model.
+    rjDoc.AddMember("geometricError", std::max(tileGeometricError(ctx, ctx.tiles[0]), diagonal(ctx.tiles[0].bbox)), alloc);
+    rjDoc.AddMember("root", buildTileJson(ctx, alloc, 0), alloc);
+
+    std::string path = (dir / "tileset.json").string();
+#ifdef _WIN32
+    FILE* out = nullptr;
+    if (fopen_s(&out, path.c_str(), "wb") != 0) {
+      out = nullptr;
+    }
+#else
+    FILE* out = fopen(path.c_str(), "wb");
+#endif
+    if (out == nullptr) {
+      ctx.logger(2, "exportTiles: Failed to open %s for writing.", path.c_str());
+      return false;
+    }
+
+    char writeBuffer[0x10000];
+    rj::FileWriteStream os(out, writeBuffer, sizeof(writeBuffer));
+    rj::Writer<rj::FileWriteStream> writer(os);
+    rjDoc.Accept(writer);
+    os.Flush();
+
+    bool success = ferror(out) == 0;
+    fclose(out);
+    if (!success) {
+      ctx.logger(2, "exportTiles: Error writing %s", path.c_str());
+    }
+    return success;
+  }
+
+}
+
+bool exportTiles(Store* store, Logger logger, const char* path, float tolerance, float cullScale, unsigned leafSize)
+{
+  auto time0 = std::chrono::high_resolution_clock::now();
+
+  Context ctx{
+    .logger = logger,
+    .store = store,
+    .path = path,
+    .tolerance = std::max(1e-6f, tolerance),
+    .cullScale = std::max(1.f, cullScale),
+    .leafSize = std::max(1u, leafSize)
+  };
+
+  collectItems(ctx, store->getFirstRoot());
+  if (ctx.items.empty()) {
+    ctx.logger(2, "exportTiles: No geometries to export");
+    return false;
+  }
+  buildTile(ctx, 0, ctx.items.size(), 0);
+
+  std::filesystem::path dir(path);
+  std::error_code ec;
+  std::filesystem::create_directories(dir / "tiles", ec);
+  if (ec) {
+    ctx.logger(2, "exportTiles: Failed to create directory %s: %s", path, ec.message().c_str());
+    return false;
+  }
+
+  bool success = writeTiles(ctx, dir) && writeTileset(ctx, dir);
+
+  for (TriangulationFactory* factory : ctx.factories) {
+    delete factory;
+  }
+
+  if (success) {
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+    ctx.logger(0, "exportTiles: Wrote %zu tiles (%zu with content, %u levels) with %llu triangles and %llu KB into %s (%lldms)",
+               ctx.tiles.size(), ctx.contentTiles, ctx.tiles[0].height + 1,
+               static_cast<unsigned long long>(ctx.triangles), static_cast<unsigned long long>((ctx.bytes + 1023) / 1024),
+               path, ms);
+  }
+  return success;
+}
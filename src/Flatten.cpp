@@ -91,34 +91,40 @@ bool Flatten::anyChildrenSelectedAndTagRecurse(Node* srcGroup, int32_t id)
   return srcGroup->group.id != -1;
 }
 
-void Flatten::buildPrunedCopyRecurse(Node* dstParent, Node* srcGroup, unsigned level)
+void Flatten::relinkRecurse(Node* keptParent, Node* group, unsigned level)
 {
-  assert(srcGroup->kind == Node::Kind::Group);
+  assert(group->kind == Node::Kind::Group);
 
   // Only groups can contain geometry, so we must make sure that we have at least one group even when none is selected.
   // Also, some subsequent stages require that we do not have geometry in the first level of groups.
-  if (srcGroup->group.id == -1 && level < 2) {
-    srcGroup->group.id = -2;
+  if (group->group.id == -1 && level < 2) {
+    group->group.id = -2;
   }
 
-  if (srcGroup->group.id != -1) {
-    dstParent = dstStore->cloneNode(dstParent, srcGroup);
-    dstParent->group.id = srcGroup->group.id;
+  if (group->group.id != -1) {
+    // Kept, link it in below the nearest kept ancestor. The geometries stay where they are.
+    keptParent->children.insert(group);
+    keptParent = group;
   }
-
-  for (auto * srcGeo = srcGroup->group.geometries.first; srcGeo != nullptr; srcGeo = srcGeo->next) {
-    dstStore->cloneGeometry(dstParent, srcGeo);
+  else {
+    // Discarded, move geometries to the nearest kept ancestor. The node itself and its attributes are dropped.
+    ListHeader<Geometry> geometries = group->group.geometries;
+    group->group.geometries.clear();
+    while (Geometry* geo = geometries.popFront()) {
+      keptParent->group.geometries.insert(geo);
+    }
   }
 
-  for (auto * srcChild = srcGroup->children.first; srcChild != nullptr; srcChild = srcChild->next) {
-    buildPrunedCopyRecurse(dstParent, srcChild, level + 1);
+  // Grab children before processing them, since keptParent may be this group.
+  ListHeader<Node> children = group->children;
+  group->children.clear();
+  while (Node* child = children.popFront()) {
+    relinkRecurse(keptParent, child, level + 1);
   }
 }
 
-Store* Flatten::run()
+void Flatten::run()
 {
-  dstStore = new Store();
-
   // populateSrcTags was run by the constructor, and setKeep and keepTags has changed some group.index from ~0u.
   // set group.index of parents of selected nodes to ~1u so we can retain them in the culling pass.
   for (auto * srcRoot = srcStore->getFirstRoot(); srcRoot != nullptr; srcRoot = srcRoot->next) {
@@ -131,26 +137,19 @@ Store* Flatten::run()
     }
   }
 
-  // Create a fresh copy
+  // Relink the hierarchy in-place, nodes and geometries are reused and nothing is copied.
   for (auto * srcRoot = srcStore->getFirstRoot(); srcRoot != nullptr; srcRoot = srcRoot->next) {
-
     assert(srcRoot->kind == Node::Kind::File);
-    auto * dstRoot = dstStore->cloneNode(nullptr, srcRoot);
-
     for (auto * srcModel = srcRoot->children.first; srcModel != nullptr; srcModel = srcModel->next) {
-
       assert(srcModel->kind == Node::Kind::Model);
-      auto * dstModel = dstStore->cloneNode(dstRoot, srcModel);
 
-      for (auto * srcGroup = srcModel->children.first; srcGroup != nullptr; srcGroup = srcGroup->next) {
-        buildPrunedCopyRecurse(dstModel, srcGroup, 0);
+      ListHeader<Node> groups = srcModel->children;
+      srcModel->children.clear();
+      while (Node* srcGroup = groups.popFront()) {
+        relinkRecurse(srcModel, srcGroup, 0);
       }
     }
   }
 
-  dstStore->updateCounts();
-  auto rv = dstStore;
-  dstStore = nullptr;
-  return rv;
+  srcStore->updateCounts();
 }
-
@@ -19,7 +19,8 @@ public:
 
   unsigned activeTagsCount() const { return activeTags; }
 
-  Store* run();
+  // Prunes the hierarchy of the store passed to the constructor in-place.
+  void run();
 
 private:
   Map srcTags;  // All tags in source store
@@ -32,7 +33,6 @@ private:
   uint32_t activeTags = 0;
 
   Store* srcStore = nullptr;
-  Store* dstStore = nullptr;
 
   Node** stack = nullptr;
   unsigned stack_p = 0;
@@ -44,5 +44,5 @@ private:
 
   bool anyChildrenSelectedAndTagRecurse(Node* srcGroup, int32_t id = -1);
 
-  void buildPrunedCopyRecurse(Node* dstParent, Node* srcGroup, unsigned level);
+  void relinkRecurse(Node* keptParent, Node* group, unsigned level);
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include <cassert>
+#include <cctype>
+#include <cstring>
 #include <regex>
+#include <vector>
 
 #include "Store.h"
 
@@ -9,16 +12,121 @@
 // Simplifies the hierarchy by removing all nodes that doesn't have a name that
 // matches a regex. The geometries and attributes of discarded node are moved to
 // the neareast ancestor that is kept.
+//
+// Several regexes can be given, and a node is kept if any of them matches. Most
+// regexes in practice are either a literal name or a literal prefix followed by
+// .*, these are matched with a plain string compare and std::regex is only used
+// for the rest. Group names are interned and repeat a lot, so the result is
+// cached per name pointer.
 
 namespace {
-  
+
+  struct Pattern
+  {
+    enum struct Kind
+    {
+      Exact,    // literal must equal the name
+      Prefix,   // literal must be a prefix of the name
+      Regex     // anything else, fall back to std::regex
+    };
+    Kind kind = Kind::Regex;
+    std::string literal;
+    std::regex re;
+  };
+
+  bool isRegexMetaChar(char c)
+  {
+    return std::strchr(".[]{}()*+?|^$\\", c) != nullptr;
+  }
+
+  // Tries to recognize [^]literal[.*][$], where literal may contain escaped
+  // punctuation. Returns false if the regex must be run through std::regex.
+  bool parseLiteralPattern(Pattern& pattern, const std::string& regex)
+  {
+    size_t a = 0;
+    size_t b = regex.size();
+    if (a < b && regex[a] == '^') a++;
+    if (a < b && regex[b - 1] == '$') {
+      // The $ is an anchor unless an odd number of backslashes escapes it.
+      size_t backslashes = 0;
+      while (a + backslashes < b - 1 && regex[b - 2 - backslashes] == '\\') backslashes++;
+      if (backslashes % 2 == 0) b--;
+    }
+
+    std::string literal;
+    while (a < b) {
+      char c = regex[a];
+      if (c == '\\') {
+        if (a + 1 < b && std::ispunct(static_cast<unsigned char>(regex[a + 1]))) {
+          literal.push_back(regex[a + 1]);
+          a += 2;
+          continue;
+        }
+        return false;   // character classes like \d or \w
+      }
+      if (isRegexMetaChar(c)) break;
+      literal.push_back(c);
+      a++;
+    }
+
+    if (a == b) {
+      pattern.kind = Pattern::Kind::Exact;
+    }
+    else if (a + 2 == b && regex[a] == '.' && regex[a + 1] == '*') {
+      pattern.kind = Pattern::Kind::Prefix;
+    }
+    else {
+      return false;
+    }
+    pattern.literal = std::move(literal);
+    return true;
+  }
+
   struct Context
   {
     Store* store;
     Logger logger;
-    std::regex re;
+    std::vector<Pattern> patterns;
+    Map cache;    // interned name pointer -> 1 if kept, 2 if discarded
+    unsigned lookups = 0;
+    unsigned evaluated = 0;
+    unsigned regexEvaluated = 0;
   };
 
+  bool matchName(Context& ctx, const char* name)
+  {
+    ctx.evaluated++;
+    size_t length = std::strlen(name);
+    for (auto& pattern : ctx.patterns) {
+      switch (pattern.kind) {
+      case Pattern::Kind::Exact:
+        if (length == pattern.literal.size() && std::memcmp(name, pattern.literal.data(), length) == 0) return true;
+        break;
+      case Pattern::Kind::Prefix:
+        if (pattern.literal.size() <= length && std::memcmp(name, pattern.literal.data(), pattern.literal.size()) == 0) return true;
+        break;
+      case Pattern::Kind::Regex:
+        ctx.regexEvaluated++;
+        if (std::regex_match(name, name + length, pattern.re)) return true;
+        break;
+      }
+    }
+    return false;
+  }
+
+  bool keepNode(Context& ctx, const char* name)
+  {
+    if (name == nullptr) return false;
+    ctx.lookups++;
+
+    uint64_t val;
+    if (!ctx.cache.get(val, uint64_t(name))) {
+      val = matchName(ctx, name) ? 1 : 2;
+      ctx.cache.insert(uint64_t(name), val);
+    }
+    return val == 1;
+  }
+
   // Grabs all children from a parent node and checks the children one-by-one.
   // 
   // If the child is to be kept, it is inserted as a child of the nearest kept
@@ -38,7 +146,7 @@ namespace {
     while (Node* child = children.popFront()) {
 
       // Child should be kept
-      if (child->group.name && std::regex_match(child->group.name, ctx.re)) {
+      if (keepNode(ctx, child->group.name)) {
 
         // Set it as child of nearest kept ancestor node. That might be its original
         // parent, but that is OK since we removed all children from the parent
@@ -74,19 +182,28 @@ namespace {
 
 }
 
-bool flattenRegex(Store* store, Logger logger, const char* regex)
+bool flattenRegex(Store* store, Logger logger, const std::vector<std::string>& regexes)
 {
   Context ctx{
     .store = store,
     .logger = logger,
   };
 
-  try {
-    ctx.re = std::regex(regex);
-  }
-  catch (std::regex_error& e) {
-    ctx.logger(2, "Failed to compile regular expression '%s': %s", "sdf", e.what());
-    return false;
+  unsigned literalPatterns = 0;
+  ctx.patterns.resize(regexes.size());
+  for (size_t i = 0; i < regexes.size(); i++) {
+    auto& pattern = ctx.patterns[i];
+    if (parseLiteralPattern(pattern, regexes[i])) {
+      literalPatterns++;
+      continue;
+    }
+    try {
+      pattern.re = std::regex(regexes[i], std::regex::ECMAScript | std::regex::optimize);
+    }
+    catch (std::regex_error& e) {
+      ctx.logger(2, "Failed to compile regular expression '%s': %s", regexes[i].c_str(), e.what());
+      return false;
+    }
   }
 
   // The three lowest levels, file, model and first group are always kept
@@ -98,5 +215,8 @@ bool flattenRegex(Store* store, Logger logger, const char* regex)
     }
   }
 
+  ctx.logger(0, "flattenRegex: %zu patterns (%u literal), %u lookups, %u distinct names, %u regex evaluations",
+             ctx.patterns.size(), literalPatterns, ctx.lookups, ctx.evaluated, ctx.regexEvaluated);
+
   return true;
 }
@@ -0,0 +1,63 @@
+#include <cstring>
+#include <cassert>
+
+#include "Store.h"
+#include "Tessellator.h"
+#include "LinAlgOps.h"
+#include "GltfParametric.h"
+
+namespace {
+
+  // Number of floats in the Geometry union member of a kind.
+  unsigned parameterCount(Geometry::Kind kind)
+  {
+    switch (kind) {
+    case Geometry::Kind::Pyramid:           return 7;
+    case Geometry::Kind::Box:               return 3;
+    case Geometry::Kind::RectangularTorus:  return 4;
+    case Geometry::Kind::CircularTorus:     return 3;
+    case Geometry::Kind::EllipticalDish:    return 2;
+    case Geometry::Kind::SphericalDish:     return 2;
+    case Geometry::Kind::Snout:             return 9;
+    case Geometry::Kind::Cylinder:          return 2;
+    case Geometry::Kind::Sphere:            return 1;
+    default:                                return 0;
+    }
+  }
+
+}
+
+bool isParametric(const Geometry* geo)
+{
+  return parameterCount(geo->kind) != 0;
+}
+
+void encodeParametric(ParametricRecord& rec, const Geometry* geo, uint32_t material, const Vec3f& origin)
+{
+  assert(isParametric(geo));
+  std::memset(&rec, 0, sizeof(rec));
+  rec.kind = static_cast<uint32_t>(geo->kind);
+  rec.material = material;
+  std::memcpy(rec.M, geo->M_3x4.data, sizeof(rec.M));
+  for (unsigned r = 0; r < 3; r++) {
+    rec.M[9 + r] -= origin[r];
+  }
+  rec.sampleStartAngle = geo->sampleStartAngle;
+  std::memcpy(rec.params, &geo->pyramid, sizeof(float) * parameterCount(geo->kind));
+}
+
+Triangulation* decodeParametric(TriangulationFactory* factory, Arena* arena, const ParametricRecord& rec)
+{
+  Geometry geo;
+  geo.kind = static_cast<Geometry::Kind>(rec.kind);
+  unsigned n = rec.kind <= static_cast<uint32_t>(Geometry::Kind::Sphere) ? parameterCount(geo.kind) : 0;
+  if (n == 0) return nullptr;
+
+  std::memcpy(geo.M_3x4.data, rec.M, sizeof(rec.M));
+  geo.sampleStartAngle = rec.sampleStartAngle;
+  std::memcpy(&geo.pyramid, rec.params, sizeof(float) * n);
+  geo.bboxLocal = analyticBounds(&geo);
+  geo.bboxWorld = transform(geo.M_3x4, geo.bboxLocal);
+
+  return factory->geometry(arena, &geo, getScale(geo.M_3x4));
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include "Common.h"
+#include "LinAlg.h"
+
+// Parametric primitive as written by exportGLTF in parametric mode instead of
+// a triangulation. A gltf node that holds such primitives has
+//
+//   "extras": { "rvm-parametric": { "bufferView": <ix>, "count": <n>, "byteStride": 96 } }
+//
+// where the buffer view holds n little-endian records, and the node has no
+// transform of its own. Clients tessellate the records themselves, for
+// example with decodeParametric below.
+struct ParametricRecord
+{
+  uint32_t kind;          // Geometry::Kind, never Line or FacetGroup
+  uint32_t material;      // Index into the gltf materials
+  float M[12];            // Column-major 3x4 matrix from the primitive frame to the node frame
+  float sampleStartAngle; // Rotation of the circle samples about the primitive z axis
+  float params[9];        // Parameters in the order of the kind's member of the Geometry union,
+                          // for example radius and height for a cylinder, unused ones are zero
+};
+static_assert(sizeof(ParametricRecord) == 96);
+
+// True for the kinds that are written as records, that is, all but lines and facet groups.
+bool isParametric(const struct Geometry* geo);
+
+// Fills rec from geo with the translation relative to origin.
+void encodeParametric(ParametricRecord& rec, const struct Geometry* geo, uint32_t material, const Vec3f& origin);
+
+// Reference decoder, rebuilds the triangulation of a record in the primitive
+// frame. Caps are always included as connectivity is not recorded. Returns
+// nullptr for records of an unknown kind.
+Triangulation* decodeParametric(class TriangulationFactory* factory, Arena* arena, const ParametricRecord& rec);
@@ -123,6 +123,15 @@ inline float diagonal(const BBox3f& b) { return distance(b.min, b.max); }
 
 inline bool isEmpty(const BBox3f& b) { return b.max.x < b.min.x; }
 
+// Non-empty and with finite corners.
+inline bool isFinite(const BBox3f& b)
+{
+  for (unsigned k = 0; k < 3; k++) {
+    if (!std::isfinite(b.min[k]) || !std::isfinite(b.max[k]) || b.max[k] < b.min[k]) return false;
+  }
+  return true;
+}
+
 inline bool isNotEmpty(const BBox3f& b) { return b.min.x <= b.max.x; }
 
 inline float maxSideLength(const BBox3f& b)
@@ -4,4 +4,4 @@
 
 bool parseAtt(Store* store, Logger logger, const void * ptr, size_t size, bool create=false);
 
-bool parseRVM(Store* store, Logger logger, const char* path, const void * ptr, size_t size);
+bool parseRVM(Store* store, Logger logger, const char* path, const void * ptr, size_t size, bool growBounds=false);
@@ -21,6 +21,7 @@ namespace {
     char* buf;
     size_t buf_size;
     std::vector<Node*> group_stack;
+    bool growBounds;
   };
 
   const char* read_uint8(uint8_t& rv, const char* curr_ptr, const char* /*end_ptr*/)
@@ -176,7 +177,6 @@ namespace {
     for (unsigned i = 0; i < 6; i++) {
       curr_ptr = read_float32_be(g->bboxLocal.data[i], curr_ptr, end_ptr);
     }
-    g->bboxWorld = transform(g->M_3x4, g->bboxLocal);
 
     bool hasTransparency = false;
     switch (chunk_id) {
@@ -322,6 +322,23 @@ namespace {
       return nullptr;
     }
 
+    // Use the analytic bounds when the recorded box is garbage. With
+    // growBounds, also grow a recorded box to them so that group boxes and
+    // culling never cut off the primitive, which changes the boxes written
+    // for files whose recorded boxes are tighter.
+    if (!isFinite(g->bboxLocal) || ctx->growBounds) {
+      BBox3f bounds = analyticBounds(g);
+      if (isFinite(bounds)) {
+        if (isFinite(g->bboxLocal)) {
+          engulf(g->bboxLocal, bounds);
+        }
+        else {
+          g->bboxLocal = bounds;
+        }
+      }
+    }
+    g->bboxWorld = transform(g->M_3x4, g->bboxLocal);
+
     if (!verifyOffset(ctx, "PRIM", base_ptr, curr_ptr, expected_next_chunk_offset)) return nullptr;
 
     return curr_ptr;
@@ -431,14 +448,15 @@ namespace {
 
 }
 
-bool parseRVM(class Store* store, Logger logger, const char* path, const void * ptr, size_t size)
+bool parseRVM(class Store* store, Logger logger, const char* path, const void * ptr, size_t size, bool growBounds)
 {
   char buf[1024];
   Context ctx = {
     .store = store, 
     .logger = logger,
     .buf = buf,
-    .buf_size = sizeof(buf)
+    .buf_size = sizeof(buf),
+    .growBounds = growBounds
   };
 
   const char* base_ptr = reinterpret_cast<const char*>(ptr);
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "PipeTransport.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include "windows.h"
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+
+  std::wstring utf8ToWide(const std::string& str)
+  {
+    int size_needed = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), NULL, 0);
+    std::wstring result(size_needed, 0);
+    MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.size(), &result[0], size_needed);
+    return result;
+  }
+
+  class NamedPipeTransport : public PipeTransport
+  {
+  public:
+    NamedPipeTransport(Logger logger, HANDLE handle) : logger(logger), handle(handle) {}
+
+    ~NamedPipeTransport()
+    {
+      CloseHandle(handle);
+    }
+
+    bool write(const Chunk* chunks, size_t chunks_n) override
+    {
+      // One WriteFile per chunk keeps message boundaries in message-mode pipes.
+      for (size_t i = 0; i < chunks_n; i++) {
+        DWORD written = 0;
+        if (!WriteFile(handle, chunks[i].ptr, DWORD(chunks[i].size), &written, NULL) || written != chunks[i].size) {
+          logger(2, "PipeTransport: WriteFile failed (error %u)", unsigned(GetLastError()));
+          return false;
+        }
+        bytesWritten += chunks[i].size;
+      }
+      return true;
+    }
+
+    bool read(void* ptr, size_t size) override
+    {
+      auto* dst = (char*)ptr;
+      while (size) {
+        DWORD bytesRead = 0;
+        if (!ReadFile(handle, dst, DWORD(size), &bytesRead, NULL) && GetLastError() != ERROR_MORE_DATA) {
+          logger(2, "PipeTransport: ReadFile failed (error %u)", unsigned(GetLastError()));
+          return false;
+        }
+        dst += bytesRead;
+        size -= bytesRead;
+      }
+      return true;
+    }
+
+  private:
+    Logger logger;
+    HANDLE handle;
+  };
+
+#else
+
+  class FileDescriptorTransport : public PipeTransport
+  {
+  public:
+    FileDescriptorTransport(Logger logger, int fd, bool isSocket) : logger(logger), fd(fd), isSocket(isSocket) {}
+
+    ~FileDescriptorTransport()
+    {
+      close(fd);
+    }
+
+    // Gathers all chunks into a single writev/sendmsg straight from the
+    // caller's buffers, and resumes after partial writes.
+    bool write(const Chunk* chunks, size_t chunks_n) override
+    {
+      iovecs.resize(chunks_n);
+      for (size_t i = 0; i < chunks_n; i++) {
+        iovecs[i].iov_base = const_cast<void*>(chunks[i].ptr);
+        iovecs[i].iov_len = chunks[i].size;
+      }
+
+      size_t first = 0;
+      while (first < iovecs.size()) {
+        int n = int(std::min(iovecs.size() - first, size_t(IOV_MAX)));
+        ssize_t written;
+        if (isSocket) {
+          msghdr msg{};
+          msg.msg_iov = iovecs.data() + first;
+          msg.msg_iovlen = n;
+          written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        }
+        else {
+          written = writev(fd, iovecs.data() + first, n);
+        }
+        if (written < 0) {
+          if (errno == EINTR) continue;
+          logger(2, "PipeTransport: write failed: %s", strerror(errno));
+          return false;
+        }
+        bytesWritten += size_t(written);
+
+        size_t remaining = size_t(written);
+        while (first < iovecs.size() && iovecs[first].iov_len <= remaining) {
+          remaining -= iovecs[first].iov_len;
+          first++;
+        }
+        if (remaining) {
+          iovecs[first].iov_base = (char*)iovecs[first].iov_base + remaining;
+          iovecs[first].iov_len -= remaining;
+        }
+      }
+      return true;
+    }
+
+    bool read(void* ptr, size_t size) override
+    {
+      if (!isSocket) {
+        logger(2, "PipeTransport: cannot read from a FIFO, use a unix domain socket for flow control");
+        return false;
+      }
+      auto* dst = (char*)ptr;
+      while (size) {
+        ssize_t n = ::read(fd, dst, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+          logger(2, "PipeTransport: read failed: %s", n == 0 ? "connection closed" : strerror(errno));
+          return false;
+        }
+        dst += n;
+        size -= size_t(n);
+      }
+      return true;
+    }
+
+  private:
+    Logger logger;
+    int fd;
+    bool isSocket;
+    std::vector<iovec> iovecs;
+  };
+
+#endif
+
+}
+
+
+PipeTransport* createPipeTransport(Logger logger, const std::string& name)
+{
+#ifdef _WIN32
+  std::wstring fullname = L"\\\\.\\pipe\\" + utf8ToWide(name);
+  HANDLE handle = CreateFileW(fullname.c_str(),
+                              GENERIC_READ | GENERIC_WRITE,
+                              0, NULL, OPEN_EXISTING, 0, NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    logger(2, "PipeTransport: failed to open pipe %s (error %u)", name.c_str(), unsigned(GetLastError()));
+    return nullptr;
+  }
+  return new NamedPipeTransport(logger, handle);
+#else
+  struct stat st;
+  if (stat(name.c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+    int fd = open(name.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+      logger(2, "PipeTransport: failed to open FIFO %s: %s", name.c_str(), strerror(errno));
+      return nullptr;
+    }
+    return new FileDescriptorTransport(logger, fd, false);
+  }
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (sizeof(addr.sun_path) <= name.size()) {
+    logger(2, "PipeTransport: socket path %s is too long", name.c_str());
+    return nullptr;
+  }
+  std::memcpy(addr.sun_path, name.c_str(), name.size() + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    logger(2, "PipeTransport: failed to create socket: %s", strerror(errno));
+    return nullptr;
+  }
+  if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+    logger(2, "PipeTransport: failed to connect to %s: %s", name.c_str(), strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  return new FileDescriptorTransport(logger, fd, true);
+#endif
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include "Common.h"
+
+// Byte stream to the process that consumes the named pipe export.
+//
+// On Windows this is a named pipe, \\.\pipe\<name>. Elsewhere the name is a
+// path to either a unix domain stream socket or a FIFO. A FIFO is write-only,
+// so it can not be used with flow control.
+class PipeTransport
+{
+public:
+  struct Chunk
+  {
+    const void* ptr;
+    size_t size;
+  };
+
+  virtual ~PipeTransport() {}
+
+  // Writes the chunks in order, one message per chunk where the transport has
+  // message boundaries. Returns false if the connection is broken.
+  virtual bool write(const Chunk* chunks, size_t chunks_n) = 0;
+
+  // Reads exactly size bytes, blocking until they arrive.
+  virtual bool read(void* ptr, size_t size) = 0;
+
+  bool write(const void* ptr, size_t size)
+  {
+    Chunk chunk{ ptr, size };
+    return write(&chunk, 1);
+  }
+
+  size_t bytesWritten = 0;
+};
+
+// Returns nullptr and logs an error if the connection can not be opened.
+PipeTransport* createPipeTransport(Logger logger, const std::string& name);
@@ -21,6 +21,131 @@ namespace {
     }
   }
 
+  // Bounds of rho*(cos u, sin u) for rho in [rho0, rho1] and u between 0 and
+  // angle, the extremes are at the ends and where u crosses an axis.
+  void engulfSector(BBox3f& bbox, float rho0, float rho1, float angle, float z0, float z1)
+  {
+    const float half_pi = 1.57079632679f;
+    int k0 = 0;
+    int k1 = 3;
+    if (std::isfinite(angle) && std::abs(angle) < 4.f * half_pi) {
+      k0 = int(std::ceil(std::min(0.f, angle) / half_pi));
+      k1 = int(std::floor(std::max(0.f, angle) / half_pi));
+    }
+    for (float rho : { rho0, rho1 }) {
+      for (float z : { z0, z1 }) {
+        engulf(bbox, makeVec3f(rho, 0.f, z));
+        engulf(bbox, makeVec3f(rho * std::cos(angle), rho * std::sin(angle), z));
+        for (int k = k0; k <= k1; k++) {
+          switch (k & 3) {
+          case 0: engulf(bbox, makeVec3f( rho, 0.f, z)); break;
+          case 1: engulf(bbox, makeVec3f(0.f,  rho, z)); break;
+          case 2: engulf(bbox, makeVec3f(-rho, 0.f, z)); break;
+          case 3: engulf(bbox, makeVec3f(0.f, -rho, z)); break;
+          }
+        }
+      }
+    }
+  }
+
+}
+
+BBox3f analyticBounds(const Geometry* geo)
+{
+  BBox3f bbox = createEmptyBBox3f();
+  switch (geo->kind) {
+  case Geometry::Kind::Pyramid: {
+    auto& py = geo->pyramid;
+    float ox = 0.5f * py.offset[0];
+    float oy = 0.5f * py.offset[1];
+    float h2 = 0.5f * py.height;
+    engulf(bbox, makeVec3f(-0.5f * py.bottom[0] - ox, -0.5f * py.bottom[1] - oy, -h2));
+    engulf(bbox, makeVec3f( 0.5f * py.bottom[0] - ox,  0.5f * py.bottom[1] - oy, -h2));
+    engulf(bbox, makeVec3f(-0.5f * py.top[0] + ox, -0.5f * py.top[1] + oy, h2));
+    engulf(bbox, makeVec3f( 0.5f * py.top[0] + ox,  0.5f * py.top[1] + oy, h2));
+    break;
+  }
+  case Geometry::Kind::Box: {
+    Vec3f h = makeVec3f(0.5f * geo->box.lengths[0], 0.5f * geo->box.lengths[1], 0.5f * geo->box.lengths[2]);
+    engulf(bbox, -1.f * h);
+    engulf(bbox, h);
+    break;
+  }
+  case Geometry::Kind::RectangularTorus: {
+    auto& tor = geo->rectangularTorus;
+    float h2 = 0.5f * tor.height;
+    engulfSector(bbox, tor.inner_radius, tor.outer_radius, tor.angle, -h2, h2);
+    break;
+  }
+  case Geometry::Kind::CircularTorus: {
+    auto& ct = geo->circularTorus;
+    engulfSector(bbox, ct.offset - ct.radius, ct.offset + ct.radius, ct.angle, -ct.radius, ct.radius);
+    break;
+  }
+  case Geometry::Kind::EllipticalDish: {
+    float r = geo->ellipticalDish.baseRadius;
+    engulf(bbox, makeVec3f(-r, -r, 0.f));
+    engulf(bbox, makeVec3f(r, r, geo->ellipticalDish.height));
+    break;
+  }
+  case Geometry::Kind::SphericalDish: {
+    // A dish higher than its base radius is more than a hemisphere and
+    // bulges out to the sphere radius.
+    float r = geo->sphericalDish.baseRadius;
+    float h = geo->sphericalDish.height;
+    if (r < h) {
+      r = (r * r + h * h) / (2.f * h);
+    }
+    engulf(bbox, makeVec3f(-r, -r, 0.f));
+    engulf(bbox, makeVec3f(r, r, h));
+    break;
+  }
+  case Geometry::Kind::Snout: {
+    // Caps are discs in planes tilted by the shear angles.
+    auto& sn = geo->snout;
+    float h2 = 0.5f * sn.height;
+    float ox = 0.5f * sn.offset[0];
+    float oy = 0.5f * sn.offset[1];
+    float rb = std::abs(sn.radius_b);
+    float rt = std::abs(sn.radius_t);
+    float zb = rb * std::hypot(std::tan(sn.bshear[0]), std::tan(sn.bshear[1]));
+    float zt = rt * std::hypot(std::tan(sn.tshear[0]), std::tan(sn.tshear[1]));
+    engulf(bbox, makeVec3f(-rb - ox, -rb - oy, -h2 - zb));
+    engulf(bbox, makeVec3f( rb - ox,  rb - oy, -h2 + zb));
+    engulf(bbox, makeVec3f(-rt + ox, -rt + oy, h2 - zt));
+    engulf(bbox, makeVec3f( rt + ox,  rt + oy, h2 + zt));
+    break;
+  }
+  case Geometry::Kind::Cylinder: {
+    float r = std::abs(geo->cylinder.radius);
+    float h2 = 0.5f * geo->cylinder.height;
+    engulf(bbox, makeVec3f(-r, -r, -h2));
+    engulf(bbox, makeVec3f(r, r, h2));
+    break;
+  }
+  case Geometry::Kind::Sphere: {
+    float r = 0.5f * std::abs(geo->sphere.diameter);
+    engulf(bbox, makeVec3f(-r, -r, -r));
+    engulf(bbox, makeVec3f(r, r, r));
+    break;
+  }
+  case Geometry::Kind::Line:
+    engulf(bbox, makeVec3f(geo->line.a, 0.f, 0.f));
+    engulf(bbox, makeVec3f(geo->line.b, 0.f, 0.f));
+    break;
+  case Geometry::Kind::FacetGroup:
+    for (unsigned p = 0; p < geo->facetGroup.polygons_n; p++) {
+      auto& poly = geo->facetGroup.polygons[p];
+      for (unsigned c = 0; c < poly.contours_n; c++) {
+        auto& cont = poly.contours[c];
+        for (unsigned i = 0; i < cont.vertices_n; i++) {
+          engulf(bbox, makeVec3f(cont.vertices + 3 * i));
+        }
+      }
+    }
+    break;
+  }
+  return bbox;
 }
 
 
@@ -30,8 +155,6 @@ Store::Store()
   debugLines.clear();
   connections.clear();
   setErrorString("");
-
-  geometryBinaryReuse = (char*)arenaGeometryBinary.alloc(geometryBinaryLength);
 }
 
 Color* Store::newColor(Node* parent)
@@ -157,20 +280,23 @@ Geometry* Store::cloneGeometry(Node* parent, const Geometry* src)
     dtri->id = stri->id;
     if (stri->vertices_n) {
       dtri->vertices_n = stri->vertices_n;
-      dtri->vertices = (float*)arena.dup(stri->vertices, 3 * sizeof(float) * dtri->vertices_n);
-      dtri->normals = (float*)arena.dup(stri->normals, 3 * sizeof(float) * dtri->vertices_n);
-      dtri->texCoords = (float*)arena.dup(stri->texCoords, 2 * sizeof(float) * dtri->vertices_n);
+      if (stri->vertices) dtri->vertices = (float*)arena.dup(stri->vertices, 3 * sizeof(float) * dtri->vertices_n);
+      if (stri->halfVertices) dtri->halfVertices = (uint16_t*)arena.dup(stri->halfVertices, 3 * sizeof(uint16_t) * dtri->vertices_n);
+      if (stri->normals) dtri->normals = (float*)arena.dup(stri->normals, 3 * sizeof(float) * dtri->vertices_n);
+      if (stri->octNormals) dtri->octNormals = (int16_t*)arena.dup(stri->octNormals, 2 * sizeof(int16_t) * dtri->vertices_n);
+      if (stri->texCoords) dtri->texCoords = (float*)arena.dup(stri->texCoords, 2 * sizeof(float) * dtri->vertices_n);
     }
     if (stri->triangles_n) {
       dtri->triangles_n = stri->triangles_n;
-      dtri->indices = (uint32_t*)arena.dup(stri->indices, 3 * sizeof(uint32_t) * dtri->triangles_n);
+      if (stri->indices) dtri->indices = (uint32_t*)arena.dup(stri->indices, 3 * sizeof(uint32_t) * dtri->triangles_n);
+      if (stri->indices16) dtri->indices16 = (uint16_t*)arena.dup(stri->indices16, 3 * sizeof(uint16_t) * dtri->triangles_n);
     }
   }
 
   return dst;
 }
 
-bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosize)
+bool Store::serializeGeometry(const Geometry* geo, std::string& binary)
 {
     //лʱҪע ƽ̨ͱ뻷Ĳ졣
     // int -> Ӧʹ int32_tȷ4ֽ
@@ -186,6 +312,8 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
 
     auto scale = getScale(geo->M_3x4);
 
+    size_t geosize = 0;
+
     //int32_t TriangleCount = geo->triangulation ? geo->triangulation->triangles_n : -1;
 
     //ͳһ100
@@ -197,14 +325,15 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
     {
         geosize = sizeof(int32_t) + sizeof(geo->pyramid) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->pyramid, sizeof(geo->pyramid));
+        memcpy(dst + pos, &geo->pyramid, sizeof(geo->pyramid));
         //pos += sizeof(geo->pyramid);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
 
 
@@ -215,14 +344,15 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
 
         geosize = sizeof(int32_t) + sizeof(Geometry::box) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->box, sizeof(Geometry::box));
+        memcpy(dst + pos, &geo->box, sizeof(Geometry::box));
         //pos += sizeof(Geometry::box);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
     }
     break;
@@ -232,18 +362,19 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->rectangularTorus) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->rectangularTorus, sizeof(geo->rectangularTorus));
+        memcpy(dst + pos, &geo->rectangularTorus, sizeof(geo->rectangularTorus));
         pos += sizeof(geo->rectangularTorus);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
 
 
@@ -255,19 +386,20 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->sphere) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->sphere, sizeof(geo->sphere));
+        memcpy(dst + pos, &geo->sphere, sizeof(geo->sphere));
         pos += sizeof(geo->sphere);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
 
     }
@@ -293,45 +425,46 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         }
         //geosize += sizeof(TriangleCount);
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->facetGroup.polygons_n, sizeof(geo->facetGroup.polygons_n));
+        memcpy(dst + pos, &geo->facetGroup.polygons_n, sizeof(geo->facetGroup.polygons_n));
         pos += sizeof(geo->facetGroup.polygons_n);
 
         for (size_t i = 0; i < geo->facetGroup.polygons_n; i++)
         {
             auto& polygon = geo->facetGroup.polygons[i];
 
-            memcpy(geometryBinaryReuse + pos, &polygon.contours_n, sizeof(polygon.contours_n));
+            memcpy(dst + pos, &polygon.contours_n, sizeof(polygon.contours_n));
             pos += sizeof(polygon.contours_n);
 
             for (size_t j = 0; j < polygon.contours_n; j++)
             {
                 auto& contour = polygon.contours[j];
 
-                memcpy(geometryBinaryReuse + pos, &contour.vertices_n, sizeof(contour.vertices_n));
+                memcpy(dst + pos, &contour.vertices_n, sizeof(contour.vertices_n));
                 pos += sizeof(contour.vertices_n);
 
-                memcpy(geometryBinaryReuse + pos, contour.vertices, sizeof(float) * contour.vertices_n * 3);
+                memcpy(dst + pos, contour.vertices, sizeof(float) * contour.vertices_n * 3);
                 pos += sizeof(float) * contour.vertices_n * 3;
-                memcpy(geometryBinaryReuse + pos, contour.normals, sizeof(float) * contour.vertices_n * 3);
+                memcpy(dst + pos, contour.normals, sizeof(float) * contour.vertices_n * 3);
                 pos += sizeof(float) * contour.vertices_n * 3;
 
                 //for (size_t k = 0; k < contour.vertices_n; k++)
                 //{
-                //    memcpy(geometryBinaryReuse + pos, contour.vertices, sizeof(float) * contour.vertices_n * 3);
+                //    memcpy(dst + pos, contour.vertices, sizeof(float) * contour.vertices_n * 3);
                 //    pos += sizeof(float) * contour.vertices_n * 3;
-                //    memcpy(geometryBinaryReuse + pos, contour.normals, sizeof(float) * contour.vertices_n * 3);
+                //    memcpy(dst + pos, contour.normals, sizeof(float) * contour.vertices_n * 3);
                 //    pos += sizeof(float) * contour.vertices_n * 3;
                 //}
 
             }
         }
 
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
     }
     break;
@@ -342,19 +475,20 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->snout) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->snout, sizeof(geo->snout));
+        memcpy(dst + pos, &geo->snout, sizeof(geo->snout));
         pos += sizeof(geo->snout);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
 
 
@@ -366,19 +500,20 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->ellipticalDish) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->ellipticalDish, sizeof(geo->ellipticalDish));
+        memcpy(dst + pos, &geo->ellipticalDish, sizeof(geo->ellipticalDish));
         pos += sizeof(geo->ellipticalDish);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
 
     }
@@ -389,18 +524,19 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->sphericalDish) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->sphericalDish, sizeof(geo->sphericalDish));
+        memcpy(dst + pos, &geo->sphericalDish, sizeof(geo->sphericalDish));
         pos += sizeof(geo->sphericalDish);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
     }
     break;
@@ -409,18 +545,19 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->cylinder) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->cylinder, sizeof(geo->cylinder));
+        memcpy(dst + pos, &geo->cylinder, sizeof(geo->cylinder));
         pos += sizeof(geo->cylinder);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
     }
     break;
@@ -430,18 +567,19 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
         geosize = sizeof(int32_t) + sizeof(geo->circularTorus) + sizeof(scale) +
             sizeof(geo->sampleStartAngle) /*+ sizeof(TriangleCount)*/;
 
-        ResizeGeometryBinaryReuse(geosize);
+        binary.resize(geosize);
+        char* dst = binary.data();
 
         size_t pos = 0;
-        memcpy(geometryBinaryReuse, &rvmkind, sizeof(int32_t));
+        memcpy(dst, &rvmkind, sizeof(int32_t));
         pos += sizeof(int32_t);
-        memcpy(geometryBinaryReuse + pos, &geo->circularTorus, sizeof(geo->circularTorus));
+        memcpy(dst + pos, &geo->circularTorus, sizeof(geo->circularTorus));
         pos += sizeof(geo->circularTorus);
-        memcpy(geometryBinaryReuse + pos, &scale, sizeof(scale));
+        memcpy(dst + pos, &scale, sizeof(scale));
         pos += sizeof(scale);
-        memcpy(geometryBinaryReuse + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
+        memcpy(dst + pos, &geo->sampleStartAngle, sizeof(geo->sampleStartAngle));
         //pos += sizeof(geo->sampleStartAngle);
-        //memcpy(geometryBinaryReuse + pos, &TriangleCount, sizeof(TriangleCount));
+        //memcpy(dst + pos, &TriangleCount, sizeof(TriangleCount));
 
 
     }
@@ -454,10 +592,10 @@ bool Store::serializeGeometry(const Geometry* geo, char*& binary, size_t& geosiz
 
     if (geosize > 0)
     {
-        binary = geometryBinaryReuse;
         return true;
     }
 
+    binary.clear();
     return false;
 }
 
@@ -905,19 +1043,6 @@ void Store::apply(StoreVisitor* visitor, Node* group)
   visitor->EndGroup();
 }
 
-void Store::ResizeGeometryBinaryReuse(const int& RequestLen)
-{
-    if (geometryBinaryLength < RequestLen)
-    {
-        geometryBinaryLength = RequestLen;
-        arenaGeometryBinary.clear();
-        geometryBinaryReuse = nullptr;
-    }
-
-    if (geometryBinaryReuse == nullptr)
-        geometryBinaryReuse = (char*)arenaGeometryBinary.alloc(geometryBinaryLength);
-}
-
 void Store::DeleteFacetGroup(Geometry* geo)
 {
     if (geo == nullptr || geo->kind != Geometry::Kind::FacetGroup)
@@ -1,5 +1,8 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <cmath>
 #include "Common.h"
 #include "LinAlg.h"
 
@@ -19,15 +22,98 @@ struct Polygon
   uint32_t contours_n;
 };
 
+inline float halfToFloat(uint16_t h)
+{
+  uint32_t sign = uint32_t(h & 0x8000u) << 16;
+  uint32_t exponent = (h >> 10) & 0x1Fu;
+  uint32_t mantissa = h & 0x3FFu;
+  uint32_t bits;
+  if (exponent == 0) {
+    float f = float(mantissa) * (1.f / 16777216.f);
+    std::memcpy(&bits, &f, sizeof(bits));
+    bits |= sign;
+  }
+  else if (exponent == 31) {
+    bits = sign | 0x7F800000u | (mantissa << 13);
+  }
+  else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Unit vector from two snorm16 octahedral coordinates.
+inline Vec3f octDecode(const int16_t* e)
+{
+  float x = std::max(-1.f, e[0] * (1.f / 32767.f));
+  float y = std::max(-1.f, e[1] * (1.f / 32767.f));
+  float z = 1.f - std::abs(x) - std::abs(y);
+  if (z < 0.f) {
+    float t = x;
+    x = std::copysign(1.f - std::abs(y), x);
+    y = std::copysign(1.f - std::abs(t), y);
+  }
+  float r = 1.f / std::sqrt(x * x + y * y + z * z);
+  return makeVec3f(r * x, r * y, r * z);
+}
+
+// A triangulation is either plain, with float positions and normals and 32-bit
+// indices, or compact (see TriangulationFactory::compact), where each of the
+// arrays may be replaced by its compact counterpart. Use the accessors unless
+// the plain arrays are known to be present.
 struct Triangulation {
   float* vertices = nullptr;
   float* normals = nullptr;
   float* texCoords = nullptr;
   uint32_t* indices = 0;
+  uint16_t* halfVertices = nullptr;   // Compact positions, half floats in the local frame.
+  int16_t* octNormals = nullptr;      // Compact normals, two snorm16 octahedral coordinates per vertex.
+  uint16_t* indices16 = nullptr;      // Compact indices, when there are at most 65536 vertices.
   uint32_t vertices_n = 0;
   uint32_t triangles_n = 0;
   int32_t id = 0;
   float error = 0.f;
+  Triangulation* coarser = nullptr;   // Next level of detail tessellated with a larger tolerance, if any.
+
+  bool hasVertices() const { return vertices || halfVertices; }
+  bool hasNormals() const { return normals || octNormals; }
+  bool hasIndices() const { return indices || indices16; }
+
+  Vec3f vertex(size_t i) const
+  {
+    if (vertices) return makeVec3f(vertices + 3 * i);
+    return makeVec3f(halfToFloat(halfVertices[3 * i + 0]),
+                     halfToFloat(halfVertices[3 * i + 1]),
+                     halfToFloat(halfVertices[3 * i + 2]));
+  }
+
+  Vec3f normal(size_t i) const
+  {
+    if (normals) return makeVec3f(normals + 3 * i);
+    return octDecode(octNormals + 2 * i);
+  }
+
+  // Vertex index i, where i < 3 * triangles_n.
+  uint32_t index(size_t i) const
+  {
+    return indices ? indices[i] : indices16[i];
+  }
+
+  // Bytes used by the vertex and index arrays.
+  size_t arrayBytes() const
+  {
+    size_t bytes = 0;
+    if (vertices) bytes += 3 * sizeof(float) * vertices_n;
+    if (halfVertices) bytes += 3 * sizeof(uint16_t) * vertices_n;
+    if (normals) bytes += 3 * sizeof(float) * vertices_n;
+    if (octNormals) bytes += 2 * sizeof(int16_t) * vertices_n;
+    if (texCoords) bytes += 2 * sizeof(float) * vertices_n;
+    if (indices) bytes += 3 * sizeof(uint32_t) * triangles_n;
+    if (indices16) bytes += 3 * sizeof(uint16_t) * triangles_n;
+    return bytes;
+  }
 };
 
 struct Color
@@ -155,6 +241,10 @@ struct Geometry
   };
 };
 
+// Bounding box in the local frame computed from the primitive parameters, in
+// the same frame as the tessellation.
+BBox3f analyticBounds(const Geometry* geo);
+
 template<typename T>
 struct ListHeader
 {
@@ -279,8 +369,8 @@ public:
   Geometry* cloneGeometry(Node* parent, const Geometry* src);
 
 
-  //binary Storeͷ
-  bool serializeGeometry(const Geometry* geo, char*& binary, size_t& geosize);
+  //binaryɵṩظʹãֻʱڴ档Storeڶ߳е
+  static bool serializeGeometry(const Geometry* geo, std::string& binary);
 
   //binaryɵ߹Geometry*Ҳɵͷ
   static bool deserializeGeometry(const char* buffer, const size_t& bufsize, Geometry* geo, float& scale);
@@ -322,13 +412,12 @@ public:
   Arena arena;
   Arena arenaTriangulation;
 
-  Arena arenaGeometryBinary;
-
   struct Stats* stats = nullptr;
   struct Connectivity* conn = nullptr;
 
 
   StringInterning strings;
+  Utf8Names utf8Names;
 
   void updateCounts();
 
@@ -353,12 +442,6 @@ private:
   ListHeader<DebugLine> debugLines;
   ListHeader<Connection> connections;
 
-protected:
-  char* geometryBinaryReuse = nullptr;
-  int geometryBinaryLength = 16 * 1024 * 1024; //Ԥ16Mڴ棬ظʹ
-
-  void ResizeGeometryBinaryReuse(const int& RequestLen);
-
 public:
   static void DeleteFacetGroup(Geometry* geo);
   
@@ -4,6 +4,8 @@
 class StoreVisitor
 {
 public:
+  virtual ~StoreVisitor() {}
+
   virtual void init(class Store& /*store*/) {}
 
   virtual bool done() { return true; }
@@ -10,25 +10,25 @@
 #include "Tessellator.h"
 #include "LinAlgOps.h"
 
-namespace {
-
-  const float pi = float(M_PI);
-  const float half_pi = float(0.5*M_PI);
-
-}
-
-Tessellator::Tessellator(Logger logger, float tolerance, float cullLeafThreshold, float cullGeometryThreshold, unsigned maxSamples) :
+Tessellator::Tessellator(Logger logger, float tolerance, float cullLeafThreshold, float cullGeometryThreshold, unsigned maxSamples, unsigned lodLevels, float lodScale, bool weldVertices, bool compact) :
   logger(logger),
   tolerance(tolerance),
   maxSamples(maxSamples),
   cullLeafThresholdScaled(tolerance * cullLeafThreshold),
-  cullGeometryThresholdScaled(tolerance * cullGeometryThreshold)
+  cullGeometryThresholdScaled(tolerance * cullGeometryThreshold),
+  lodLevels(std::min(maxLodLevels, std::max(1u, lodLevels))),
+  lodScale(std::max(1.f, lodScale)),
+  weldVertices(weldVertices),
+  compact(compact)
 {
 }
 
 Tessellator::~Tessellator()
 {
   delete factory;
+  for (unsigned i = 0; i + 1 < lodLevels; i++) {
+    delete lodFactories[i];
+  }
 }
 
 Triangulation* Tessellator::getTriangulation(Geometry* geo)
@@ -62,6 +62,7 @@ void Tessellator::init(class Store& store_)
   store = &store_;
 
   factory = new TriangulationFactory(store, logger, tolerance, 3, maxSamples),
+  factory->weldVertices = weldVertices;
 
   store->arenaTriangulation.clear();
 
@@ -70,11 +71,139 @@ void Tessellator::init(class Store& store_)
 
   stack = (StackItem*)arena.alloc(sizeof(StackItem)*store->groupCountAllocated());
   stack_p = 0;
+
+  // Coarser levels of detail re-tessellate the parametric primitive with a
+  // successively larger tolerance instead of decimating the finest mesh.
+  float lodTolerance = tolerance;
+  for (unsigned i = 0; i + 1 < lodLevels; i++) {
+    lodTolerance *= lodScale;
+    lodFactories[i] = new TriangulationFactory(store, logger, lodTolerance, 3, maxSamples);
+  }
+
+  budgetLevel.clear();
+  if (triangleBudget) {
+    planBudget();
+  }
+}
+
+namespace {
+
+  void collectGeometries(std::vector<Geometry*>& geos, Node* node)
+  {
+    for (auto * child = node->children.first; child != nullptr; child = child->next) {
+      collectGeometries(geos, child);
+    }
+    if (node->kind == Node::Kind::Group) {
+      for (auto * geo = node->group.geometries.first; geo != nullptr; geo = geo->next) {
+        if (geo->kind != Geometry::Kind::Line) {
+          geos.push_back(geo);
+        }
+      }
+    }
+  }
+
+  // Level of a geometry of the given world diagonal when geometries smaller
+  // than size get their tolerance multiplied by size/diagonal.
+  unsigned budgetLevelOf(float size, float diagonal, unsigned levels)
+  {
+    if (!(0.f < diagonal)) return levels - 1;
+    float ratio = size / diagonal;
+    if (ratio < 2.f) return 0;
+    return std::min(levels - 1, unsigned(std::log2(ratio)));
+  }
+
+}
+
+void Tessellator::planBudget()
+{
+  std::vector<Geometry*> geos;
+  for (auto * root = store->getFirstRoot(); root != nullptr; root = root->next) {
+    collectGeometries(geos, root);
+  }
+
+  // Triangle count of every geometry at every level. The tolerance reaches the
+  // factory only as tolerance/scale, so a coarser level is the same geometry
+  // at a smaller scale. The counts come from the sampling formulas, nothing is
+  // tessellated.
+  std::vector<uint32_t> counts(budgetLevels * geos.size());
+  std::vector<float> diagonals(geos.size());
+  float minDiagonal = FLT_MAX;
+  float maxDiagonal = 0.f;
+  for (size_t i = 0; i < geos.size(); i++) {
+    auto * geo = geos[i];
+    auto * c = counts.data() + budgetLevels * i;
+    diagonals[i] = diagonal(geo->bboxWorld);
+    if (0.f < diagonals[i]) {
+      minDiagonal = std::min(minDiagonal, diagonals[i]);
+      maxDiagonal = std::max(maxDiagonal, diagonals[i]);
+    }
+
+    auto scale = getScale(geo->M_3x4);
+    c[0] = factory->triangleCount(geo, scale);
+    unsigned l = 1;
+    for (; l < budgetLevels && geo->kind != Geometry::Kind::FacetGroup; l++) {
+      c[l] = factory->triangleCount(geo, scale / float(1u << l));
+    }
+    for (; l < budgetLevels; l++) {
+      c[l] = c[l - 1];
+    }
+  }
+
+  auto total = [&](float size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < geos.size(); i++) {
+      sum += counts[budgetLevels * i + budgetLevelOf(size, diagonals[i], budgetLevels)];
+    }
+    return sum;
+  };
+
+  // The total only decreases with size, bisect between everything at the base
+  // tolerance and everything at the coarsest level.
+  budgetSize = 0.f;
+  budgetEstimate = total(budgetSize);
+  if (triangleBudget < budgetEstimate && !geos.empty()) {
+    float lo = minDiagonal;
+    float hi = std::max(minDiagonal, maxDiagonal) * float(1u << budgetLevels);
+    uint64_t hiTotal = total(hi);
+    if (triangleBudget < hiTotal) {
+      logger(1, "Triangle budget %llu is below the %llu triangles at %u times the tolerance",
+             triangleBudget, hiTotal, 1u << (budgetLevels - 1));
+    }
+    else {
+      for (unsigned iter = 0; iter < 64 && lo * 1.001f < hi; iter++) {
+        float mid = std::sqrt(lo * hi);
+        uint64_t t = total(mid);
+        if (t <= triangleBudget) {
+          hi = mid;
+          hiTotal = t;
+        }
+        else {
+          lo = mid;
+        }
+      }
+    }
+    budgetSize = hi;
+    budgetEstimate = hiTotal;
+
+    for (size_t i = 0; i < geos.size(); i++) {
+      unsigned level = budgetLevelOf(budgetSize, diagonals[i], budgetLevels);
+      if (level && counts[budgetLevels * i] != counts[budgetLevels * i + level]) {
+        budgetLevel.insert(uint64_t(geos[i]), level);
+        budgetCoarsened++;
+      }
+    }
+  }
 }
 
 void Tessellator::endModel()
 {
   logger(0, "Discarded %u caps.", factory->discardedCaps);
+  weldInputVertices = factory->weldInputVertices;
+  weldOutputVertices = factory->weldOutputVertices;
+  fanPolygons = factory->fanPolygons;
+  earClippedPolygons = factory->earClippedPolygons;
+  libtessCalls = factory->libtessCalls;
+  libtessNanoseconds = factory->libtessNanoseconds;
 }
 
 
@@ -104,8 +233,6 @@ void Tessellator::geometry(Geometry* geo)
   }
   processed++;
 
-  auto scale = getScale(geo->M_3x4);
-
   // Group error less than threshold, skip tessellation and record error.
   if (stack[stack_p - 1].groupError < cullLeafThresholdScaled) {
     geo->triangulation = store->arenaTriangulation.alloc<Triangulation>();
@@ -123,78 +250,98 @@ void Tessellator::geometry(Geometry* geo)
   }
 
 
-  Triangulation* tri = nullptr;
-  switch (geo->kind) {
-  case Geometry::Kind::Pyramid:
-    tri = factory->pyramid(&store->arenaTriangulation, geo, scale);
-    break;
-
-  case Geometry::Kind::Box:
-    tri = factory->box(&store->arenaTriangulation, geo, scale);
-    break;
-
-  case Geometry::Kind::RectangularTorus:
-    tri = factory->rectangularTorus(&store->arenaTriangulation, geo, scale);
-    break;
-    
-  case Geometry::Kind::CircularTorus:
-    tri = factory->circularTorus(&store->arenaTriangulation, geo, scale);
-    break;
-
-  case Geometry::Kind::EllipticalDish:
-    tri = factory->sphereBasedShape(&store->arenaTriangulation, geo, geo->ellipticalDish.baseRadius, half_pi, 0.f, geo->ellipticalDish.height / geo->ellipticalDish.baseRadius, scale);
-    break;
-
-  case Geometry::Kind::SphericalDish: {
-    float r_circ = geo->sphericalDish.baseRadius;
-    auto h = geo->sphericalDish.height;
-    float r_sphere = (r_circ*r_circ + h * h) / (2.f*h);
-    float sinval = std::min(1.f, std::max(-1.f, r_circ / r_sphere));
-    float arc = asin(sinval);
-    if (r_circ < h) { arc = pi - arc; }
-    tri = factory->sphereBasedShape(&store->arenaTriangulation, geo, r_sphere, arc, h - r_sphere, 1.f, scale);
-    break;
-  }
-  case Geometry::Kind::Snout:
-    tri = factory->snout(&store->arenaTriangulation, geo, scale);
-    break;
-
-  case Geometry::Kind::Cylinder:
-    tri = factory->cylinder(&store->arenaTriangulation, geo, scale);
-    break;
-
-  case Geometry::Kind::Sphere:
-    tri = factory->sphereBasedShape(&store->arenaTriangulation, geo, 0.5f*geo->sphere.diameter, pi, 0.f, 1.f, scale);
-    break;
-
-  case Geometry::Kind::FacetGroup:
-    tri = factory->facetGroup(&store->arenaTriangulation, geo, scale);
-    break;
-
-  case Geometry::Kind::Line:  // Handled at start of function.
-  default:
-    assert(false && "Unhandled primitive type");
-    break;
-  }
+  geo->triangulation = tessellate(&store->arenaTriangulation, geo);
+  process(geo);
+}
 
-  geo->triangulation = tri;
+Triangulation* Tessellator::tessellate(Arena* arena, const Geometry* geo)
+{
+  // A geometry coarsened by the triangle budget is tessellated as if it was
+  // smaller, which multiplies the effective tolerance.
+  unsigned level = unsigned(budgetLevel.get(uint64_t(geo)));
+  float multiplier = float(1u << level);
+  auto scale = getScale(geo->M_3x4) / multiplier;
+
+  Arena* triArena = compact ? &scratch : arena;
+  Triangulation* tri = factory->geometry(triArena, geo, scale);
   vertices += uint64_t(tri->vertices_n);
   triangles += uint64_t(tri->triangles_n);
 
-  BBox3f box = createEmptyBBox3f();
-  for (unsigned i = 0; i < geo->triangulation->vertices_n; i++) {
-    engulf(box, makeVec3f(geo->triangulation->vertices + 3 * i));
+  // Boxes, pyramids and facet groups do not depend on the tolerance, so
+  // coarser levels would just be copies of the finest level.
+  if (geo->kind != Geometry::Kind::Box &&
+      geo->kind != Geometry::Kind::Pyramid &&
+      geo->kind != Geometry::Kind::FacetGroup)
+  {
+    Triangulation* finer = tri;
+    for (unsigned i = 0; i + 1 < lodLevels; i++) {
+      Triangulation* coarser = lodFactories[i]->geometry(triArena, geo, scale);
+
+      // Segment counts are clamped by minSamples, stop when a level no longer reduces.
+      if (finer->triangles_n <= coarser->triangles_n) break;
+
+      coarser->id = geo->id;
+      finer->coarser = coarser;
+      finer = coarser;
+      lodTessellated++;
+      lodVertices += uint64_t(coarser->vertices_n);
+      lodTriangles += uint64_t(coarser->triangles_n);
+    }
   }
-  //assert(geo->bbox_l.min[0] < box.min[0] + 0.1f*box.maxSideLength());
-  //assert(geo->bbox_l.min[1] < box.min[1] + 0.1f*box.maxSideLength());
-  //assert(geo->bbox_l.min[2] < box.min[2] + 0.1f*box.maxSideLength());
 
-  //assert(box.max[0] - 0.1f*box.maxSideLength() < geo->bbox_l.max[0]);
-  //assert(box.max[1] - 0.1f*box.maxSideLength() < geo->bbox_l.max[1]);
-  //assert(box.max[2] - 0.1f*box.maxSideLength() < geo->bbox_l.max[2]);
+  tri->id = geo->id;
+  if (level) {
+    for (Triangulation* t = tri; t; t = t->coarser) {
+      t->error *= multiplier;
+    }
+  }
+  maxError = std::max(maxError, tri->error);
+
+  Triangulation* rv = tri;
+  if (compact) {
+    Triangulation** dst = &rv;
+    for (const Triangulation* src = tri; src; src = src->coarser) {
+      *dst = factory->compact(arena, src, scale);
+      plainTriangulationBytes += src->arrayBytes();
+      triangulationBytes += (*dst)->arrayBytes();
+      if ((*dst)->halfVertices) halfVertexTriangulations++;
+      dst = &(*dst)->coarser;
+    }
+    scratch.reset();
+  }
+  else {
+    for (const Triangulation* src = tri; src; src = src->coarser) {
+      plainTriangulationBytes += src->arrayBytes();
+      triangulationBytes += src->arrayBytes();
+    }
+  }
 
-  geo->triangulation->id = geo->id;
-  process(geo);
+  if (validateBounds) {
+    // The bounds already include the analytic bounds, only allow for float
+    // rounding and half float positions.
+    const BBox3f& bbox = geo->bboxLocal;
+    float slack = 1e-4f * diagonal(bbox) + tolerance / scale;
+    for (const Triangulation* t = rv; t; t = t->coarser) {
+      unsigned outside = 0;
+      for (size_t i = 0; i < t->vertices_n; i++) {
+        Vec3f p = t->vertex(i);
+        for (unsigned k = 0; k < 3; k++) {
+          if (p[k] < bbox.min[k] - slack || bbox.max[k] + slack < p[k]) {
+            outside++;
+            break;
+          }
+        }
+      }
+      if (outside) {
+        if (boundsViolations < 10) {
+          logger(1, "Geometry %u of kind %u has %u of %u vertices outside its bounds",
+                 geo->id, unsigned(geo->kind), outside, t->vertices_n);
+        }
+        boundsViolations++;
+      }
+    }
+  }
 
   tessellated++;
+  return rv;
 }
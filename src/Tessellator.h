@@ -8,6 +8,10 @@ class TriangulationFactory
 {
 public:
   TriangulationFactory(Store* store, Logger logger, float tolerance, unsigned minSamples, unsigned maxSamples);
+  TriangulationFactory(const TriangulationFactory&) = delete;
+  TriangulationFactory& operator=(const TriangulationFactory&) = delete;
+
+  ~TriangulationFactory();
 
   unsigned sagittaBasedSegmentCount(float arc, float radius, float scale);
 
@@ -29,7 +33,29 @@ public:
 
   Triangulation* sphereBasedShape(Arena* arena, const  Geometry* geo, float radius, float arc, float shift_z, float scale_z, float scale);
 
+  // Dispatch on geometry kind, lines are not handled.
+  Triangulation* geometry(Arena* arena, const Geometry* geo, float scale);
+
+  // Number of triangles geometry would create, without tessellating. Exact
+  // for the parametric kinds, an estimate for facet groups. Zero for lines.
+  unsigned triangleCount(const Geometry* geo, float scale);
+
+  // Copy of src in arena with 16-bit indices when there are at most 65536
+  // vertices and octahedral normals. Positions become half floats when their
+  // rounding error stays below a quarter of the tolerance. The copy has no
+  // coarser level.
+  Triangulation* compact(Arena* arena, const Triangulation* src, float scale);
+
   unsigned discardedCaps = 0;
+  bool weldVertices = false;        // Merge facet group vertices with matching position and normal.
+  uint64_t weldInputVertices = 0;   // Facet group vertices before welding.
+  uint64_t weldOutputVertices = 0;  // Facet group vertices after welding.
+
+  bool simpleContours = true;       // Fan or ear clip single contours instead of passing them to libtess2.
+  unsigned fanPolygons = 0;         // Convex polygons triangulated as a fan.
+  unsigned earClippedPolygons = 0;  // Small simple polygons triangulated by ear clipping.
+  unsigned libtessCalls = 0;        // Polygons passed to libtess2.
+  uint64_t libtessNanoseconds = 0;  // Time spent in libtess2.
 
 private:
   Store* store;
@@ -50,6 +76,33 @@ private:
   std::vector<float> t1;
   std::vector<float> t2;
 
+  // Unrotated cos/sin tables keyed by sample count and step, shared by all
+  // primitives with the same sampling.
+  static constexpr size_t maxCircleTables = 4096;
+  Map circleTables;
+  Arena circleTablesArena;
+
+  // Fills dst with count interleaved cos/sin pairs of step*i + rotation.
+  void circleSamples(std::vector<float>& dst, unsigned count, float step, float rotation);
+
+  unsigned sphereBasedTriangleCount(float radius, float arc, float scale_z, float scale);
+
+  std::vector<float> contour2d;
+  std::vector<uint32_t> contourLinks;
+
+  std::vector<int64_t> weldKeys;
+  std::vector<uint32_t> weldRemap;
+
+  // Merges vertices that quantize to the same position and normal, and drops
+  // the triangles that collapse.
+  void weld(float scale);
+
+  // Appends the triangulation of a single contour to the vertex and index
+  // arrays without libtess2 if it is planar and either convex or small and
+  // simple. Returns false and appends nothing otherwise.
+  bool triangulateSimpleContour(const struct Contour& cont);
+
+  struct TessArena* tessArena = nullptr;  // Backs libtess2 allocations, reset after each polygon.
 };
 
 class Tessellator : public StoreVisitor
@@ -57,7 +110,7 @@ class Tessellator : public StoreVisitor
 public:
   Tessellator() = delete;
   Tessellator(const Tessellator&) = delete;
-  Tessellator(Logger logger, float tolerance, float cullLeafThreshold, float cullGeometryThreshold, unsigned maxSamples);
+  Tessellator(Logger logger, float tolerance, float cullLeafThreshold, float cullGeometryThreshold, unsigned maxSamples, unsigned lodLevels = 1, float lodScale = 4.f, bool weldVertices = false, bool compact = false);
 
   Tessellator& operator=(const Tessellator&) = delete;
 
@@ -73,6 +126,11 @@ public:
 
   void endModel() override;
 
+  // Tessellates geo with its coarser levels of detail into arena, without
+  // culling, and updates the counters. Used directly by exporters that
+  // tessellate on demand, after init has been called.
+  Triangulation* tessellate(Arena* arena, const Geometry* geo);
+
 
   unsigned leafCulled = 0;
   unsigned geometryCulled = 0;
@@ -82,6 +140,35 @@ public:
   uint64_t vertices = 0;
   uint64_t triangles = 0;
 
+  unsigned lodTessellated = 0;  // Number of coarser levels of detail created.
+  uint64_t lodVertices = 0;     // Vertices in coarser levels of detail.
+  uint64_t lodTriangles = 0;    // Triangles in coarser levels of detail.
+
+  uint64_t weldInputVertices = 0;   // Facet group vertices before and after welding,
+  uint64_t weldOutputVertices = 0;  // equal unless weldVertices is set.
+
+  unsigned fanPolygons = 0;         // Facet group polygons triangulated as a fan.
+  unsigned earClippedPolygons = 0;  // Facet group polygons triangulated by ear clipping.
+  unsigned libtessCalls = 0;        // Facet group polygons passed to libtess2.
+  uint64_t libtessNanoseconds = 0;  // Time spent in libtess2.
+
+  uint64_t triangulationBytes = 0;      // Vertex and index arrays as stored,
+  uint64_t plainTriangulationBytes = 0; // and as they would be without compaction.
+  unsigned halfVertexTriangulations = 0;  // Compacted triangulations with half float positions.
+
+  bool validateBounds = false;  // Check that triangulations stay inside the local bounds of their geometry,
+  unsigned boundsViolations = 0;  // and count the levels that do not.
+
+  uint64_t triangleBudget = 0;  // Target number of finest level triangles, zero for no budget. Set before init.
+  uint64_t budgetEstimate = 0;  // Finest level triangles planned for the budget.
+  float budgetSize = 0.f;       // Geometries with a smaller world diagonal get a proportionally larger tolerance.
+  unsigned budgetCoarsened = 0; // Number of geometries whose triangulation the budget made coarser.
+  float maxError = 0.f;         // Largest error of a finest level triangulation.
+
+  static constexpr unsigned budgetLevels = 12;  // Tolerances up to 2^(budgetLevels-1) times the base tolerance.
+
+  static constexpr unsigned maxLodLevels = 4;
+
 protected:
   struct CacheItem
   {
@@ -101,6 +188,12 @@ protected:
   float cullGeometryThresholdScaled = 0.f / 0.f;
   Arena arena;
   TriangulationFactory* factory = nullptr;
+  TriangulationFactory* lodFactories[maxLodLevels - 1] = { nullptr };  // Factory of level 1 and up, level 0 is factory.
+  unsigned lodLevels = 1;
+  float lodScale = 4.f;         // Tolerance multiplier between consecutive levels of detail.
+  bool weldVertices = false;
+  bool compact = false;         // Store compact triangulations, see TriangulationFactory::compact.
+  Arena scratch;                // Triangulations before compaction.
   Logger logger;
 
   Store * store = nullptr;
@@ -114,6 +207,11 @@ protected:
   StackItem* stack = nullptr;
   unsigned stack_p = 0;
 
+  Map budgetLevel;  // Geometry to the power of two its tolerance is multiplied by, absent means zero.
+
+  // Picks budgetSize such that the planned triangle count fits triangleBudget.
+  void planBudget();
+
   Triangulation* getTriangulation(Geometry* geo);
 
   virtual void process(Geometry* /*geometry*/) {}
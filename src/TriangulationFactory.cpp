@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cassert>
 #include <cstring>
@@ -10,6 +11,13 @@
 #include "Tessellator.h"
 #include "LinAlgOps.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RVMPARSER_TESSELLATE_SSE2 (1)
+#include <emmintrin.h>
+#else
+#define RVMPARSER_TESSELLATE_SSE2 (0)
+#endif
+
 namespace {
 
   const float pi = float(M_PI);
@@ -272,18 +280,485 @@ namespace {
 
   }
 
+  // Round to nearest even, values past the half range become infinity.
+  uint16_t floatToHalf(float f)
+  {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint16_t sign = uint16_t((x >> 16) & 0x8000u);
+    x &= 0x7FFFFFFFu;
+    if (0x47800000u <= x) {
+      return sign | 0x7C00u;
+    }
+    if (x < 0x38800000u) {  // Subnormal, steps of 2^-24
+      float a;
+      std::memcpy(&a, &x, sizeof(a));
+      return sign | uint16_t(std::lrint(a * 16777216.f));
+    }
+    x -= 0x38000000u;
+    x += 0xFFFu + ((x >> 13) & 1u);
+    return sign | uint16_t(x >> 13);
+  }
+
+  void octEncode(int16_t* e, float x, float y, float z)
+  {
+    float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+    if (!(0.f < l1) || !std::isfinite(l1)) {
+      x = 1.f; y = 0.f; z = 0.f;
+      l1 = 1.f;
+    }
+    float u = x / l1;
+    float v = y / l1;
+    if (z < 0.f) {
+      float t = u;
+      u = std::copysign(1.f - std::abs(v), u);
+      v = std::copysign(1.f - std::abs(t), v);
+    }
+    e[0] = int16_t(std::lrint(std::min(1.f, std::max(-1.f, u)) * 32767.f));
+    e[1] = int16_t(std::lrint(std::min(1.f, std::max(-1.f, v)) * 32767.f));
+  }
+
+  // Rotates interleaved cos/sin pairs by angle, one complex multiply per pair.
+  void rotateCircleSamples(float* dst, const float* src, unsigned count, float angle)
+  {
+    if (angle == 0.f) {
+      std::memcpy(dst, src, 2 * sizeof(float) * count);
+      return;
+    }
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    unsigned i = 0;
+#if RVMPARSER_TESSELLATE_SSE2
+    const __m128 cc = _mm_set1_ps(c);
+    const __m128 ss = _mm_setr_ps(-s, s, -s, s);
+    for (; i + 2 <= count; i += 2) {
+      const __m128 v = _mm_loadu_ps(src + 2 * i);
+      const __m128 w = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+      _mm_storeu_ps(dst + 2 * i, _mm_add_ps(_mm_mul_ps(v, cc), _mm_mul_ps(w, ss)));
+    }
+#endif
+    for (; i < count; i++) {
+      const float x = src[2 * i + 0];
+      const float y = src[2 * i + 1];
+      dst[2 * i + 0] = x * c - y * s;
+      dst[2 * i + 1] = y * c + x * s;
+    }
+  }
+
+  // Single contours up to this size are ear clipped, larger ones that are not
+  // convex go to libtess2.
+  const unsigned maxEarClipVertices = 32;
+
+  enum struct ContourShape
+  {
+    Other,    // Degenerate, non-planar, self-intersecting or too large.
+    Convex,
+    Simple
+  };
+
+  // Project the contour onto the coordinate plane most aligned with its Newell
+  // normal such that it winds counter-clockwise, and classify it.
+  ContourShape classifyContour(std::vector<float>& p, const Contour& cont)
+  {
+    const unsigned n = cont.vertices_n;
+    const float* V = cont.vertices;
+
+    // Relative to the first vertex to keep precision for large coordinates.
+    float N[3] = { 0.f, 0.f, 0.f };
+    BBox3f bbox = createEmptyBBox3f();
+    for (unsigned i = 0; i < n; i++) {
+      const float* a = V + 3 * i;
+      const float* b = V + 3 * ((i + 1) % n);
+      const float a0 = a[0] - V[0], a1 = a[1] - V[1], a2 = a[2] - V[2];
+      const float b0 = b[0] - V[0], b1 = b[1] - V[1], b2 = b[2] - V[2];
+      N[0] += (a1 - b1) * (a2 + b2);
+      N[1] += (a2 - b2) * (a0 + b0);
+      N[2] += (a0 - b0) * (a1 + b1);
+      engulf(bbox, makeVec3f(a0, a1, a2));
+    }
+    const float extent = maxSideLength(bbox);
+    const float area2 = std::sqrt(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+    if (!(1e-6f * extent * extent < area2)) return ContourShape::Other;
+
+    // Planar within a small fraction of the extent.
+    const float nx = N[0] / area2, ny = N[1] / area2, nz = N[2] / area2;
+    float dmin = 0.f, dmax = 0.f;
+    for (unsigned i = 1; i < n; i++) {
+      const float* a = V + 3 * i;
+      const float d = nx * (a[0] - V[0]) + ny * (a[1] - V[1]) + nz * (a[2] - V[2]);
+      dmin = std::min(dmin, d);
+      dmax = std::max(dmax, d);
+    }
+    if (1e-3f * extent < dmax - dmin) return ContourShape::Other;
+
+    // Dropping the dominant axis k and keeping the axes in cyclic order gives
+    // a counter-clockwise polygon when N[k] is positive, else mirror it.
+    unsigned k = 0;
+    if (std::abs(N[k]) < std::abs(N[1])) k = 1;
+    if (std::abs(N[k]) < std::abs(N[2])) k = 2;
+    const unsigned iu = (k + 1) % 3;
+    const unsigned iv = (k + 2) % 3;
+    const float sv = N[k] < 0.f ? -1.f : 1.f;
+    p.resize(2 * n);
+    for (unsigned i = 0; i < n; i++) {
+      p[2 * i + 0] = V[3 * i + iu] - V[iu];
+      p[2 * i + 1] = sv * (V[3 * i + iv] - V[iv]);
+    }
+
+    // Strictly convex if every corner turns left and the edge directions
+    // sweep around once, which rules out star shapes.
+    bool convex = true;
+    unsigned flipsU = 0, flipsV = 0;
+    float prevDu = 0.f, prevDv = 0.f;
+    for (unsigned i = 0; i < n && convex; i++) {
+      const float* a = p.data() + 2 * ((i + n - 1) % n);
+      const float* b = p.data() + 2 * i;
+      const float* c = p.data() + 2 * ((i + 1) % n);
+      const float e0u = b[0] - a[0], e0v = b[1] - a[1];
+      const float e1u = c[0] - b[0], e1v = c[1] - b[1];
+      const float cross = e0u * e1v - e0v * e1u;
+      const float lengths = std::sqrt((e0u * e0u + e0v * e0v) * (e1u * e1u + e1v * e1v));
+      if (!(1e-5f * lengths < cross)) convex = false;
+
+      if (e1u != 0.f) {
+        if (prevDu != 0.f && (prevDu < 0.f) != (e1u < 0.f)) flipsU++;
+        prevDu = e1u;
+      }
+      if (e1v != 0.f) {
+        if (prevDv != 0.f && (prevDv < 0.f) != (e1v < 0.f)) flipsV++;
+        prevDv = e1v;
+      }
+    }
+    if (convex && flipsU <= 2 && flipsV <= 2) return ContourShape::Convex;
+    if (maxEarClipVertices < n) return ContourShape::Other;
+
+    // Ear clipping needs a simple polygon, require that edges only meet their
+    // neighbours at the shared vertex.
+    for (unsigned i = 0; i < n; i++) {
+      const float* a = p.data() + 2 * i;
+      const float* b = p.data() + 2 * ((i + 1) % n);
+      if (a[0] == b[0] && a[1] == b[1]) return ContourShape::Other;
+      for (unsigned j = i + 2; j < n; j++) {
+        if (i == 0 && j + 1 == n) continue;
+        const float* c = p.data() + 2 * j;
+        const float* d = p.data() + 2 * ((j + 1) % n);
+        const float abc = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+        const float abd = (b[0] - a[0]) * (d[1] - a[1]) - (b[1] - a[1]) * (d[0] - a[0]);
+        const float cda = (d[0] - c[0]) * (a[1] - c[1]) - (d[1] - c[1]) * (a[0] - c[0]);
+        const float cdb = (d[0] - c[0]) * (b[1] - c[1]) - (d[1] - c[1]) * (b[0] - c[0]);
+        if ((abc <= 0.f || abd <= 0.f) && (abc >= 0.f || abd >= 0.f) &&
+            (cda <= 0.f || cdb <= 0.f) && (cda >= 0.f || cdb >= 0.f))
+        {
+          return ContourShape::Other;
+        }
+      }
+    }
+    return ContourShape::Simple;
+  }
+
+  inline float orient2(const float* a, const float* b, const float* c)
+  {
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+  }
+
+  // Ear clipping of a simple counter-clockwise polygon. Ears that are nearly
+  // flat are only clipped when there is nothing else left, which keeps
+  // collinear vertices from ending up as slivers with rounding-noise winding.
+  // Returns false without emitting anything if it runs out of ears.
+  bool earClip(std::vector<uint32_t>& indices, std::vector<uint32_t>& next, const std::vector<float>& p, unsigned n, uint32_t vo)
+  {
+    const size_t indices_n = indices.size();
+    next.resize(2 * n);
+    uint32_t* nxt = next.data();
+    uint32_t* prv = next.data() + n;
+    float umin = p[0], umax = p[0], vmin = p[1], vmax = p[1];
+    for (unsigned i = 0; i < n; i++) {
+      nxt[i] = (i + 1) % n;
+      prv[i] = (i + n - 1) % n;
+      umin = std::min(umin, p[2 * i + 0]);
+      umax = std::max(umax, p[2 * i + 0]);
+      vmin = std::min(vmin, p[2 * i + 1]);
+      vmax = std::max(vmax, p[2 * i + 1]);
+    }
+    const float extent = std::max(umax - umin, vmax - vmin);
+    float minArea = 1e-6f * extent * extent;
+
+    unsigned i = 0;
+    unsigned remaining = n;
+    unsigned tries = 0;
+    while (3 < remaining) {
+      const unsigned a = prv[i];
+      const unsigned c = nxt[i];
+      const float* pa = p.data() + 2 * a;
+      const float* pb = p.data() + 2 * i;
+      const float* pc = p.data() + 2 * c;
+
+      bool ear = minArea < orient2(pa, pb, pc);
+      for (unsigned j = nxt[c]; ear && j != a; j = nxt[j]) {
+        const float* q = p.data() + 2 * j;
+        if (0.f <= orient2(pa, pb, q) && 0.f <= orient2(pb, pc, q) && 0.f <= orient2(pc, pa, q)) {
+          ear = false;
+        }
+      }
+
+      if (ear) {
+        indices.push_back(vo + a);
+        indices.push_back(vo + i);
+        indices.push_back(vo + c);
+        nxt[a] = c;
+        prv[c] = a;
+        remaining--;
+        tries = 0;
+        i = c;
+      }
+      else if (remaining < ++tries) {
+        if (minArea == 0.f) {
+          indices.resize(indices_n);
+          return false;
+        }
+        minArea = 0.f;
+        tries = 0;
+      }
+      else {
+        i = c;
+      }
+    }
+    indices.push_back(vo + prv[i]);
+    indices.push_back(vo + i);
+    indices.push_back(vo + nxt[i]);
+    return true;
+  }
+
 }
 
 
+// Bump allocator handed to libtess2. Nothing is freed individually, instead
+// the arena is reset when a polygon is done, keeping its memory for the next
+// one. If a polygon spilled into more than one block, the blocks are merged
+// on reset so that the arena settles on a single block.
+struct TessArena
+{
+  struct Block
+  {
+    uint8_t* ptr;
+    size_t size;
+  };
+
+  static constexpr size_t header = 16;  // Allocation size, keeps 16 byte alignment.
+  static constexpr size_t minBlockSize = 256 * 1024;
+
+  TESSalloc alloc;
+  std::vector<Block> blocks;
+  size_t block = 0;
+  size_t fill = 0;
+
+  TessArena()
+  {
+    alloc.memalloc = memalloc;
+    alloc.memrealloc = memrealloc;
+    alloc.memfree = memfree;
+    alloc.userData = this;
+
+    // Facet group polygons are mostly small, and every bucket is threaded
+    // onto a free list when created, so keep buckets a lot smaller than the
+    // libtess2 defaults.
+    alloc.meshEdgeBucketSize = 64;
+    alloc.meshVertexBucketSize = 64;
+    alloc.meshFaceBucketSize = 32;
+    alloc.dictNodeBucketSize = 64;
+    alloc.regionBucketSize = 32;
+    alloc.extraVertices = 0;
+  }
+
+  ~TessArena()
+  {
+    for (auto& b : blocks) free(b.ptr);
+  }
+
+  void* allocate(size_t size)
+  {
+    size_t bytes = (header + size + 15) & ~size_t(15);
+    while (block < blocks.size() && blocks[block].size < fill + bytes) {
+      block++;
+      fill = 0;
+    }
+    if (block == blocks.size()) {
+      size_t blockSize = std::max(minBlockSize, bytes);
+      blocks.push_back(Block{ (uint8_t*)xmalloc(blockSize), blockSize });
+    }
+    uint8_t* ptr = blocks[block].ptr + fill;
+    fill += bytes;
+    *(size_t*)ptr = size;
+    return ptr + header;
+  }
+
+  void reset()
+  {
+    if (block != 0) {
+      size_t total = 0;
+      for (auto& b : blocks) {
+        total += b.size;
+        free(b.ptr);
+      }
+      blocks.clear();
+      blocks.push_back(Block{ (uint8_t*)xmalloc(total), total });
+    }
+    block = 0;
+    fill = 0;
+  }
+
+  static void* memalloc(void* userData, unsigned size)
+  {
+    return ((TessArena*)userData)->allocate(size);
+  }
+
+  static void* memrealloc(void* userData, void* ptr, unsigned size)
+  {
+    void* rv = ((TessArena*)userData)->allocate(size);
+    if (ptr) {
+      size_t oldSize = *(size_t*)((uint8_t*)ptr - header);
+      std::memcpy(rv, ptr, std::min(oldSize, size_t(size)));
+    }
+    return rv;
+  }
+
+  static void memfree(void* /*userData*/, void* /*ptr*/) {}
+};
+
+
 TriangulationFactory::TriangulationFactory(Store* store, Logger logger, float tolerance, unsigned minSamples, unsigned maxSamples) :
   store(store),
   logger(logger),
   tolerance(tolerance),
   minSamples(minSamples),
-  maxSamples(std::max(minSamples, maxSamples))
+  maxSamples(std::max(minSamples, maxSamples)),
+  tessArena(new TessArena())
 {
 }
 
+TriangulationFactory::~TriangulationFactory()
+{
+  delete tessArena;
+}
+
+void TriangulationFactory::circleSamples(std::vector<float>& dst, unsigned count, float step, float rotation)
+{
+  dst.resize(2 * count);
+
+  uint32_t stepBits;
+  std::memcpy(&stepBits, &step, sizeof(stepBits));
+  const uint64_t key = (uint64_t(count) << 32) | stepBits;
+
+  const float* table = nullptr;
+  if (uint64_t val; circleTables.get(val, key)) {
+    table = (const float*)val;
+  }
+  else if (circleTables.fill < maxCircleTables) {
+    auto* t = (float*)circleTablesArena.alloc(2 * sizeof(float) * count);
+    for (unsigned i = 0; i < count; i++) {
+      t[2 * i + 0] = std::cos(step * i);
+      t[2 * i + 1] = std::sin(step * i);
+    }
+    circleTables.insert(key, uint64_t(t));
+    table = t;
+  }
+  else {
+    for (unsigned i = 0; i < count; i++) {
+      dst[2 * i + 0] = std::cos(step * i + rotation);
+      dst[2 * i + 1] = std::sin(step * i + rotation);
+    }
+    return;
+  }
+  rotateCircleSamples(dst.data(), table, count, rotation);
+}
+
+void TriangulationFactory::weld(float scale)
+{
+  // Positions snap to a grid of a hundredth of the tolerance in the local
+  // frame, small enough to not be visible at that tolerance.
+  const float cell = 0.01f * tolerance / scale;
+  if (!(0.f < cell)) return;
+  const float positionScale = 1.f / cell;
+  const float normalScale = 1024.f;
+
+  const auto vertices_n = uint32_t(vertices.size() / 3);
+  weldKeys.clear();
+  weldRemap.resize(vertices_n);
+
+  Map map;
+  uint32_t o = 0;
+  for (uint32_t i = 0; i < vertices_n; i++) {
+    int64_t key[6];
+    for (unsigned k = 0; k < 3; k++) {
+      key[k] = std::llround(positionScale * vertices[3 * i + k]);
+      key[3 + k] = std::llround(normalScale * normals[3 * i + k]);
+    }
+    uint64_t hash = fnv_1a((const char*)key, sizeof(key));
+    if (hash == 0) hash = 1;
+
+    // On a hash collision with a different key the vertex is just kept.
+    uint64_t j;
+    bool found = map.get(j, hash);
+    if (found && std::memcmp(weldKeys.data() + 6 * j, key, sizeof(key)) == 0) {
+      weldRemap[i] = uint32_t(j);
+      continue;
+    }
+    if (!found) {
+      map.insert(hash, o);
+    }
+    weldKeys.insert(weldKeys.end(), key, key + 6);
+    for (unsigned k = 0; k < 3; k++) {
+      vertices[3 * o + k] = vertices[3 * i + k];
+      normals[3 * o + k] = normals[3 * i + k];
+    }
+    weldRemap[i] = o++;
+  }
+  vertices.resize(3 * o);
+  normals.resize(3 * o);
+
+  size_t l = 0;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    uint32_t a = weldRemap[indices[t + 0]];
+    uint32_t b = weldRemap[indices[t + 1]];
+    uint32_t c = weldRemap[indices[t + 2]];
+    if (a != b && b != c && c != a) {
+      indices[l++] = a;
+      indices[l++] = b;
+      indices[l++] = c;
+    }
+  }
+  indices.resize(l);
+}
+
+bool TriangulationFactory::triangulateSimpleContour(const Contour& cont)
+{
+  const unsigned n = cont.vertices_n;
+  auto vo = uint32_t(vertices.size()) / 3;
+
+  switch (classifyContour(contour2d, cont)) {
+  case ContourShape::Convex:
+    for (unsigned i = 1; i + 1 < n; i++) {
+      indices.push_back(vo);
+      indices.push_back(vo + i);
+      indices.push_back(vo + i + 1);
+    }
+    fanPolygons++;
+    break;
+  case ContourShape::Simple:
+    if (!earClip(indices, contourLinks, contour2d, n, vo)) return false;
+    earClippedPolygons++;
+    break;
+  default:
+    return false;
+  }
+
+  vertices.resize(vertices.size() + 3 * n);
+  normals.resize(vertices.size());
+  std::memcpy(vertices.data() + 3 * vo, cont.vertices, 3 * n * sizeof(float));
+  std::memcpy(normals.data() + 3 * vo, cont.normals, 3 * n * sizeof(float));
+  return true;
+}
+
 
 unsigned TriangulationFactory::sagittaBasedSegmentCount(float arc, float radius, float scale)
 {
@@ -539,11 +1014,7 @@ Triangulation* TriangulationFactory::rectangularTorus(Arena* arena, const Geomet
   };
 
   // Not closed
-  t0.resize(2 * samples + 1);
-  for (unsigned i = 0; i < samples; i++) {
-    t0[2 * i + 0] = std::cos((tor.angle / segments)*i);
-    t0[2 * i + 1] = std::sin((tor.angle / segments)*i);
-  }
+  circleSamples(t0, samples, tor.angle / segments, 0.f);
 
   unsigned l = 0;
 
@@ -667,17 +1138,8 @@ Triangulation* TriangulationFactory::circularTorus(Arena* arena, const Geometry*
     }
   }
 
-  t0.resize(2 * samples_l);
-  for (unsigned i = 0; i < samples_l; i++) {
-    t0[2 * i + 0] = std::cos((ct.angle / (samples_l - 1.f))*i);
-    t0[2 * i + 1] = std::sin((ct.angle / (samples_l - 1.f))*i);
-  }
-
-  t1.resize(2 * samples_s);
-  for (unsigned i = 0; i < samples_s; i++) {
-    t1[2 * i + 0] = std::cos((twopi / samples_s)*i + geo->sampleStartAngle);
-    t1[2 * i + 1] = std::sin((twopi / samples_s)*i + geo->sampleStartAngle);
-  }
+  circleSamples(t0, samples_l, ct.angle / (samples_l - 1.f), 0.f);
+  circleSamples(t1, samples_s, twopi / samples_s, geo->sampleStartAngle);
 
 
   tri->vertices_n = ((shell ? samples_l : 0) + (cap[0] ? 1 : 0) + (cap[1] ? 1 : 0)) * samples_s;
@@ -800,11 +1262,7 @@ Triangulation* TriangulationFactory::snout(Arena* arena, const Geometry* geo, fl
     }
   }
 
-  t0.resize(2 * samples);
-  for (unsigned i = 0; i < samples; i++) {
-    t0[2 * i + 0] = std::cos((twopi / samples)*i + geo->sampleStartAngle);
-    t0[2 * i + 1] = std::sin((twopi / samples)*i + geo->sampleStartAngle);
-  }
+  circleSamples(t0, samples, twopi / samples, geo->sampleStartAngle);
   t1.resize(2 * samples);
   for (unsigned i = 0; i < 2 * samples; i++) {
     t1[i] = sn.radius_b * t0[i];
@@ -939,11 +1397,7 @@ Triangulation* TriangulationFactory::cylinder(Arena* arena, const Geometry* geo,
   tri->triangles_n = (shell ? 2 * samples : 0) + (cap[0] ? samples - 2 : 0) + (cap[1] ? samples - 2 : 0);
   tri->indices = (uint32_t*)arena->alloc(3 * sizeof(uint32_t)*tri->triangles_n);
 
-  t0.resize(2 * samples);
-  for (unsigned i = 0; i < samples; i++) {
-    t0[2 * i + 0] = std::cos((twopi / samples)*i + geo->sampleStartAngle);
-    t0[2 * i + 1] = std::sin((twopi / samples)*i + geo->sampleStartAngle);
-  }
+  circleSamples(t0, samples, twopi / samples, geo->sampleStartAngle);
   t1.resize(2 * samples);
   for (unsigned i = 0; i < 2 * samples; i++) {
     t1[i] = cy.radius * t0[i];
@@ -1027,12 +1481,8 @@ Triangulation* TriangulationFactory::sphereBasedShape(Arena* arena, const Geomet
   unsigned rings = unsigned(std::max(float(min_rings), scale_z * samples*arc*(1.f / twopi)));
 
   u0.resize(rings);
-  t0.resize(2 * rings);
-  auto theta_scale = arc / (rings - 1);
+  circleSamples(t0, rings, arc / (rings - 1), 0.f);
   for (unsigned r = 0; r < rings; r++) {
-    float theta = theta_scale * r;
-    t0[2 * r + 0] = std::cos(theta);
-    t0[2 * r + 1] = std::sin(theta);
     u0[r] = unsigned(std::max(3.f, t0[2 * r + 1] * samples));  // samples in this ring
   }
   u0[0] = 1;
@@ -1057,11 +1507,10 @@ Triangulation* TriangulationFactory::sphereBasedShape(Arena* arena, const Geomet
     auto w = t0[2 * r + 1];
     auto n = u0[r];
 
-    auto phi_scale = twopi / n;
+    circleSamples(t1, n, twopi / n, geo->sampleStartAngle);
     for (unsigned i = 0; i < n; i++) {
-      auto phi = phi_scale * i + geo->sampleStartAngle;
-      auto nx = w * std::cos(phi);
-      auto ny = w * std::sin(phi);
+      auto nx = w * t1[2 * i + 0];
+      auto ny = w * t1[2 * i + 1];
       l = vertex(tri->normals, tri->vertices, l, nx, ny, nz / scale_z, radius*nx, radius*ny, z);
     }
   }
@@ -1127,7 +1576,7 @@ Triangulation* TriangulationFactory::sphereBasedShape(Arena* arena, const Geomet
 }
 
 
-Triangulation* TriangulationFactory::facetGroup(Arena* arena, const Geometry* geo, float /*scale*/)
+Triangulation* TriangulationFactory::facetGroup(Arena* arena, const Geometry* geo, float scale)
 {
   auto & fg = geo->facetGroup;
 
@@ -1206,85 +1655,94 @@ Triangulation* TriangulationFactory::facetGroup(Arena* arena, const Geometry* ge
         indices.push_back(vo + 3);
       }
     }
-    else  {
-
-      bool anyData = false;
-
-      BBox3f bbox = createEmptyBBox3f();
-      for (unsigned c = 0; c < poly.contours_n; c++) {
-        for (unsigned i = 0; i < poly.contours[c].vertices_n; i++) {
-          const Vec3f pos = makeVec3f(poly.contours[c].vertices + 3 * i);
-          engulf(bbox, pos);
-        }
-      }
-      auto m = 0.5f*(Vec3f(bbox.min) + Vec3f(bbox.max));
-
-      auto tess = tessNewTess(nullptr);
-      for (unsigned c = 0; c < poly.contours_n; c++) {
-        auto & cont = poly.contours[c];
-        if (cont.vertices_n < 3) {
-          logger(1, "Ignoring degenerate contour with %d vertices.", cont.vertices_n);
-          continue;
+    else {
+      // Fan or ear clip single contours, libtess2 is only needed for the rest.
+      bool triangulated = simpleContours && poly.contours_n == 1 && triangulateSimpleContour(poly.contours[0]);
+      if (!triangulated) {
+        bool anyData = false;
+
+        BBox3f bbox = createEmptyBBox3f();
+        for (unsigned c = 0; c < poly.contours_n; c++) {
+          for (unsigned i = 0; i < poly.contours[c].vertices_n; i++) {
+            const Vec3f pos = makeVec3f(poly.contours[c].vertices + 3 * i);
+            engulf(bbox, pos);
+          }
         }
-        vec3.resize(cont.vertices_n);
-        for (unsigned i = 0; i < cont.vertices_n; i++) {
-          vec3[i] = makeVec3f(cont.vertices + 3 * i) - m;
+        auto m = 0.5f*(Vec3f(bbox.min) + Vec3f(bbox.max));
+
+        // The tessellator lives in the arena, so it is recreated from recycled
+        // memory for each polygon and dropped along with everything else
+        // libtess2 allocated when the arena is reset.
+        auto libtessTime0 = std::chrono::high_resolution_clock::now();
+        libtessCalls++;
+        auto tess = tessNewTess(&tessArena->alloc);
+        for (unsigned c = 0; c < poly.contours_n; c++) {
+          auto & cont = poly.contours[c];
+          if (cont.vertices_n < 3) {
+            logger(1, "Ignoring degenerate contour with %d vertices.", cont.vertices_n);
+            continue;
+          }
+          vec3.resize(cont.vertices_n);
+          for (unsigned i = 0; i < cont.vertices_n; i++) {
+            vec3[i] = makeVec3f(cont.vertices + 3 * i) - m;
+          }
+          tessAddContour(tess, 3, vec3.data(), 3 * sizeof(float), cont.vertices_n);
+          //tessAddContour(tess, 3, cont.vertices, 3 * sizeof(float), cont.vertices_n);
+          anyData = true;
         }
-        tessAddContour(tess, 3, vec3.data(), 3 * sizeof(float), cont.vertices_n);
-        //tessAddContour(tess, 3, cont.vertices, 3 * sizeof(float), cont.vertices_n);
-        anyData = true;
-      }
 
-      if (anyData == false) {
-        logger(1, "Ignoring polygon with no valid contours.");
-      }
-      else {
-        if (tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 3, nullptr)) {
-          auto vo = uint32_t(vertices.size()) / 3;
-          auto vn = unsigned(tessGetVertexCount(tess));
+        if (anyData == false) {
+          logger(1, "Ignoring polygon with no valid contours.");
+        }
+        else {
+          if (tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 3, nullptr)) {
+            auto vo = uint32_t(vertices.size()) / 3;
+            auto vn = unsigned(tessGetVertexCount(tess));
 
-          vertices.resize(vertices.size() + 3 * vn);
+            vertices.resize(vertices.size() + 3 * vn);
 
-          auto * src = tessGetVertices(tess);
-          for (unsigned i = 0; i < vn; i++) {
-            const Vec3f pos = makeVec3f((float*)(src + 3 * i)) + m;
-            write(vertices.data() + 3 * (vo + i), pos);
-          }
+            auto * src = tessGetVertices(tess);
+            for (unsigned i = 0; i < vn; i++) {
+              const Vec3f pos = makeVec3f((float*)(src + 3 * i)) + m;
+              write(vertices.data() + 3 * (vo + i), pos);
+            }
 
-          //std::memcpy(vertices.data() + 3 * vo, tessGetVertices(tess), 3 * vn * sizeof(float));
-
-          auto * remap = tessGetVertexIndices(tess);
-          normals.resize(vertices.size());
-          for (unsigned i = 0; i < vn; i++) {
-            if (remap[i] != TESS_UNDEF) {
-              unsigned ix = remap[i];
-              for (unsigned c = 0; c < poly.contours_n; c++) {
-                auto & cont = poly.contours[c];
-                if (ix < cont.vertices_n) {
-                  normals[3 * (vo + i) + 0] = cont.normals[3 * ix + 0];
-                  normals[3 * (vo + i) + 1] = cont.normals[3 * ix + 1];
-                  normals[3 * (vo + i) + 2] = cont.normals[3 * ix + 2];
-                  break;
+            //std::memcpy(vertices.data() + 3 * vo, tessGetVertices(tess), 3 * vn * sizeof(float));
+
+            auto * remap = tessGetVertexIndices(tess);
+            normals.resize(vertices.size());
+            for (unsigned i = 0; i < vn; i++) {
+              if (remap[i] != TESS_UNDEF) {
+                unsigned ix = remap[i];
+                for (unsigned c = 0; c < poly.contours_n; c++) {
+                  auto & cont = poly.contours[c];
+                  if (ix < cont.vertices_n) {
+                    normals[3 * (vo + i) + 0] = cont.normals[3 * ix + 0];
+                    normals[3 * (vo + i) + 1] = cont.normals[3 * ix + 1];
+                    normals[3 * (vo + i) + 2] = cont.normals[3 * ix + 2];
+                    break;
+                  }
+                  ix -= cont.vertices_n;
                 }
-                ix -= cont.vertices_n;
               }
             }
-          }
 
-          auto * elements = tessGetElements(tess);
-          auto elements_n = unsigned(tessGetElementCount(tess));
-          for (unsigned e = 0; e < elements_n; e++) {
-            auto ix = elements + 3 * e;
-            if ((ix[0] != TESS_UNDEF) && (ix[1] != TESS_UNDEF) && (ix[2] != TESS_UNDEF)) {
-              indices.push_back(ix[0] + vo);
-              indices.push_back(ix[1] + vo);
-              indices.push_back(ix[2] + vo);
+            auto * elements = tessGetElements(tess);
+            auto elements_n = unsigned(tessGetElementCount(tess));
+            for (unsigned e = 0; e < elements_n; e++) {
+              auto ix = elements + 3 * e;
+              if ((ix[0] != TESS_UNDEF) && (ix[1] != TESS_UNDEF) && (ix[2] != TESS_UNDEF)) {
+                indices.push_back(ix[0] + vo);
+                indices.push_back(ix[1] + vo);
+                indices.push_back(ix[2] + vo);
+              }
             }
           }
         }
-      }
 
-      tessDeleteTess(tess);
+        tessArena->reset();
+        libtessNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - libtessTime0).count();
+      }
     }
 
   skip_polygon:
@@ -1293,6 +1751,12 @@ Triangulation* TriangulationFactory::facetGroup(Arena* arena, const Geometry* ge
 
   assert(vertices.size() == normals.size());
 
+  weldInputVertices += vertices.size() / 3;
+  if (weldVertices && !indices.empty()) {
+    weld(scale);
+  }
+  weldOutputVertices += vertices.size() / 3;
+
   Triangulation* tri = arena->alloc<Triangulation>();
   tri->error = 0.f;
 
@@ -1308,3 +1772,259 @@ Triangulation* TriangulationFactory::facetGroup(Arena* arena, const Geometry* ge
   return tri;
 }
 
+Triangulation* TriangulationFactory::geometry(Arena* arena, const Geometry* geo, float scale)
+{
+  Triangulation* tri = nullptr;
+  switch (geo->kind) {
+  case Geometry::Kind::Pyramid:
+    tri = pyramid(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::Box:
+    tri = box(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::RectangularTorus:
+    tri = rectangularTorus(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::CircularTorus:
+    tri = circularTorus(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::EllipticalDish:
+    tri = sphereBasedShape(arena, geo, geo->ellipticalDish.baseRadius, half_pi, 0.f, geo->ellipticalDish.height / geo->ellipticalDish.baseRadius, scale);
+    break;
+
+  case Geometry::Kind::SphericalDish: {
+    float r_circ = geo->sphericalDish.baseRadius;
+    auto h = geo->sphericalDish.height;
+    float r_sphere = (r_circ*r_circ + h * h) / (2.f*h);
+    float sinval = std::min(1.f, std::max(-1.f, r_circ / r_sphere));
+    float arc = asin(sinval);
+    if (r_circ < h) { arc = pi - arc; }
+    tri = sphereBasedShape(arena, geo, r_sphere, arc, h - r_sphere, 1.f, scale);
+    break;
+  }
+  case Geometry::Kind::Snout:
+    tri = snout(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::Cylinder:
+    tri = cylinder(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::Sphere:
+    tri = sphereBasedShape(arena, geo, 0.5f*geo->sphere.diameter, pi, 0.f, 1.f, scale);
+    break;
+
+  case Geometry::Kind::FacetGroup:
+    tri = facetGroup(arena, geo, scale);
+    break;
+
+  case Geometry::Kind::Line:  // Handled by caller.
+  default:
+    assert(false && "Unhandled primitive type");
+    break;
+  }
+  return tri;
+}
+
+namespace {
+
+  // Number of caps in [first, first+n) that survive the connection test of
+  // the factory functions.
+  unsigned keptCaps(const Geometry* geo, const bool* candidates, unsigned first, unsigned n, Connection::Flags flags)
+  {
+    unsigned caps = 0;
+    for (unsigned i = first; i < first + n; i++) {
+      if (!candidates[i]) continue;
+      auto * con = geo->connections[i];
+      if (con && con->flags == flags && doInterfacesMatch(geo, con)) continue;
+      caps++;
+    }
+    return caps;
+  }
+
+}
+
+unsigned TriangulationFactory::triangleCount(const Geometry* geo, float scale)
+{
+  const bool all[6] = { true, true, true, true, true, true };
+  switch (geo->kind) {
+  case Geometry::Kind::Pyramid: {
+    bool cap[6] = {
+      true, true, true, true,
+      1e-7f <= std::min(std::abs(geo->pyramid.bottom[0]), std::abs(geo->pyramid.bottom[1])),
+      1e-7f <= std::min(std::abs(geo->pyramid.top[0]), std::abs(geo->pyramid.top[1]))
+    };
+    return 2 * keptCaps(geo, cap, 0, 6, Connection::Flags::HasRectangularSide);
+  }
+
+  case Geometry::Kind::Box: {
+    auto & box = geo->box;
+    bool faces[6] = {
+      1e-5 <= box.lengths[0], 1e-5 <= box.lengths[0],
+      1e-5 <= box.lengths[1], 1e-5 <= box.lengths[1],
+      1e-5 <= box.lengths[2], 1e-5 <= box.lengths[2],
+    };
+    return 2 * keptCaps(geo, faces, 0, 6, Connection::Flags::HasRectangularSide);
+  }
+
+  case Geometry::Kind::RectangularTorus: {
+    auto & tor = geo->rectangularTorus;
+    auto samples = sagittaBasedSegmentCount(tor.angle, tor.outer_radius, scale) + 1;
+    return 4 * 2 * (samples - 1) + 2 * keptCaps(geo, all, 0, 2, Connection::Flags::HasRectangularSide);
+  }
+
+  case Geometry::Kind::CircularTorus: {
+    auto & ct = geo->circularTorus;
+    auto samples_l = sagittaBasedSegmentCount(ct.angle, ct.offset + ct.radius, scale) + 1;
+    auto samples_s = sagittaBasedSegmentCount(twopi, ct.radius, scale);
+    return 2 * (samples_l - 1) * samples_s + (samples_s - 2) * keptCaps(geo, all, 0, 2, Connection::Flags::HasCircularSide);
+  }
+
+  case Geometry::Kind::EllipticalDish:
+    return sphereBasedTriangleCount(geo->ellipticalDish.baseRadius, half_pi, geo->ellipticalDish.height / geo->ellipticalDish.baseRadius, scale);
+
+  case Geometry::Kind::SphericalDish: {
+    float r_circ = geo->sphericalDish.baseRadius;
+    auto h = geo->sphericalDish.height;
+    float r_sphere = (r_circ*r_circ + h * h) / (2.f*h);
+    float sinval = std::min(1.f, std::max(-1.f, r_circ / r_sphere));
+    float arc = asin(sinval);
+    if (r_circ < h) { arc = pi - arc; }
+    return sphereBasedTriangleCount(r_sphere, arc, 1.f, scale);
+  }
+
+  case Geometry::Kind::Snout: {
+    auto samples = sagittaBasedSegmentCount(twopi, std::max(geo->snout.radius_b, geo->snout.radius_t), scale);
+    return 2 * samples + (samples - 2) * keptCaps(geo, all, 0, 2, Connection::Flags::HasCircularSide);
+  }
+
+  case Geometry::Kind::Cylinder: {
+    auto samples = sagittaBasedSegmentCount(twopi, geo->cylinder.radius, scale);
+    return 2 * samples + (samples - 2) * keptCaps(geo, all, 0, 2, Connection::Flags::HasCircularSide);
+  }
+
+  case Geometry::Kind::Sphere:
+    return sphereBasedTriangleCount(0.5f*geo->sphere.diameter, pi, 1.f, scale);
+
+  case Geometry::Kind::FacetGroup: {
+    // A polygon with holes becomes vertices + 2*contours - 4 triangles.
+    unsigned count = 0;
+    for (unsigned p = 0; p < geo->facetGroup.polygons_n; p++) {
+      auto & poly = geo->facetGroup.polygons[p];
+      unsigned n = 2 * poly.contours_n;
+      for (unsigned k = 0; k < poly.contours_n; k++) {
+        n += poly.contours[k].vertices_n;
+      }
+      count += 4 < n ? n - 4 : 0;
+    }
+    return count;
+  }
+
+  case Geometry::Kind::Line:
+  default:
+    return 0;
+  }
+}
+
+unsigned TriangulationFactory::sphereBasedTriangleCount(float radius, float arc, float scale_z, float scale)
+{
+  if (!std::isfinite(scale_z)) {
+    scale_z = 0;
+  }
+
+  unsigned samples = sagittaBasedSegmentCount(twopi, radius, scale);
+
+  bool is_sphere = false;
+  if (pi - 1e-3 <= arc) {
+    arc = pi;
+    is_sphere = true;
+  }
+
+  // Same rings as sphereBasedShape. Between two rings of n_c and n_n samples
+  // every sample of the larger ring starts a triangle, and so does every
+  // sample of the smaller one unless it is a pole.
+  unsigned min_rings = 3;
+  unsigned rings = unsigned(std::max(float(min_rings), scale_z * samples*arc*(1.f / twopi)));
+  circleSamples(t0, rings, arc / (rings - 1), 0.f);
+
+  unsigned count = 0;
+  unsigned n_c = 1;
+  for (unsigned r = 1; r < rings; r++) {
+    unsigned n_n = (is_sphere && r + 1 == rings) ? 1 : unsigned(std::max(3.f, t0[2 * r + 1] * samples));
+    unsigned lo = std::min(n_c, n_n);
+    count += std::max(n_c, n_n) + (1 < lo ? lo : 0);
+    n_c = n_n;
+  }
+  return count;
+}
+
+Triangulation* TriangulationFactory::compact(Arena* arena, const Triangulation* src, float scale)
+{
+  auto * dst = arena->alloc<Triangulation>();
+  dst->vertices_n = src->vertices_n;
+  dst->triangles_n = src->triangles_n;
+  dst->id = src->id;
+  dst->error = src->error;
+
+  const size_t n = src->vertices_n;
+  if (src->hasVertices()) {
+    float maxAbs = 0.f;
+    for (size_t i = 0; i < n; i++) {
+      Vec3f p = src->vertex(i);
+      maxAbs = std::max(maxAbs, std::max(std::abs(p.x), std::max(std::abs(p.y), std::abs(p.z))));
+    }
+    // Half floats have 11 significant bits, keep their rounding error well
+    // inside the tessellation tolerance.
+    if (maxAbs < 65504.f && scale * 1.7320508f * maxAbs * (1.f / 2048.f) <= 0.25f * tolerance) {
+      dst->halfVertices = (uint16_t*)arena->alloc(3 * sizeof(uint16_t) * n);
+      for (size_t i = 0; i < n; i++) {
+        Vec3f p = src->vertex(i);
+        for (unsigned k = 0; k < 3; k++) {
+          dst->halfVertices[3 * i + k] = floatToHalf(p[k]);
+        }
+      }
+    }
+    else if (src->vertices) {
+      dst->vertices = (float*)arena->dup(src->vertices, 3 * sizeof(float) * n);
+    }
+    else {
+      dst->vertices = (float*)arena->alloc(3 * sizeof(float) * n);
+      for (size_t i = 0; i < n; i++) {
+        write(dst->vertices + 3 * i, src->vertex(i));
+      }
+    }
+  }
+
+  if (src->hasNormals()) {
+    dst->octNormals = (int16_t*)arena->alloc(2 * sizeof(int16_t) * n);
+    for (size_t i = 0; i < n; i++) {
+      Vec3f m = src->normal(i);
+      octEncode(dst->octNormals + 2 * i, m.x, m.y, m.z);
+    }
+  }
+
+  if (src->texCoords) {
+    dst->texCoords = (float*)arena->dup(src->texCoords, 2 * sizeof(float) * n);
+  }
+
+  const size_t m = 3 * size_t(src->triangles_n);
+  if (src->hasIndices()) {
+    if (n <= 0x10000) {
+      dst->indices16 = (uint16_t*)arena->alloc(sizeof(uint16_t) * m);
+      for (size_t i = 0; i < m; i++) {
+        dst->indices16[i] = uint16_t(src->index(i));
+      }
+    }
+    else {
+      dst->indices = (uint32_t*)arena->alloc(sizeof(uint32_t) * m);
+      for (size_t i = 0; i < m; i++) {
+        dst->indices[i] = src->index(i);
+      }
+    }
+  }
+  return dst;
+}
@@ -4,11 +4,27 @@
 
 #include "TriangulationMeshSerialize.h"
 
-TriangulationMeshSerialize::TriangulationMeshSerialize(Triangulation* tri)
+TriangulationMeshSerialize::TriangulationMeshSerialize(const Triangulation* tri)
 {
 	triangle = tri;
 }
 
+bool TriangulationMeshSerialize::SerializeTo(std::string& binary)
+{
+	uint8* buffer = nullptr;
+	int32 size = 0;
+	Serialize(buffer, size);
+	if (buffer == nullptr || size <= 0)
+	{
+		delete[] buffer;
+		binary.clear();
+		return false;
+	}
+	binary.assign((const char*)buffer, size_t(size));
+	delete[] buffer;
+	return true;
+}
+
 int32 TriangulationMeshSerialize::VertexCount()
 {
 	return triangle->vertices_n;
@@ -38,9 +54,10 @@ void TriangulationMeshSerialize::GetVertex(int32 index, double& x, double& y, do
 {
 	if (index < triangle->vertices_n)
 	{
-		x = triangle->vertices[3 * index];
-		y = triangle->vertices[3 * index + 1];
-		z = triangle->vertices[3 * index + 2];
+		Vec3f p = triangle->vertex(index);
+		x = p.x;
+		y = p.y;
+		z = p.z;
 	}
 }
 
@@ -48,9 +65,10 @@ void TriangulationMeshSerialize::GetVertexNormal(int32 index, float& x, float& y
 {
 	if (index < triangle->vertices_n)
 	{
-		x = triangle->normals[3 * index];
-		y = triangle->normals[3 * index + 1];
-		z = triangle->normals[3 * index + 2];
+		Vec3f n = triangle->normal(index);
+		x = n.x;
+		y = n.y;
+		z = n.z;
 	}
 }
 
@@ -66,8 +84,8 @@ void TriangulationMeshSerialize::GetFace(int32 index, int32& a, int32& b, int32&
 {
 	if (index < triangle->triangles_n)
 	{
-		a = triangle->indices[3 * index];
-		b = triangle->indices[3 * index + 1];
-		c = triangle->indices[3 * index + 2];
+		a = triangle->index(3 * index);
+		b = triangle->index(3 * index + 1);
+		c = triangle->index(3 * index + 2);
 	}
 }
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "StudioMeshSerialize.h"
+#include <string>
 #include "Store.h"
 
 
@@ -12,7 +13,12 @@
 class  TriangulationMeshSerialize: public DMesh3CommonSerialize
 {
 public:
-	TriangulationMeshSerialize(Triangulation* tri);
+	TriangulationMeshSerialize(const Triangulation* tri);
+
+	// Serializes into binary, which keeps its capacity between calls so that
+	// only the library's own buffer is allocated per mesh. Returns false if
+	// nothing was written.
+	bool SerializeTo(std::string& binary);
 
 protected:
 
@@ -32,5 +38,5 @@ protected:
 	virtual void GetVertexUV(int32 index, float& u, float& v) override;
 	virtual void GetFace(int32 index, int32& a, int32& b, int32& c) override;
 
-	Triangulation* triangle = nullptr;
+	const Triangulation* triangle = nullptr;
 };
@@ -0,0 +1,161 @@
+#include <cassert>
+#include <cstring>
+
+#include "Common.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RVMPARSER_UTF8_SSE2 (1)
+#include <emmintrin.h>
+#else
+#define RVMPARSER_UTF8_SSE2 (0)
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include "windows.h"
+#endif
+
+extern const uint16_t cp936Table[126 * 191];
+
+namespace {
+
+  void appendUtf8(std::string& dst, uint32_t c)
+  {
+    assert(c < 0x10000);
+    if (c < 0x80) {
+      dst.push_back(char(c));
+    }
+    else if (c < 0x800) {
+      dst.push_back(char(0xC0 | (c >> 6)));
+      dst.push_back(char(0x80 | (c & 0x3F)));
+    }
+    else {
+      dst.push_back(char(0xE0 | (c >> 12)));
+      dst.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+      dst.push_back(char(0x80 | (c & 0x3F)));
+    }
+  }
+
+  void ansiToUtf8(std::string& dst, const char* src, size_t length)
+  {
+#ifdef _WIN32
+    int wlen = MultiByteToWideChar(CP_ACP, 0, src, int(length), NULL, 0);
+    std::wstring wide(size_t(wlen), L'\0');
+    MultiByteToWideChar(CP_ACP, 0, src, int(length), wide.data(), wlen);
+    int ulen = WideCharToMultiByte(CP_UTF8, 0, wide.data(), wlen, NULL, 0, NULL, NULL);
+    dst.resize(size_t(ulen));
+    WideCharToMultiByte(CP_UTF8, 0, wide.data(), wlen, dst.data(), ulen, NULL, NULL);
+#else
+    dst.clear();
+    cp936ToUtf8(dst, src, length);
+#endif
+  }
+
+}
+
+
+// Names are mostly plain ASCII, so check that quickly 16 or 8 bytes at a time.
+bool isAscii(const char* str, size_t length)
+{
+  size_t i = 0;
+#if RVMPARSER_UTF8_SSE2
+  for (; i + 16 <= length; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+    if (_mm_movemask_epi8(v) != 0) return false;
+  }
+#endif
+  for (; i + 8 <= length; i += 8) {
+    uint64_t v;
+    std::memcpy(&v, str + i, sizeof(v));
+    if (v & 0x8080808080808080ull) return false;
+  }
+  for (; i < length; i++) {
+    if (str[i] & 0x80) return false;
+  }
+  return true;
+}
+
+// Only checks the lead and continuation bit patterns, which is what the
+// exporters have always used to tell UTF-8 from ANSI names.
+bool isValidUtf8(const char* str)
+{
+  while (*str) {
+    if ((*str & 0x80) == 0) str++;
+    else if ((*str & 0xE0) == 0xC0) {
+      if ((str[1] & 0xC0) != 0x80) return false;
+      str += 2;
+    }
+    else if ((*str & 0xF0) == 0xE0) {
+      for (int i = 1; i <= 2; ++i)
+        if ((str[i] & 0xC0) != 0x80) return false;
+      str += 3;
+    }
+    else if ((*str & 0xF8) == 0xF0) {
+      for (int i = 1; i <= 3; ++i)
+        if ((str[i] & 0xC0) != 0x80) return false;
+      str += 4;
+    }
+    else return false;
+  }
+  return true;
+}
+
+// Single bytes below 0x80 are ASCII and 0x80 is the euro sign, other bytes
+// lead a two-byte code. Unassigned codes and stray bytes become U+FFFD, and
+// decoding resumes at the byte after the lead byte.
+void cp936ToUtf8(std::string& dst, const char* src, size_t length)
+{
+  const auto* s = reinterpret_cast<const uint8_t*>(src);
+  for (size_t i = 0; i < length; ) {
+    const uint8_t lead = s[i];
+    if (lead < 0x80) {
+      dst.push_back(char(lead));
+      i++;
+      continue;
+    }
+    if (lead == 0x80) {
+      appendUtf8(dst, 0x20AC);
+      i++;
+      continue;
+    }
+
+    uint16_t c = 0;
+    if (lead != 0xFF && i + 1 < length) {
+      const uint8_t trail = s[i + 1];
+      if (0x40 <= trail && trail <= 0xFE) {
+        c = cp936Table[191 * (lead - 0x81) + (trail - 0x40)];
+      }
+    }
+    if (c) {
+      appendUtf8(dst, c);
+      i += 2;
+    }
+    else {
+      appendUtf8(dst, 0xFFFD);
+      i++;
+    }
+  }
+}
+
+
+const char* Utf8Names::get(const char* str)
+{
+  if (str == nullptr) return nullptr;
+
+  const size_t length = strlen(str);
+  if (isAscii(str, length)) return str;
+
+  if (uint64_t val; map.get(val, uint64_t(str))) {
+    return (const char*)val;
+  }
+
+  const char* utf8 = str;
+  if (!isValidUtf8(str)) {
+    std::string tmp;
+    ansiToUtf8(tmp, str, length);
+    utf8 = (const char*)arena.dup(tmp.c_str(), tmp.size() + 1);
+    converted++;
+  }
+  map.insert(uint64_t(str), uint64_t(utf8));
+  return utf8;
+}
@@ -22,6 +22,7 @@
 #include <cctype>
 #include <chrono>
 #include <algorithm>
+#include <memory>
 
 #include "Parser.h"
 #include "Tessellator.h"
@@ -36,7 +37,11 @@
 #include "StudioColorizer.h"
 
 
+// The original sample application with the generic outputs, selected with
+// -DORIGINMAIN=1. The default build is the EWC converter.
+#ifndef ORIGINMAIN
 #define ORIGINMAIN 0
+#endif
 
 void logger(unsigned level, const char* msg, ...)
 {
@@ -142,7 +147,10 @@ Options:
   --keep-regex=<keep-regex>           Prune hierarchy by flattening node hierarchy that has names
                                       that do not match the regular expression. Note that the full
                                       name must match the regex, not just a part of the name, e.g.,
-                                      the regex ^/.* will match all names that start with /.
+                                      the regex ^/.* will match all names that start with /. May be
+                                      given multiple times, names matching any of the regexes are
+                                      kept. Literal names and literal prefixes followed by .* are
+                                      matched without running the regex engine.
   --keep-groups=filename.txt          Provide a list of group names to keep. Groups not itself or
                                       with a child in this list will be merged with the first
                                       parent that should be kept.
@@ -150,10 +158,32 @@ Options:
                                       Groups with its name in this list will be discarded along
                                       with its children. Default is no groups are discarded.
   --output-json=<filename.json>       Write hierarchy with attributes to a json file.
+  --output-json-lines=<bool>          Write one json object per line for each top-level group,
+                                      tagged with file index, project and model name, instead of
+                                      a single nested document. Default value is false.
   --output-txt=<filename.txt>         Dump all group names to a text file.
   --output-rev=filename.rev           Write database as a text review file.
+  --output-rev-threads=<uint>         Number of threads used to format top-level groups of the
+                                      review file, where 0 implies one thread per core. Output is
+                                      identical regardless of thread count. Default value is 1.
+  --output-pipe=<name>                Stream groups and tessellated shapes as framed records to a
+                                      consumer, through the named pipe \\.\pipe\<name> on Windows
+                                      and a unix domain socket or FIFO at the path <name> elsewhere.
+                                      The EWC converter writes no EWC file when this is given.
+  --output-pipe-credits=<uint>        Frames the consumer grants up front, it grants more by
+                                      replying with 888 messages. A FIFO needs 0, which disables
+                                      flow control. Default value is 0.
+  --output-pipe-frame-buffers=<uint>  Number of 4MB frame buffers, at least 2, so that encoding
+                                      continues while frames are written. Default value is 2.
+  --output-pipe-threads=<uint>        Number of threads that tessellate and encode shapes, where 0
+                                      implies one thread per core. Default value is 0.
   --output-obj=<filenamestem>         Write geometry to an obj file. The suffices .obj and .mtl are
                                       added to the filenamestem.
+  --output-obj-threads=<uint>         Number of threads used to format obj geometry, where 0 implies
+                                      one thread per core. Output order is unaffected. Default value
+                                      is 1.
+  --output-obj-shortest-floats=<bool> Write the shortest decimal representation that round-trips
+                                      instead of six fixed decimals. Default value is false.
   --output-gltf=<filename.gltf>       Write geometry into a GLTF file (pure JSON with buffers base64
              or <filename.glb>        encoded inline) or a GLB file (JSON with binary buffers in a
                                       GLB container). Type of file is specified by the suffix.
@@ -171,11 +201,27 @@ Options:
                                       of having a dummy holder node to hold each geometry piece.
                                       This transform geometries into common frames, disable this to
                                       avoid that. Default value is true.
+  --output-gltf-stitch-seams=<bool>   When merging geometries, let connected primitives that sample
+                                      their common seam identically share the seam vertices instead
+                                      of each emitting a ring. Default value is false.
+  --output-gltf-parametric=<bool>     Write all primitives but facet groups and lines as compact
+                                      parametric records, kind, parameters and matrix, in a buffer
+                                      referenced from the extras of their node, instead of as
+                                      triangles. Clients tessellate them, src/GltfParametric.h has
+                                      the layout and a reference decoder. Default value is false.
   --output-gltf-split-level=<uint>    Specify a level in the hierarchy to split the output into
                                       multiple files, where 0 implies no split. Geometries and
                                       attributes below the split point are included in the first
                                       file, while subsequent files while have empty nodes just to
                                       represent the hierarchy. Default value is 0.
+  --output-tiles=<directory>          Write geometry as a 3D Tiles tileset, a tileset.json with a
+                                      spatial hierarchy of tiles and one GLB file per tile. Coarser
+                                      tiles use a tolerance that doubles per level and omit objects
+                                      smaller than cull-scale times that tolerance (cull-scale
+                                      defaults to 10 for tiles). The EWC converter writes no EWC
+                                      file when this is given.
+  --output-tiles-leaf-size=<uint>     Maximum number of geometries in a leaf tile. Default value
+                                      is 500.
   --group-bounding-boxes              Include wireframe of boundingboxes of groups in output.
   --color-attribute=key               Specify which attributes that contain color, empty key
                                       implies that material id of group is used.
@@ -183,6 +229,37 @@ Options:
                                       is 0.1.
   --cull-scale=value                  Cull objects smaller than cull-scale times tolerance. Set to
                                       a negative value to disable culling. Disabled by default.
+  --lod-levels=<uint>                 Number of levels of detail to tessellate, in the range 1 to 4.
+                                      Coarser levels re-tessellate primitives with a tolerance that
+                                      is lod-scale times larger than the previous level, and are
+                                      exported as MSFT_lod nodes in GLTF files and as additional
+                                      mesh rows in EWC files. Default value is 1.
+  --lod-scale=value                   Tolerance multiplier between consecutive levels of detail.
+                                      Default value is 4.
+  --weld-vertices=<bool>              Merge facet group vertices that share position and normal
+                                      within a hundredth of the tolerance, instead of emitting
+                                      separate vertices for every polygon. Default value is false.
+  --compact-triangulations=<bool>     Store triangulations with 16-bit indices, octahedral normals
+                                      and, where the rounding error is well below the tolerance,
+                                      half float positions. Saves memory at a small cost in
+                                      tessellation time. Default value is false.
+  --lazy-tessellation=<bool>          Tessellate each geometry just before it is written into a
+                                      reused scratch arena instead of tessellating the whole model
+                                      up front, which bounds memory use by the geometry in flight.
+                                      Only obj output supports this, gltf and chunk-tiny still
+                                      tessellate up front. Default value is false.
+  --validate-bounds=<bool>            Check that every tessellation stays inside the bounding box
+                                      of its geometry and warn about those that do not. Costs a
+                                      pass over all vertices. Default value is false.
+  --grow-bounds=<bool>                Grow the bounding box recorded for each primitive to the box
+                                      computed from its parameters, so that the tessellation always
+                                      fits. Changes the boxes written to rev and json output for
+                                      files whose recorded boxes are tighter. Recorded boxes that
+                                      are not finite are always replaced. Default value is false.
+  --triangle-budget=<uint>            Target number of triangles. Geometries are coarsened, the
+                                      smallest first, by giving them a tolerance up to 2048 times
+                                      --tolerance until the estimated count fits. Zero for no
+                                      budget, which is the default.
 
 Post bug reports or questions at https://github.com/cdyk/rvmparser
 )help", argv0);
@@ -207,6 +284,126 @@ Post bug reports or questions at https://github.com/cdyk/rvmparser
     }
   }
 
+  // Tessellation options accepted by both command lines.
+  struct TessellationOptions
+  {
+    unsigned lodLevels = 1;
+    float lodScale = 4.f;
+    bool weldVertices = false;
+    bool compactTriangulations = false;
+    bool lazyTessellation = false;
+    bool validateBounds = false;
+    uint64_t triangleBudget = 0;
+  };
+
+  // Returns false if key is not a tessellation option.
+  bool parseTessellationOption(TessellationOptions& options, const std::string& arg, const std::string& key, const std::string& val)
+  {
+    if (key == "--lod-levels") {
+      options.lodLevels = std::min(Tessellator::maxLodLevels, std::max(1u, unsigned(std::stoul(val))));
+    }
+    else if (key == "--lod-scale") {
+      options.lodScale = std::max(1.f, std::stof(val));
+    }
+    else if (key == "--weld-vertices") {
+      options.weldVertices = parseBool(logger, arg, val);
+    }
+    else if (key == "--compact-triangulations") {
+      options.compactTriangulations = parseBool(logger, arg, val);
+    }
+    else if (key == "--lazy-tessellation") {
+      options.lazyTessellation = parseBool(logger, arg, val);
+    }
+    else if (key == "--validate-bounds") {
+      options.validateBounds = parseBool(logger, arg, val);
+    }
+    else if (key == "--triangle-budget") {
+      options.triangleBudget = std::stoull(val);
+    }
+    else {
+      return false;
+    }
+    return true;
+  }
+
+  std::unique_ptr<Tessellator> createTessellator(const TessellationOptions& options, float tolerance, float cullLeafThreshold, float cullGeometryThreshold, unsigned maxSamples)
+  {
+    auto tessellator = std::make_unique<Tessellator>(logger, tolerance, cullLeafThreshold, cullGeometryThreshold, maxSamples,
+                                                     options.lodLevels, options.lodScale, options.weldVertices, options.compactTriangulations);
+    tessellator->validateBounds = options.validateBounds;
+    tessellator->triangleBudget = options.triangleBudget;
+    return tessellator;
+  }
+
+  void logTessellationChecks(const Tessellator& tessellator, const TessellationOptions& options)
+  {
+    if (options.weldVertices) {
+      logger(0, "Welded facet group vertices from %llu to %llu",
+             tessellator.weldInputVertices,
+             tessellator.weldOutputVertices);
+    }
+    if (tessellator.boundsViolations) {
+      logger(1, "%u triangulations extend outside the bounds of their geometry", tessellator.boundsViolations);
+    }
+    if (options.triangleBudget) {
+      logger(0, "Triangle budget %llu, coarsened %u geometries smaller than %f for an estimate of %llu, achieved %llu triangles with max error %f",
+             options.triangleBudget,
+             tessellator.budgetCoarsened,
+             tessellator.budgetSize,
+             tessellator.budgetEstimate,
+             tessellator.triangles,
+             tessellator.maxError);
+    }
+  }
+
+  // Reports a tessellator that was applied to the whole store in ms milliseconds.
+  void logTessellation(const Tessellator& tessellator, const TessellationOptions& options, float tolerance, long long ms)
+  {
+    logger(0, "Tessellated %u items of %u into %llu vertices and %llu triangles (tol=%f, %lluk, %lldms, facet polygons %u fan, %u ear clipped, %u libtess2 in %llums)",
+           tessellator.tessellated,
+           tessellator.processed,
+           tessellator.vertices,
+           tessellator.triangles,
+           tolerance,
+           (4*3*tessellator.vertices + 4*3*tessellator.triangles)/1024,
+           ms,
+           tessellator.fanPolygons,
+           tessellator.earClippedPolygons,
+           tessellator.libtessCalls,
+           tessellator.libtessNanoseconds / 1000000);
+    if (1 < options.lodLevels) {
+      logger(0, "Tessellated %u coarser levels of detail into %llu vertices and %llu triangles (levels=%u, scale=%f)",
+             tessellator.lodTessellated,
+             tessellator.lodVertices,
+             tessellator.lodTriangles,
+             options.lodLevels,
+             options.lodScale);
+    }
+    logger(0, "Triangulation arrays use %lluk, %lluk without compaction (%u with half float positions)",
+           tessellator.triangulationBytes / 1024,
+           tessellator.plainTriangulationBytes / 1024,
+           tessellator.halfVertexTriangulations);
+    logTessellationChecks(tessellator, options);
+  }
+
+  // Reports a tessellator used on demand after init. Calls endModel, which
+  // collects the facet polygon and weld counters.
+  void logTessellationOnDemand(Tessellator& tessellator, const TessellationOptions& options, float tolerance)
+  {
+    tessellator.endModel();
+    logger(0, "Tessellated %u items on demand into %llu vertices and %llu triangles (tol=%f, %lluk triangulation arrays, facet polygons %u fan, %u ear clipped, %u libtess2 in %llums)",
+           tessellator.tessellated,
+           tessellator.vertices,
+           tessellator.triangles,
+           tolerance,
+           tessellator.triangulationBytes / 1024,
+           tessellator.fanPolygons,
+           tessellator.earClippedPolygons,
+           tessellator.libtessCalls,
+           tessellator.libtessNanoseconds / 1000000);
+    logTessellationChecks(tessellator, options);
+  }
+
 }
 
 #if ORIGINMAIN
@@ -221,21 +418,36 @@ int main(int argc, char** argv)
 
   unsigned chunkTinyVertexThreshold = 0;
 
+  TessellationOptions tessellationOptions;
+  bool grow_bounds = false;
+
   bool groupBoundingBoxes = false;
-  std::string keep_regex;
+  std::vector<std::string> keep_regexes;
   std::string discard_groups;
   std::string keep_groups;
   std::string output_json;
+  bool output_json_lines = false;
   std::string output_txt;
   std::string output_gltf;
   bool output_gltf_rotate_z_to_y = true;
   bool output_gltf_center = false;
   bool output_gltf_attributes = true;
   bool output_gltf_merge_geos = true;
+  bool output_gltf_stitch_seams = false;
+  bool output_gltf_parametric = false;
   size_t output_gltf_split_level = 0;
+  std::string output_tiles;
+  unsigned output_tiles_leaf_size = 500;
 
   std::string output_rev;
+  unsigned output_rev_threads = 1;
+  std::string output_pipe;
+  unsigned output_pipe_credits = 0;
+  unsigned output_pipe_frame_buffers = 2;
+  unsigned output_pipe_threads = 0;
   std::string output_obj_stem;
+  unsigned output_obj_threads = 1;
+  bool output_obj_shortest_floats = false;
   std::string color_attribute;
   
   Store* store = new Store();
@@ -263,7 +475,7 @@ int main(int argc, char** argv)
           continue;
         }
         else if (key == "--keep-regex") {
-          keep_regex = val;
+          if (!val.empty()) keep_regexes.push_back(val);
           continue;
         }
         else if (key == "--discard-groups") {
@@ -274,6 +486,10 @@ int main(int argc, char** argv)
           output_json = val;
           continue;
         }
+        else if (key == "--output-json-lines") {
+          output_json_lines = parseBool(logger, arg, val);
+          continue;
+        }
         else if (key == "--output-txt") {
           output_txt = val;
           continue;
@@ -282,12 +498,40 @@ int main(int argc, char** argv)
           output_rev = val;
           continue;
         }
+        else if (key == "--output-rev-threads") {
+          output_rev_threads = std::stoul(val);
+          continue;
+        }
+        else if (key == "--output-pipe") {
+          output_pipe = val;
+          continue;
+        }
+        else if (key == "--output-pipe-credits") {
+          output_pipe_credits = std::stoul(val);
+          continue;
+        }
+        else if (key == "--output-pipe-frame-buffers") {
+          output_pipe_frame_buffers = std::stoul(val);
+          continue;
+        }
+        else if (key == "--output-pipe-threads") {
+          output_pipe_threads = std::stoul(val);
+          continue;
+        }
         else if (key == "--output-obj") {
           output_obj_stem = val;
           should_tessellate = true;
           should_colorize = true;
           continue;
         }
+        else if (key == "--output-obj-threads") {
+          output_obj_threads = std::stoul(val);
+          continue;
+        }
+        else if (key == "--output-obj-shortest-floats") {
+          output_obj_shortest_floats = parseBool(logger, arg, val);
+          continue;
+        }
         else if (key == "--output-gltf") {
           output_gltf = val;
           should_tessellate = true;
@@ -310,14 +554,35 @@ int main(int argc, char** argv)
           output_gltf_merge_geos = parseBool(logger, arg, val);
           continue;
         }
+        else if (key == "--output-gltf-stitch-seams") {
+          output_gltf_stitch_seams = parseBool(logger, arg, val);
+          continue;
+        }
+        else if (key == "--output-gltf-parametric") {
+          output_gltf_parametric = parseBool(logger, arg, val);
+          continue;
+        }
         else if (key == "--output-gltf-split-level") {
           output_gltf_split_level = std::stoul(val);
           continue;
         }
+        else if (key == "--output-tiles") {
+          output_tiles = val;
+          should_colorize = true;
+          continue;
+        }
+        else if (key == "--output-tiles-leaf-size") {
+          output_tiles_leaf_size = std::max(1u, unsigned(std::stoul(val)));
+          continue;
+        }
         else if (key == "--color-attribute") {
           color_attribute = val;
           continue;
         }
+        else if (key == "--grow-bounds") {
+          grow_bounds = parseBool(logger, arg, val);
+          continue;
+        }
         else if (key == "--tolerance") {
           tolerance = std::max(1e-6f, std::stof(val));
           continue;
@@ -331,6 +596,9 @@ int main(int argc, char** argv)
           should_tessellate = true;
           continue;
         }
+        else if (parseTessellationOption(tessellationOptions, arg, key, val)) {
+          continue;
+        }
         else
         {
             continue;
@@ -347,7 +615,7 @@ int main(int argc, char** argv)
 
     // parse rvm file
     if (arg_lc.rfind(".rvm") != std::string::npos) {
-      if (processFile(arg, [store, arg](const void * ptr, size_t size) { return parseRVM(store, logger, arg.c_str(), ptr, size); }))
+      if (processFile(arg, [store, arg, grow_bounds](const void * ptr, size_t size) { return parseRVM(store, logger, arg.c_str(), ptr, size, grow_bounds); }))
       {
         fprintf(stderr, "Successfully parsed %s\n", arg.c_str());
       }
@@ -388,20 +656,24 @@ int main(int argc, char** argv)
     }
   } 
 
-  if (rv == 0 && !keep_regex.empty()) {
+  if (rv == 0 && !keep_regexes.empty()) {
+    std::string keep_regex;
+    for (auto& regex : keep_regexes) {
+      keep_regex += (keep_regex.empty() ? "'" : ", '") + regex + "'";
+    }
     unsigned prevGroups = store->groupCount_();
     unsigned prevGeos = store->geometryCount_();
     auto time0 = std::chrono::high_resolution_clock::now();
-    if (flattenRegex(store, logger, keep_regex.c_str())) {
+    if (flattenRegex(store, logger, keep_regexes)) {
       long long ms = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
       store->updateCounts();
-      logger(0, "Flatten hierarchy using regex '%s' in %lldms, %u -> %u nodes, %u -> %u geometries",
+      logger(0, "Flatten hierarchy using regex %s in %lldms, %u -> %u nodes, %u -> %u geometries",
              keep_regex.c_str(), ms,
              prevGroups, store->groupCount_(),
              prevGeos, store->geometryCount_());
     }
     else {
-      logger(2, "Failed to flatten hierarchy using regex '%s'", keep_regex.c_str());
+      logger(2, "Failed to flatten hierarchy using regex %s", keep_regex.c_str());
       rv = -1;
     }
   }
@@ -411,29 +683,29 @@ int main(int argc, char** argv)
     align(store, logger);
   }
 
-  if (rv == 0 && (should_tessellate || !output_json.empty())) {
+  if (rv == 0 && (should_tessellate || !output_json.empty() || !output_tiles.empty())) {
     AddGroupBBox addGroupBBox;
     store->apply(&addGroupBBox);
   }
 
-  if (rv == 0 && should_tessellate ) {
+  // Only the obj exporter tessellates on demand, the other consumers need the
+  // whole model tessellated.
+  bool tessellateOnDemand = tessellationOptions.lazyTessellation && output_gltf.empty() && chunkTinyVertexThreshold == 0;
+  if (tessellationOptions.lazyTessellation && !tessellateOnDemand) {
+    logger(1, "Lazy tessellation is only supported for obj output, tessellating up front.");
+  }
+
+  if (rv == 0 && should_tessellate && !tessellateOnDemand) {
     float cullLeafThreshold = -1.f;
     float cullGeometryThreshold = -1.f;
     unsigned maxSamples = 100;
 
     auto time0 = std::chrono::high_resolution_clock::now();
-    Tessellator tessellator(logger, tolerance, cullLeafThreshold, cullGeometryThreshold, maxSamples);
-    store->apply(&tessellator);
+    auto tessellator = createTessellator(tessellationOptions, tolerance, cullLeafThreshold, cullGeometryThreshold, maxSamples);
+    store->apply(tessellator.get());
     auto time1 = std::chrono::high_resolution_clock::now();
     auto e0 = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
-    logger(0, "Tessellated %u items of %u into %llu vertices and %llu triangles (tol=%f, %lluk, %lldms)",
-           tessellator.tessellated,
-           tessellator.processed,
-           tessellator.vertices,
-           tessellator.triangles,
-           tolerance,
-           (4*3*tessellator.vertices + 4*3*tessellator.triangles)/1024,
-           e0);
+    logTessellation(*tessellator, tessellationOptions, tolerance, e0);
   }
 
   bool do_flatten = false;
@@ -457,15 +729,13 @@ int main(int argc, char** argv)
   }
 
   if (do_flatten) {
-    auto * storeNew = flatten.run();
-    delete store;
-    store = storeNew;
+    flatten.run();
   }
 
 
   if (rv == 0 && !output_json.empty()) {
     auto time0 = std::chrono::high_resolution_clock::now();
-    if (exportJson(store, logger, output_json.c_str())) {
+    if (exportJson(store, logger, output_json.c_str(), output_json_lines)) {
       auto time1 = std::chrono::high_resolution_clock::now();
       auto e = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
       logger(0, "Exported json into %s (%lldms)", output_json.c_str(), e);
@@ -499,7 +769,7 @@ int main(int argc, char** argv)
 
   if (rv == 0 && !output_rev.empty()) {
     auto time0 = std::chrono::high_resolution_clock::now();
-    if (exportRev(store, logger, output_rev.c_str())) {
+    if (exportRev(store, logger, output_rev.c_str(), output_rev_threads)) {
       long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
       logger(0, "Exported rev file %s (%lldms)", output_rev.c_str(), e);
     }
@@ -509,18 +779,43 @@ int main(int argc, char** argv)
     }
   }
 
+  if (rv == 0 && !output_pipe.empty()) {
+    auto time0 = std::chrono::high_resolution_clock::now();
+    if (exportNamedPipe(store, logger, output_pipe, output_pipe_credits, output_pipe_frame_buffers, output_pipe_threads)) {
+      long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+      logger(0, "Exported to pipe %s (%lldms)", output_pipe.c_str(), e);
+    }
+    else {
+      logger(2, "Failed to export to pipe %s", output_pipe.c_str());
+      rv = -1;
+    }
+  }
+
   if (rv == 0 && !output_obj_stem.empty()) {
     assert(should_tessellate);
  
     auto time0 = std::chrono::high_resolution_clock::now();
     ExportObj exportObj;
     exportObj.groupBoundingBoxes = groupBoundingBoxes;
+    exportObj.threads = output_obj_threads;
+    exportObj.shortestFloats = output_obj_shortest_floats;
+
+    std::unique_ptr<Tessellator> tessellator;
+    if (tessellateOnDemand) {
+      tessellator = createTessellator(tessellationOptions, tolerance, -1.f, -1.f, 100);
+      tessellator->init(*store);
+      exportObj.tessellator = tessellator.get();
+    }
+
     if (exportObj.open((output_obj_stem + ".obj").c_str(), (output_obj_stem + ".mtl").c_str())) {
       store->apply(&exportObj);
 
       auto time1 = std::chrono::high_resolution_clock::now();
       auto e = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
       logger(0, "Exported obj into %s(.obj|.mtl) (%lldms)", output_obj_stem.c_str(), e);
+      if (tessellator) {
+        logTessellationOnDemand(*tessellator, tessellationOptions, tolerance);
+      }
     }
     else {
       logger(2, "Failed to export obj file.\n");
@@ -537,7 +832,9 @@ int main(int argc, char** argv)
                    output_gltf_rotate_z_to_y,
                    output_gltf_center,
                    output_gltf_attributes,
-                   output_gltf_merge_geos))
+                   output_gltf_merge_geos,
+                   output_gltf_stitch_seams,
+                   output_gltf_parametric))
     {
       long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
       logger(0, "Exported gltf in %lldms", e);
@@ -548,6 +845,23 @@ int main(int argc, char** argv)
     }
   }
 
+  if (rv == 0 && !output_tiles.empty()) {
+    auto time0 = std::chrono::high_resolution_clock::now();
+    if (exportTiles(store, logger,
+                    output_tiles.c_str(),
+                    tolerance,
+                    cullScale < 0.f ? 10.f : cullScale,
+                    output_tiles_leaf_size))
+    {
+      long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+      logger(0, "Exported tiles in %lldms", e);
+    }
+    else {
+      logger(2, "Failed to export tiles into %s", output_tiles.c_str());
+      rv = -1;
+    }
+  }
+
   AddStats addStats;
   store->apply(&addStats);
   auto * stats = store->stats;
@@ -595,6 +909,10 @@ int main(int argc, char** argv)
 
   bool compresszip = false;
 
+  //дɺִANALYZE/VACUUM
+  bool analyze = false;
+  bool vacuum = false;
+
   bool should_colorize = true;
   std::string color_attribute;
 
@@ -604,6 +922,18 @@ int main(int argc, char** argv)
 
   std::string outformat = "ewc";
 
+  std::string output_pipe;
+  unsigned output_pipe_credits = 0;
+  unsigned output_pipe_frame_buffers = 2;
+  unsigned output_pipe_threads = 0;
+
+  std::string output_tiles;
+  unsigned output_tiles_leaf_size = 500;
+  float cullScale = 10.f;
+
+  TessellationOptions tessellationOptions;
+  bool grow_bounds = false;
+
   Store* store = new Store();
 
   for (int i = 1; i < argc; i++) {
@@ -634,6 +964,16 @@ int main(int argc, char** argv)
               compresszip = true;
               continue;
           }
+          else if (arg == "--analyze") {
+
+              analyze = true;
+              continue;
+          }
+          else if (arg == "--vacuum") {
+
+              vacuum = true;
+              continue;
+          }
 
           auto e = arg.find('=');
           if (e != std::string::npos) {
@@ -673,6 +1013,22 @@ int main(int argc, char** argv)
 
                   continue;
               }
+              else if (key == "--output-pipe") {
+                  output_pipe = val;
+                  continue;
+              }
+              else if (key == "--output-pipe-credits") {
+                  output_pipe_credits = std::stoul(val);
+                  continue;
+              }
+              else if (key == "--output-pipe-frame-buffers") {
+                  output_pipe_frame_buffers = std::stoul(val);
+                  continue;
+              }
+              else if (key == "--output-pipe-threads") {
+                  output_pipe_threads = std::stoul(val);
+                  continue;
+              }
               else if (key == "--output-obj") {
 
                   continue;
@@ -697,26 +1053,50 @@ int main(int argc, char** argv)
 
                   continue;
               }
+              else if (key == "--output-gltf-stitch-seams") {
+
+                  continue;
+              }
+              else if (key == "--output-gltf-parametric") {
+
+                  continue;
+              }
               else if (key == "--output-gltf-split-level") {
 
                   continue;
               }
+              else if (key == "--output-tiles") {
+                  output_tiles = val;
+                  continue;
+              }
+              else if (key == "--output-tiles-leaf-size") {
+                  output_tiles_leaf_size = std::max(1u, unsigned(std::stoul(val)));
+                  continue;
+              }
               else if (key == "--color-attribute") {
                   color_attribute = val;
                   continue;
               }
+              else if (key == "--grow-bounds") {
+                  grow_bounds = parseBool(logger, arg, val);
+                  continue;
+              }
               else if (key == "--tolerance") {
 
                   continue;
               }
               else if (key == "--cull-scale") {
-
+                  // ֻ--output-tiles
+                  cullScale = std::stof(val);
                   continue;
               }
               else if (key == "--chunk-tiny") {
 
                   continue;
               }
+              else if (parseTessellationOption(tessellationOptions, arg, key, val)) {
+                  continue;
+              }
           }
 
           continue;
@@ -728,7 +1108,7 @@ int main(int argc, char** argv)
 
       // parse rvm file
       if (arg_lc.rfind(".rvm") != std::string::npos) {
-          if (processFile(arg, [store, arg](const void* ptr, size_t size) { return parseRVM(store, logger, arg.c_str(), ptr, size); }))
+          if (processFile(arg, [store, arg, grow_bounds](const void* ptr, size_t size) { return parseRVM(store, logger, arg.c_str(), ptr, size, grow_bounds); }))
           {
               fprintf(stderr, "Successfully parsed %s\n", arg.c_str());
           }
@@ -765,28 +1145,55 @@ int main(int argc, char** argv)
   }
 
 
-  if (rv == 0&& !geometryasmesh) {
-      float tolerance = 0.1f;
-      float cullLeafThreshold = -1.f;
-      float cullGeometryThreshold = -1.f;
-      unsigned maxSamples = 100;
+  float tolerance = 0.1f;
+  float cullLeafThreshold = -1.f;
+  float cullGeometryThreshold = -1.f;
+  unsigned maxSamples = 100;
+
+  // The pipe and tiles exports tessellate each shape themselves.
+  bool exportOther = !output_pipe.empty() || !output_tiles.empty();
+
+  // ϸʱexportEWCдÿshapeǰϸ, Ԥϸģ
+  std::unique_ptr<Tessellator> lazyTessellator;
+  if (rv == 0 && !exportOther && !geometryasmesh && tessellationOptions.lazyTessellation) {
+      lazyTessellator = createTessellator(tessellationOptions, tolerance, cullLeafThreshold, cullGeometryThreshold, maxSamples);
+      lazyTessellator->init(*store);
+  }
 
+  if (rv == 0 && !exportOther && !geometryasmesh && !tessellationOptions.lazyTessellation) {
       auto time0 = std::chrono::high_resolution_clock::now();
-      Tessellator tessellator(logger, tolerance, cullLeafThreshold, cullGeometryThreshold, maxSamples);
-      store->apply(&tessellator);
+      auto tessellator = createTessellator(tessellationOptions, tolerance, cullLeafThreshold, cullGeometryThreshold, maxSamples);
+      store->apply(tessellator.get());
       auto time1 = std::chrono::high_resolution_clock::now();
       auto e0 = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
-      logger(0, "Tessellated %u items of %u into %llu vertices and %llu triangles (tol=%f, %lluk, %lldms)",
-          tessellator.tessellated,
-          tessellator.processed,
-          tessellator.vertices,
-          tessellator.triangles,
-          tolerance,
-          (4 * 3 * tessellator.vertices + 4 * 3 * tessellator.triangles) / 1024,
-          e0);
+      logTessellation(*tessellator, tessellationOptions, tolerance, e0);
   }
 
-  if (exportEWC(store, logger, filename, delexistfile, geometryasmesh, compresszip, outformat))
+  if (!output_pipe.empty()) {
+      if (rv == 0 && exportNamedPipe(store, logger, output_pipe, output_pipe_credits, output_pipe_frame_buffers, output_pipe_threads)) {
+          long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+          logger(0, "Exported to pipe %s in %lldms", output_pipe.c_str(), e);
+      }
+      else {
+          logger(2, "Failed to export to pipe %s", output_pipe.c_str());
+          rv = -1;
+      }
+  }
+  else if (!output_tiles.empty()) {
+      if (rv == 0) {
+          AddGroupBBox addGroupBBox;
+          store->apply(&addGroupBBox);
+      }
+      if (rv == 0 && exportTiles(store, logger, output_tiles.c_str(), tolerance, cullScale < 0.f ? 10.f : cullScale, output_tiles_leaf_size)) {
+          long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
+          logger(0, "Exported tiles in %lldms", e);
+      }
+      else {
+          logger(2, "Failed to export tiles into %s", output_tiles.c_str());
+          rv = -1;
+      }
+  }
+  else if (exportEWC(store, logger, filename, delexistfile, geometryasmesh, compresszip, outformat, analyze, vacuum, lazyTessellator.get()))
   {
       long long e = std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::high_resolution_clock::now() - time0)).count();
       logger(0, "Exported  in %lldms", e);
@@ -796,6 +1203,11 @@ int main(int argc, char** argv)
       rv = -1;
   }
 
+  if (lazyTessellator) {
+      logTessellationOnDemand(*lazyTessellator, tessellationOptions, tolerance);
+      lazyTessellator.reset();
+  }
+
   AddStats addStats;
   store->apply(&addStats);
   auto * stats = store->stats;
@@ -0,0 +1,107 @@
+// Benchmark and check of the base64 encoders used for gltf buffers.
+//
+// Usage: bench-base64 [megabytes] [--repeat=<uint>]
+//
+// Includes ExportGLTF.cpp to reach the encoders in its anonymous namespace.
+// Every encoder the CPU supports must give the same characters as the scalar
+// encoder for all lengths up to 256 bytes at every alignment, and for the
+// whole benchmark buffer. Prints the best throughput of each encoder and exits
+// with status 1 if any output differs.
+#include "../src/ExportGLTF.cpp"
+
+#include <cstdlib>
+#include <random>
+
+void logger(unsigned, const char*, ...) {}
+
+namespace {
+
+  struct Encoder
+  {
+    const char* name;
+    Base64Encoder encode;
+  };
+
+  // Runs the encoder and finishes the triples it left with the scalar encoder,
+  // like encodeBase64 does. Returns the number of characters written.
+  size_t encodeTriples(Base64Encoder encode, char* dst, const uint8_t* src, size_t byteLength)
+  {
+    size_t i = encode(dst, src, byteLength);
+    i += encodeBase64Scalar(dst + 4 * (i / 3), src + i, byteLength - i);
+    return 4 * (i / 3);
+  }
+
+  bool check(const Encoder& encoder, const std::vector<uint8_t>& data)
+  {
+    std::vector<char> expected(4 * (data.size() / 3) + 64);
+    std::vector<char> actual(expected.size());
+    for (size_t offset = 0; offset < 32; offset++) {
+      for (size_t length = 0; length <= 256 && offset + length <= data.size(); length++) {
+        size_t n = encodeTriples(encodeBase64Scalar, expected.data(), data.data() + offset, length);
+        size_t m = encodeTriples(encoder.encode, actual.data(), data.data() + offset, length);
+        if (n != m || std::memcmp(expected.data(), actual.data(), n) != 0) {
+          fprintf(stderr, "FAILED: %s differs from scalar for %zu bytes at offset %zu\n", encoder.name, length, offset);
+          return false;
+        }
+      }
+    }
+    size_t n = encodeTriples(encodeBase64Scalar, expected.data(), data.data(), data.size());
+    size_t m = encodeTriples(encoder.encode, actual.data(), data.data(), data.size());
+    if (n != m || std::memcmp(expected.data(), actual.data(), n) != 0) {
+      fprintf(stderr, "FAILED: %s differs from scalar for the whole buffer\n", encoder.name);
+      return false;
+    }
+    return true;
+  }
+
+  // Best time in milliseconds of encoding the buffer.
+  double bench(const Encoder& encoder, const std::vector<uint8_t>& data, unsigned repeat)
+  {
+    std::vector<char> out(4 * (data.size() / 3) + 64);
+    double best = 0.0;
+    for (unsigned r = 0; r < repeat; r++) {
+      auto time0 = std::chrono::high_resolution_clock::now();
+      encodeTriples(encoder.encode, out.data(), data.data(), data.size());
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - time0).count();
+      best = r == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t megabytes = 64;
+  unsigned repeat = 5;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = std::max(1u, unsigned(std::strtoul(argv[i] + 9, nullptr, 10)));
+    }
+    else {
+      megabytes = std::max(size_t(1), size_t(std::strtoul(argv[i], nullptr, 10)));
+    }
+  }
+
+  std::vector<uint8_t> data(megabytes * 1024 * 1024);
+  std::mt19937 rng(1);
+  for (auto& byte : data) byte = uint8_t(rng());
+
+  std::vector<Encoder> encoders = { { "scalar", encodeBase64Scalar } };
+#if RVMPARSER_BASE64_X86
+  const char* widest = nullptr;
+  selectBase64Encoder(widest);
+  if (std::strcmp(widest, "scalar") != 0) encoders.push_back({ "ssse3", encodeBase64SSSE3 });
+  if (std::strcmp(widest, "avx2") == 0) encoders.push_back({ "avx2", encodeBase64AVX2 });
+#endif
+
+  printf("%zu MB of random bytes, best of %u runs, exportGLTF uses %s\n", megabytes, repeat, base64EncoderName);
+  bool ok = true;
+  for (const Encoder& encoder : encoders) {
+    bool same = check(encoder, data);
+    double ms = bench(encoder, data, repeat);
+    printf("%-8s %8.2fms %8.0f MB/s%s\n", encoder.name, ms, megabytes / (ms / 1000.0), same ? "" : ", output differs from scalar");
+    ok = ok && same;
+  }
+  return ok ? 0 : 1;
+}
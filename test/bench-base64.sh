@@ -0,0 +1,27 @@
+#!/bin/bash
+# Builds and runs test/bench-base64.cpp, which times the scalar, SSSE3 and
+# AVX2 base64 encoders of the gltf exporter and checks each against the
+# scalar one.
+#
+# Usage: bench-base64.sh [megabytes] [--repeat=<uint>]
+#
+# Encoders the CPU does not support are skipped. Uses $CC and $CXX, or cc and
+# c++.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+libs="$here/../rvmparser-linux/libs"
+tess="$libs/libtess2"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for c in "$tess"/Source/*.c; do
+  ${CC:-cc} -O2 -I"$tess/Include" -c "$c" -o "$tmp/$(basename "$c" .c).o"
+done
+${CXX:-c++} -std=c++20 -O2 -I"$src" -I"$libs/rapidjson/include" -I"$tess/Include" -o "$tmp/bench-base64" \
+  "$here/bench-base64.cpp" \
+  "$src/GltfParametric.cpp" "$src/TriangulationFactory.cpp" "$src/Store.cpp" "$src/LinAlgOps.cpp" "$src/Common.cpp" \
+  "$tmp"/*.o
+
+"$tmp/bench-base64" "$@"
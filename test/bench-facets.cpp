@@ -0,0 +1,130 @@
+// Benchmark of the fan and ear clipping fast path for facet groups.
+//
+// Usage: bench-facets <file.rvm>... [--repeat=<uint>]
+//
+// Parses the files and triangulates every facet group with
+// TriangulationFactory::geometry, once with the fast path for single contours
+// and once with every polygon going to libtess2. Prints the best time of each
+// with the triangle count and the fanPolygons, earClippedPolygons,
+// libtessCalls and libtessNanoseconds counters of the last run. The triangle
+// counts may differ slightly, libtess2 drops degenerate triangles that the
+// fast path keeps.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "Common.h"
+#include "Store.h"
+#include "Parser.h"
+#include "Tessellator.h"
+
+void logger(unsigned, const char*, ...) {}
+
+namespace {
+
+  void collectFacetGroups(std::vector<const Geometry*>& geos, const Node* node)
+  {
+    if (node->kind == Node::Kind::Group) {
+      for (const Geometry* geo = node->group.geometries.first; geo; geo = geo->next) {
+        if (geo->kind == Geometry::Kind::FacetGroup) geos.push_back(geo);
+      }
+    }
+    for (const Node* child = node->children.first; child; child = child->next) {
+      collectFacetGroups(geos, child);
+    }
+  }
+
+  struct Run
+  {
+    double ms = 0.0;
+    uint64_t triangles = 0;
+    unsigned fanPolygons = 0;
+    unsigned earClippedPolygons = 0;
+    unsigned libtessCalls = 0;
+    uint64_t libtessNanoseconds = 0;
+  };
+
+  // Best time of repeat runs, with the counters of the last one.
+  Run run(Store* store, const std::vector<const Geometry*>& geos, bool simpleContours, unsigned repeat)
+  {
+    Run best;
+    for (unsigned r = 0; r < repeat; r++) {
+      TriangulationFactory factory(store, logger, 0.1f, 3, 100);
+      factory.simpleContours = simpleContours;
+      Arena arena;
+      uint64_t triangles = 0;
+      auto time0 = std::chrono::high_resolution_clock::now();
+      for (const Geometry* geo : geos) {
+        const Triangulation* tri = factory.geometry(&arena, geo, 1.f);
+        if (tri) triangles += tri->triangles_n;
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - time0).count();
+      best.ms = r == 0 ? ms : std::min(best.ms, ms);
+      best.triangles = triangles;
+      best.fanPolygons = factory.fanPolygons;
+      best.earClippedPolygons = factory.earClippedPolygons;
+      best.libtessCalls = factory.libtessCalls;
+      best.libtessNanoseconds = factory.libtessNanoseconds;
+    }
+    return best;
+  }
+
+  void print(const char* label, const Run& run)
+  {
+    printf("%-12s %8.2fms, %llu triangles, fanPolygons=%u earClippedPolygons=%u libtessCalls=%u libtessNanoseconds=%llu\n",
+           label, run.ms, (unsigned long long)run.triangles, run.fanPolygons, run.earClippedPolygons, run.libtessCalls,
+           (unsigned long long)run.libtessNanoseconds);
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<const char*> paths;
+  unsigned repeat = 5;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = std::max(1u, unsigned(std::strtoul(argv[i] + 9, nullptr, 10)));
+    }
+    else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "Usage: %s <file.rvm>... [--repeat=<uint>]\n", argv[0]);
+    return 2;
+  }
+
+  Store* store = new Store();
+  for (const char* path : paths) {
+    std::vector<char> bytes;
+    FILE* in = std::fopen(path, "rb");
+    if (in) {
+      char buffer[1 << 16];
+      size_t n;
+      while ((n = std::fread(buffer, 1, sizeof(buffer), in)) > 0) bytes.insert(bytes.end(), buffer, buffer + n);
+      std::fclose(in);
+    }
+    if (!in || !parseRVM(store, logger, path, bytes.data(), bytes.size())) {
+      fprintf(stderr, "Failed to parse %s\n", path);
+      return 2;
+    }
+  }
+
+  std::vector<const Geometry*> geos;
+  for (const Node* root = store->getFirstRoot(); root; root = root->next) {
+    collectFacetGroups(geos, root);
+  }
+  printf("%zu facet groups, best of %u runs\n", geos.size(), repeat);
+
+  Run fast = run(store, geos, true, repeat);
+  Run libtess = run(store, geos, false, repeat);
+  print("fast path", fast);
+  print("libtess2", libtess);
+
+  delete store;
+  return 0;
+}
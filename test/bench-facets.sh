@@ -0,0 +1,39 @@
+#!/bin/bash
+# Builds test/bench-facets.cpp and times facet group triangulation with and
+# without the fan and ear clipping fast path.
+#
+# Usage: bench-facets.sh [files...] [--repeat=<uint>]
+#
+# Without files, a synthetic model with about 800 facet groups is generated.
+# Uses $CC and $CXX, or cc and c++.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+tess="$here/../rvmparser-linux/libs/libtess2"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+args=()
+files=0
+for a in "$@"; do
+  case "$a" in
+    --*) ;;
+    *) files=$((files + 1)) ;;
+  esac
+  args+=("$a")
+done
+if [ $files -eq 0 ]; then
+  python3 "$here/genrvm.py" "$tmp/model" 20 1 4
+  args+=("$tmp/model.rvm")
+fi
+
+for c in "$tess"/Source/*.c; do
+  ${CC:-cc} -O2 -I"$tess/Include" -c "$c" -o "$tmp/$(basename "$c" .c).o"
+done
+${CXX:-c++} -std=c++20 -O2 -I"$src" -I"$tess/Include" -o "$tmp/bench-facets" \
+  "$here/bench-facets.cpp" \
+  "$src/ParserRVM.cpp" "$src/TriangulationFactory.cpp" "$src/Store.cpp" "$src/LinAlgOps.cpp" "$src/Common.cpp" \
+  "$tmp"/*.o
+
+"$tmp/bench-facets" "${args[@]}"
@@ -0,0 +1,142 @@
+// Benchmark of --keep-regex over a group hierarchy dumped with --output-txt.
+//
+// Usage: bench-keep-regex <names.txt> <pattern>... [--repeat=<uint>]
+//
+// Rebuilds the hierarchy of the dump in a store, without geometries, and
+// runs flattenRegex on a fresh copy for each pattern as given and wrapped in
+// (?:...). The wrapped form has the same meaning but is never recognized as a
+// literal or prefix, so it always goes through std::regex. Prints the best
+// time of each and exits with status 1 if they keep different numbers of
+// groups.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "Store.h"
+
+void logger(unsigned, const char*, ...) {}
+
+namespace {
+
+  struct Group
+  {
+    unsigned level;
+    std::string name;
+  };
+
+  // Group names of a DumpNames file with their nesting level, four spaces
+  // per level. File and model headers are skipped, as are the geometry
+  // counts, which are indented by one more space.
+  bool readDump(std::vector<Group>& groups, const char* path)
+  {
+    FILE* in = std::fopen(path, "r");
+    if (!in) return false;
+
+    unsigned skip = 0;
+    char line[4096];
+    while (std::fgets(line, sizeof(line), in)) {
+      size_t length = std::strcspn(line, "\r\n");
+      line[length] = '\0';
+      if (std::strcmp(line, "File:") == 0) { skip = 5; continue; }
+      if (std::strcmp(line, "Model:") == 0) { skip = 2; continue; }
+      if (skip) { skip--; continue; }
+
+      size_t indent = std::strspn(line, " ");
+      if (indent == length || indent % 4 != 0) continue;
+      groups.push_back(Group{ unsigned(indent / 4), std::string(line + indent) });
+    }
+    std::fclose(in);
+    return true;
+  }
+
+  Store* buildStore(const std::vector<Group>& groups)
+  {
+    Store* store = new Store();
+    Node* model = store->getDefaultModel();
+    std::vector<Node*> stack;
+    for (const Group& group : groups) {
+      stack.resize(std::min(size_t(group.level), stack.size()));
+      Node* node = store->newNode(stack.empty() ? model : stack.back(), Node::Kind::Group);
+      node->group.name = store->strings.intern(group.name.c_str());
+      stack.push_back(node);
+    }
+    return store;
+  }
+
+  unsigned countGroups(const Node* node)
+  {
+    unsigned count = node->kind == Node::Kind::Group ? 1 : 0;
+    for (const Node* child = node->children.first; child; child = child->next) {
+      count += countGroups(child);
+    }
+    return count;
+  }
+
+  // Best time in milliseconds of repeat runs, and the groups kept by the last one.
+  double run(const std::vector<Group>& groups, const std::string& pattern, unsigned repeat, unsigned& kept)
+  {
+    double best = 0.0;
+    for (unsigned r = 0; r < repeat; r++) {
+      Store* store = buildStore(groups);
+      auto time0 = std::chrono::high_resolution_clock::now();
+      if (!flattenRegex(store, logger, { pattern })) {
+        fprintf(stderr, "Failed to compile %s\n", pattern.c_str());
+        std::exit(2);
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - time0).count();
+      best = r == 0 ? ms : std::min(best, ms);
+      kept = countGroups(store->getFirstRoot());
+      delete store;
+    }
+    return best;
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  const char* path = nullptr;
+  std::vector<std::string> patterns;
+  unsigned repeat = 5;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = std::max(1u, unsigned(std::strtoul(argv[i] + 9, nullptr, 10)));
+    }
+    else if (path == nullptr) {
+      path = argv[i];
+    }
+    else {
+      patterns.push_back(argv[i]);
+    }
+  }
+  if (path == nullptr || patterns.empty()) {
+    fprintf(stderr, "Usage: %s <names.txt> <pattern>... [--repeat=<uint>]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Group> groups;
+  if (!readDump(groups, path) || groups.empty()) {
+    fprintf(stderr, "Failed to read group names from %s\n", path);
+    return 2;
+  }
+  printf("%zu groups from %s, best of %u runs\n", groups.size(), path, repeat);
+
+  bool same = true;
+  for (const std::string& pattern : patterns) {
+    unsigned kept = 0;
+    unsigned keptRegex = 0;
+    double ms = run(groups, pattern, repeat, kept);
+    double msRegex = run(groups, "(?:" + pattern + ")", repeat, keptRegex);
+    printf("%-32s %8.2fms, with std::regex %8.2fms, %u groups kept\n", pattern.c_str(), ms, msRegex, kept);
+    if (kept != keptRegex) {
+      printf("FAILED: %s kept %u groups, std::regex %u\n", pattern.c_str(), kept, keptRegex);
+      same = false;
+    }
+  }
+  return same ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Builds test/bench-keep-regex.cpp and runs it over the group names that
+# <rvmparser> dumps with --output-txt.
+#
+# Usage: bench-keep-regex.sh <rvmparser> [files...] [-- patterns...]
+#
+# <rvmparser> is the sample application, built with -DORIGINMAIN=1. Without
+# files, a synthetic model with about 40000 groups is generated. Without
+# patterns, a prefix, an exact name, an escaped $ and a character class are
+# timed. Uses $CXX, or c++.
+set -e
+
+exe=$1
+shift || true
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+if [ -z "$exe" ]; then
+  echo "usage: $0 <rvmparser> [files...] [-- patterns...]"
+  exit 2
+fi
+
+files=()
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+  files+=("$1")
+  shift
+done
+shift || true
+if [ $# -eq 0 ]; then
+  set -- '/SITE1/C0.*' '/SITE7/C1/C2/C0' '/SITE7\$' '^/SITE1[0-9]/C1.*$'
+fi
+if [ ${#files[@]} -eq 0 ]; then
+  python3 "$here/genrvm.py" "$tmp/model" 100 1 6
+  files=("$tmp/model.rvm")
+fi
+
+"$exe" --output-txt="$tmp/names.txt" "${files[@]}" 2> "$tmp/dump.log"
+${CXX:-c++} -std=c++20 -O2 -I"$src" -o "$tmp/bench-keep-regex" \
+  "$here/bench-keep-regex.cpp" \
+  "$src/FlattenRegex.cpp" "$src/Store.cpp" "$src/Common.cpp" "$src/LinAlgOps.cpp"
+"$tmp/bench-keep-regex" "$tmp/names.txt" "$@"
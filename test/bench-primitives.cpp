@@ -0,0 +1,145 @@
+// Benchmark of the per-primitive cost of TriangulationFactory::geometry for
+// the kinds that sample circles through the shared cos/sin tables.
+//
+// Usage: bench-primitives [primitives per kind] [--tolerance=<float>] [--repeat=<uint>]
+//
+// Generates random cylinders, snouts, circular and rectangular tori, spheres
+// and elliptical and spherical dishes with radii over four decades, so that
+// the sample counts span minSamples to maxSamples, and with a random sample
+// start angle on every other one. Prints the best time per primitive of each
+// kind with the average triangle count.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Common.h"
+#include "Store.h"
+#include "Tessellator.h"
+
+void logger(unsigned, const char*, ...) {}
+
+namespace {
+
+  struct Kind
+  {
+    const char* name;
+    Geometry::Kind kind;
+  };
+
+  std::vector<Geometry> generate(std::mt19937& rng, Geometry::Kind kind, unsigned count)
+  {
+    const float identity[12] = { 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f };
+    std::uniform_real_distribution<float> U(0.f, 1.f);
+    std::vector<Geometry> geos(count);
+    for (unsigned i = 0; i < count; i++) {
+      Geometry& geo = geos[i];
+      geo.kind = kind;
+      geo.M_3x4 = makeMat3x4f(identity);
+      geo.sampleStartAngle = i % 2 ? 6.2831853f * U(rng) : 0.f;
+      float r = std::pow(10.f, 4.f * U(rng) - 2.f);
+      float h = r * (0.1f + 4.f * U(rng));
+      switch (kind) {
+      case Geometry::Kind::Cylinder:
+        geo.cylinder.radius = r;
+        geo.cylinder.height = h;
+        break;
+      case Geometry::Kind::Snout:
+        geo.snout = {};
+        geo.snout.radius_b = r;
+        geo.snout.radius_t = r * (0.2f + U(rng));
+        geo.snout.height = h;
+        if (i % 4 == 1) {
+          geo.snout.offset[0] = 0.3f * r * U(rng);
+          geo.snout.bshear[0] = 0.2f * U(rng);
+        }
+        break;
+      case Geometry::Kind::CircularTorus:
+        geo.circularTorus.radius = r;
+        geo.circularTorus.offset = r * (1.5f + 4.f * U(rng));
+        geo.circularTorus.angle = 0.5f + 5.7f * U(rng);
+        break;
+      case Geometry::Kind::RectangularTorus:
+        geo.rectangularTorus.inner_radius = r;
+        geo.rectangularTorus.outer_radius = r * (1.2f + 2.f * U(rng));
+        geo.rectangularTorus.height = h;
+        geo.rectangularTorus.angle = 0.5f + 5.7f * U(rng);
+        break;
+      case Geometry::Kind::Sphere:
+        geo.sphere.diameter = 2.f * r;
+        break;
+      case Geometry::Kind::EllipticalDish:
+        geo.ellipticalDish.baseRadius = r;
+        geo.ellipticalDish.height = r * (0.2f + U(rng));
+        break;
+      case Geometry::Kind::SphericalDish:
+        geo.sphericalDish.baseRadius = r;
+        geo.sphericalDish.height = r * (0.1f + 1.5f * U(rng));
+        break;
+      default:
+        break;
+      }
+      geo.bboxLocal = analyticBounds(&geo);
+    }
+    return geos;
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  unsigned count = 20000;
+  float tolerance = 0.05f;
+  unsigned repeat = 5;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--tolerance=", 12) == 0) {
+      tolerance = std::strtof(argv[i] + 12, nullptr);
+    }
+    else if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+      repeat = std::max(1u, unsigned(std::strtoul(argv[i] + 9, nullptr, 10)));
+    }
+    else {
+      count = std::max(1u, unsigned(std::strtoul(argv[i], nullptr, 10)));
+    }
+  }
+
+  const Kind kinds[] = {
+    { "cylinder", Geometry::Kind::Cylinder },
+    { "snout", Geometry::Kind::Snout },
+    { "circular torus", Geometry::Kind::CircularTorus },
+    { "rect torus", Geometry::Kind::RectangularTorus },
+    { "sphere", Geometry::Kind::Sphere },
+    { "ellip dish", Geometry::Kind::EllipticalDish },
+    { "spher dish", Geometry::Kind::SphericalDish },
+  };
+
+  printf("%u primitives per kind, tolerance %g, best of %u runs\n", count, tolerance, repeat);
+  Store store;
+  std::mt19937 rng(1);
+  for (const Kind& kind : kinds) {
+    std::vector<Geometry> geos = generate(rng, kind.kind, count);
+
+    TriangulationFactory factory(&store, logger, tolerance, 3, 100);
+    Arena arena;
+    double best = 0.0;
+    uint64_t triangles = 0;
+    for (unsigned r = 0; r < repeat; r++) {
+      arena.reset();
+      triangles = 0;
+      auto time0 = std::chrono::high_resolution_clock::now();
+      for (const Geometry& geo : geos) {
+        const Triangulation* tri = factory.geometry(&arena, &geo, 1.f);
+        if (tri) triangles += tri->triangles_n;
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - time0).count();
+      best = r == 0 ? ms : std::min(best, ms);
+    }
+    printf("%-16s %8.3fus per primitive, %8.1f triangles per primitive\n",
+           kind.name, 1000.0 * best / count, double(triangles) / count);
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Builds and runs test/bench-primitives.cpp, the per-primitive tessellation
+# cost of the kinds that sample circles.
+#
+# Usage: bench-primitives.sh [primitives per kind] [--tolerance=<float>] [--repeat=<uint>]
+#
+# Uses $CC and $CXX, or cc and c++.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+tess="$here/../rvmparser-linux/libs/libtess2"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for c in "$tess"/Source/*.c; do
+  ${CC:-cc} -O2 -I"$tess/Include" -c "$c" -o "$tmp/$(basename "$c" .c).o"
+done
+${CXX:-c++} -std=c++20 -O2 -I"$src" -I"$tess/Include" -o "$tmp/bench-primitives" \
+  "$here/bench-primitives.cpp" \
+  "$src/TriangulationFactory.cpp" "$src/Store.cpp" "$src/LinAlgOps.cpp" "$src/Common.cpp" \
+  "$tmp"/*.o
+
+"$tmp/bench-primitives" "$@"
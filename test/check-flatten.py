@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Checks the --output-json hierarchy written with --keep-groups against the
+# hierarchy written without flattening.
+#
+# Usage: check-flatten.py <full.json> <flattened.json> <keep-groups.txt>
+#
+# A group is kept if it or one of its ancestors is listed, and groups in the
+# first two levels below a model are always kept. Kept groups move below
+# their nearest kept ancestor and keep their attributes, material and bounds.
+# Discarded groups hand their geometries to that ancestor, so its bounds do
+# not change. Exits with status 1 and prints the first differences if the
+# flattened hierarchy is not the expected projection of the full one.
+import difflib, json, sys
+
+full = json.load(open(sys.argv[1]))
+flat = json.load(open(sys.argv[2]))
+keep = set(l.strip() for l in open(sys.argv[3]) if l.strip())
+
+def project(node, level, tagged):
+    tagged = tagged or node["name"] in keep
+    kids = [k for c in node.get("children", []) for k in project(c, level + 1, tagged)]
+    if not tagged and 2 <= level:
+        return kids
+    node = {k: v for k, v in node.items() if k != "children"}
+    if kids:
+        node["children"] = kids
+    return [node]
+
+def projectModels(files):
+    return [dict(f, children=[dict(m, children=[k for g in m.get("children", []) for k in project(g, 0, False)])
+                              for m in f["children"]])
+            for f in files]
+
+def lines(nodes, depth=0, out=None):
+    out = [] if out is None else out
+    for n in nodes:
+        out.append("  " * depth + json.dumps({k: v for k, v in n.items() if k != "children"}))
+        lines(n.get("children", []), depth + 1, out)
+    return out
+
+expected = projectModels(full)
+if expected != flat:
+    print("FAILED: flattened hierarchy differs from the expected one")
+    print("\n".join(list(difflib.unified_diff(lines(expected), lines(flat), "expected", "flattened", lineterm=""))[:40]))
+    sys.exit(1)
@@ -0,0 +1,196 @@
+// Randomized check of the fan and ear clipping paths of
+// TriangulationFactory::facetGroup against libtess2.
+//
+// Usage: earclip-vs-libtess [contours] [seed]
+//
+// Generates single-contour facet polygons, convex, star-shaped, random, with
+// collinear vertices, doubly wound and comb-shaped, in random orientations,
+// offsets and scales. Every contour that takes the fast path must give n-2
+// triangles whose area vector and total area match the libtess2
+// triangulation of the same contour to 1e-3 relative, and no triangle may be
+// flipped by more than a sliver. Both tolerances grow with the ratio of the
+// offset to the contour size, where the float input itself is noisy. Contours that go to libtess2
+// in the factory are skipped. Exits with status 1 if any contour fails.
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Store.h"
+#include "Tessellator.h"
+#include "tesselator.h"
+
+void logger(unsigned, const char*, ...) {}
+
+namespace {
+
+  struct AreaSum
+  {
+    double vector[3] = { 0.0, 0.0, 0.0 };
+    double absolute = 0.0;
+    double maxFlipped = 0.0;    // Largest triangle facing away from the reference normal.
+  };
+
+  void addTriangle(AreaSum& sum, const float* a, const float* b, const float* c, const double* normal)
+  {
+    double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    double x[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+    for (unsigned k = 0; k < 3; k++) sum.vector[k] += 0.5 * x[k];
+    double area = 0.5 * std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+    sum.absolute += area;
+    if (normal && x[0] * normal[0] + x[1] * normal[1] + x[2] * normal[2] < 0.0) {
+      sum.maxFlipped = std::max(sum.maxFlipped, area);
+    }
+  }
+
+  double length(const double* v)
+  {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  }
+
+  // Contour in the xy-plane, counter-clockwise unless it is random or doubly wound.
+  std::vector<float> contour2d(std::mt19937& rng, unsigned kind)
+  {
+    const float twoPi = 2.f * 3.14159265f;
+    std::uniform_real_distribution<float> U(0.f, 1.f);
+    std::vector<float> p;
+
+    if (kind == 4) {
+      // Comb with teeth pointing up.
+      unsigned teeth = rng() % 8;
+      p = { 0.f, 0.f, teeth + 1.f, 0.f };
+      for (unsigned t = teeth; t > 0; t--) {
+        p.insert(p.end(), { t + 0.5f, 3.f, float(t), 1.f });
+      }
+      p.insert(p.end(), { 0.5f, 3.f, 0.f, 3.f });
+      return p;
+    }
+
+    unsigned n = 5 + rng() % 40;
+    p.resize(2 * n);
+    for (unsigned i = 0; i < n; i++) {
+      float a = twoPi * i / n;
+      float r = 1.f;
+      switch (kind) {
+      case 1: r = 0.3f + U(rng); break;    // Star-shaped.
+      case 2: a = twoPi * U(rng); break;   // Random, often self-intersecting.
+      case 5: a *= 2.f; break;             // Doubly wound.
+      default: break;
+      }
+      p[2 * i + 0] = r * std::cos(a);
+      p[2 * i + 1] = r * std::sin(a);
+      if (kind == 3 && i % 2 == 1) {
+        // Convex with every other vertex in the middle of a chord.
+        float a0 = twoPi * (i - 1) / n;
+        float a1 = twoPi * ((i + 1) % n) / n;
+        p[2 * i + 0] = 0.5f * (std::cos(a0) + std::cos(a1));
+        p[2 * i + 1] = 0.5f * (std::sin(a0) + std::sin(a1));
+      }
+    }
+    return p;
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  unsigned contours = argc > 1 ? unsigned(std::strtoul(argv[1], nullptr, 10)) : 200000;
+  std::mt19937 rng(argc > 2 ? unsigned(std::strtoul(argv[2], nullptr, 10)) : 42);
+  std::uniform_real_distribution<float> U(0.f, 1.f);
+
+  Store store;
+  TriangulationFactory factory(&store, logger, 0.1f, 3, 100);
+
+  unsigned checked = 0;
+  unsigned failed = 0;
+  for (unsigned it = 0; it < contours; it++) {
+    unsigned kind = rng() % 6;
+    std::vector<float> p = contour2d(rng, kind);
+    unsigned n = unsigned(p.size() / 2);
+    bool reverse = rng() % 2;
+
+    float ax = 6.2831853f * U(rng), ay = 6.2831853f * U(rng), az = 6.2831853f * U(rng);
+    float scale = std::pow(10.f, 4.f * U(rng) - 2.f);
+    float offset[3] = { (U(rng) - 0.5f) * 1e4f, (U(rng) - 0.5f) * 1e4f, (U(rng) - 0.5f) * 1e4f };
+    if (rng() % 4 == 0) {
+      ax = ay = az = 0.f;
+    }
+    float cx = std::cos(ax), sx = std::sin(ax), cy = std::cos(ay), sy = std::sin(ay), cz = std::cos(az), sz = std::sin(az);
+    float R[9] = {
+      cy * cz, -cy * sz, sy,
+      sx * sy * cz + cx * sz, -sx * sy * sz + cx * cz, -sx * cy,
+      -cx * sy * cz + sx * sz, cx * sy * sz + sx * cz, cx * cy
+    };
+
+    std::vector<float> vertices(3 * n);
+    std::vector<float> normals(3 * n);
+    for (unsigned i = 0; i < n; i++) {
+      unsigned j = reverse ? n - 1 - i : i;
+      float x = scale * p[2 * j + 0];
+      float y = scale * p[2 * j + 1];
+      float z = kind == 0 && it % 50 == 0 ? scale * 0.1f * U(rng) : 0.f;  // Occasionally non-planar.
+      for (unsigned k = 0; k < 3; k++) {
+        vertices[3 * i + k] = offset[k] + R[3 * k + 0] * x + R[3 * k + 1] * y + R[3 * k + 2] * z;
+        normals[3 * i + k] = R[3 * k + 2];
+      }
+    }
+
+    Contour cont{};
+    cont.vertices = vertices.data();
+    cont.normals = normals.data();
+    cont.vertices_n = n;
+    Polygon poly{};
+    poly.contours = &cont;
+    poly.contours_n = 1;
+    Geometry geo{};
+    geo.kind = Geometry::Kind::FacetGroup;
+    geo.facetGroup.polygons = &poly;
+    geo.facetGroup.polygons_n = 1;
+
+    unsigned fast0 = factory.fanPolygons + factory.earClippedPolygons;
+    Arena arena;
+    const Triangulation* tri = factory.facetGroup(&arena, &geo, 1.f);
+    if (factory.fanPolygons + factory.earClippedPolygons == fast0) continue;
+    checked++;
+
+    TESStesselator* tess = tessNewTess(nullptr);
+    tessAddContour(tess, 3, vertices.data(), 3 * sizeof(float), int(n));
+    tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 3, nullptr);
+    const float* tv = tessGetVertices(tess);
+    const int* te = tessGetElements(tess);
+    AreaSum ref;
+    for (int e = 0; e < tessGetElementCount(tess); e++) {
+      addTriangle(ref, tv + 3 * te[3 * e + 0], tv + 3 * te[3 * e + 1], tv + 3 * te[3 * e + 2], nullptr);
+    }
+    tessDeleteTess(tess);
+
+    AreaSum sum;
+    for (unsigned e = 0; e < tri->triangles_n; e++) {
+      const uint32_t* ix = tri->indices + 3 * e;
+      addTriangle(sum, tri->vertices + 3 * ix[0], tri->vertices + 3 * ix[1], tri->vertices + 3 * ix[2], ref.vector);
+    }
+
+    // Float rounding of the input moves vertices by about 1e-7 of the
+    // offset, which can flip slivers far from the origin for either method.
+    double offsetRatio = std::max(std::abs(offset[0]), std::max(std::abs(offset[1]), std::abs(offset[2]))) / scale;
+    double noise = 2e-6 * offsetRatio;
+
+    double refLength = length(ref.vector);
+    double diff[3] = { sum.vector[0] - ref.vector[0], sum.vector[1] - ref.vector[1], sum.vector[2] - ref.vector[2] };
+    double flipped = sum.maxFlipped / ref.absolute;
+    bool ok = (tri->triangles_n == n - 2 &&
+               flipped < 1e-4 + noise &&
+               length(diff) <= 1e-3 * refLength + 1e-6 &&
+               std::abs(sum.absolute - ref.absolute) <= (1e-3 + noise) * ref.absolute + 1e-6);
+    if (!ok && failed++ < 20) {
+      fprintf(stderr, "FAILED: contour %u kind %u with %u vertices, %u triangles, area %g vs %g, absolute area %g vs %g, flipped %g\n",
+              it, kind, n, tri->triangles_n, length(sum.vector), refLength, sum.absolute, ref.absolute, flipped);
+    }
+  }
+
+  printf("%s: %u of %u contours took the fast path (%u fan, %u ear clipped), %u failed\n",
+         failed ? "FAILED" : "ok", checked, contours, factory.fanPolygons, factory.earClippedPolygons, failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# Writes a synthetic RVM file and matching attribute file for the tests.
+#
+# Usage: genrvm.py <stem> [sites] [seed] [depth]
+#
+# Each site is a tree of groups of the given depth with two or three children
+# per group. Every leaf holds a connected cylinder-torus-cylinder pipe run, one
+# primitive of every other kind and a facet group with a triangle, a quad, a
+# convex hexagon, a concave L, a polygon with a hole, a star and a grid of
+# quads. Writes <stem>.rvm and <stem>.att.
+import struct, sys, random, math
+
+stem = sys.argv[1]
+nsites = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+random.seed(int(sys.argv[3]) if len(sys.argv) > 3 else 1)
+depth = int(sys.argv[4]) if len(sys.argv) > 4 else 2
+
+out = bytearray()
+att = []
+
+def u32(v): out.extend(struct.pack('>I', v))
+def f32(v): out.extend(struct.pack('>f', v))
+def s(str_):
+    b = str_.encode('latin-1'); n = (len(b) + 4) // 4  # always at least one zero
+    u32(n); out.extend(b + b'\0' * (4 * n - len(b)))
+def chunk_begin(id_):
+    for c in id_: u32(ord(c))
+    pos = len(out); u32(0); u32(1); return pos
+def patch(pos): struct.pack_into('>I', out, pos, len(out))
+
+def rot(a):
+    c, s_ = math.cos(a), math.sin(a)
+    return [c, s_, 0, -s_, c, 0, 0, 0, 1]
+def M(a, t): return rot(a) + list(t)
+
+def prim(kind, M, params, bb=(-1,-1,-1,1,1,1), facet=None):
+    p = chunk_begin("PRIM"); u32(2); u32(kind)
+    for v in M: f32(v)
+    for v in bb: f32(v)
+    for v in params: f32(v)
+    if facet is not None:
+        u32(len(facet))
+        for poly in facet:
+            u32(len(poly))
+            for cont in poly:
+                u32(len(cont))
+                for (v, n) in cont:
+                    for x in v: f32(x)
+                    for x in n: f32(x)
+    patch(p)
+
+def leaf(x, y, z):
+    # Pipe run: cylinder along z, a quarter torus, and a cylinder along -x, connected end to end.
+    r = 0.1 + random.random() * 0.3
+    L = 2.0
+    R = 1.0
+    prim(8, [1,0,0, 0,1,0, 0,0,1, x, y, z + L/2], [r, L])
+    prim(4, [1,0,0, 0,0,1, 0,-1,0, x - R, y, z + L], [R, r, math.pi/2])
+    prim(8, [0,0,1, 0,1,0, -1,0,0, x - R - L/2, y, z + L + R], [r, L])
+
+    prim(2, M(random.random(), (x + 3, y, z)), [1, 2, 0.5])
+    prim(1, M(0.2, (x + 5, y, z)), [1, 1, 0.5, 0.5, 0.1, 0.1, 1])
+    prim(3, M(0.3, (x + 7, y, z)), [0.5, 1.0, 0.3, math.pi/3])
+    prim(5, M(0.0, (x, y + 3, z)), [0.8, 0.3])
+    prim(6, M(0.0, (x + 2, y + 3, z)), [0.8, 0.2])
+    prim(7, M(0.1, (x + 4, y + 3, z)), [0.6, 0.3, 1.2, 0.1, 0.0, 0.05, 0.0, 0.0, 0.1])
+    prim(9, M(0.0, (x + 6, y + 3, z)), [0.7])
+    prim(10, M(0.0, (x + 8, y + 3, z)), [0.0, 1.0])
+
+    def v(px, py, pz=0): return ((x + px, y + 6 + py, z + pz), (0, 0, 1))
+    hexa = [v(math.cos(k * math.pi / 3), math.sin(k * math.pi / 3)) for k in range(6)]
+    L_ = [v(0,0), v(2,0), v(2,1), v(1,1), v(1,2), v(0,2)]
+    outer = [v(3,0), v(5,0), v(5,2), v(3,2)]
+    hole = [v(3.5,0.5), v(3.5,1.5), v(4.5,1.5), v(4.5,0.5)]
+    star = [v(6 + (1 if k % 2 == 0 else 0.4) * math.cos(k * math.pi / 5), (1 if k % 2 == 0 else 0.4) * math.sin(k * math.pi / 5)) for k in range(10)]
+    grid = []
+    for i in range(4):
+        for j in range(4):
+            grid.append([[v(i*0.5, 3+j*0.5), v(i*0.5+0.5, 3+j*0.5), v(i*0.5+0.5, 3+j*0.5+0.5), v(i*0.5, 3+j*0.5+0.5)]])
+    facet = [[[v(0,-1), v(1,-1), v(0,-0.5)]], [hexa], [L_], [outer, hole], [star]] + grid
+    prim(11, [1,0,0, 0,1,0, 0,0,1, 0,0,0], [], bb=(x, y + 5, z, x + 7, y + 9, z + 1), facet=facet)
+
+gid = 0
+def group(name, level, origin):
+    global gid
+    gid += 1
+    p = chunk_begin("CNTB"); u32(2); s(name)
+    f32(origin[0]*1000); f32(origin[1]*1000); f32(origin[2]*1000); u32(random.randint(1, 20))
+    patch(p)
+    att.append(("NEW " + name, {"TYPE": random.choice(["PIPE", "EQUI", "STRU"]), "NAME": name, "DESC": "d%d" % gid}))
+    x, y, z = origin
+    if level > 0:
+        for i in range(random.randint(2, 3)):
+            group("%s/C%d" % (name, i), level - 1, (x + i * 10, y + random.random() * 5, z))
+    else:
+        leaf(x, y, z)
+    p = chunk_begin("CNTE"); u32(1); patch(p)
+    att.append(None)
+
+p = chunk_begin("HEAD"); u32(2); s("AVEVA PDMS Design"); s("note"); s("date"); s("user"); s("Unicode UTF-8"); patch(p)
+p = chunk_begin("MODL"); u32(1); s("PROJ"); s("MODEL"); patch(p)
+for site in range(nsites):
+    group("/SITE%d" % site, depth, (site * 100.0, 0.0, 0.0))
+p = chunk_begin("END:"); u32(1); patch(p)
+open(stem + ".rvm", "wb").write(out)
+
+lines = ["CADC_Attributes_File v1.0 , start: NEW END , name_end: END , sep: :=",
+         "NEW Header Information", "END"]
+for a in att:
+    if a is None:
+        lines.append("END")
+        continue
+    lines.append(a[0])
+    for k, val in a[1].items():
+        lines.append("%s := '%s'" % (k, val))
+open(stem + ".att", "w").write("\n".join(lines) + "\n")
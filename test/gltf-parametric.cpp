@@ -0,0 +1,214 @@
+// Checks decodeParametric of src/GltfParametric.cpp against the factory.
+//
+// Usage: gltf-parametric <out.glb> <file.rvm>...
+//
+// Parses the files, writes them with exportGLTF in parametric mode and reads
+// back every record of the "rvm-parametric" extras of the glb. Each record
+// must encode one of the parsed primitives, and decodeParametric must give
+// the triangulation TriangulationFactory::geometry gives for that primitive,
+// same counts and indices and positions and normals within 1e-5. The files
+// are connected and aligned like the application does, so that records carry
+// sample start angles, and the connections are then dropped, since records do
+// not keep them and the decoder always adds caps. Exits with status 1 if any
+// record fails or a primitive has no record.
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "Common.h"
+#include "Store.h"
+#include "Parser.h"
+#include "Tessellator.h"
+#include "LinAlgOps.h"
+#include "GltfParametric.h"
+
+void logger(unsigned level, const char* msg, ...)
+{
+  if (level < 2) return;
+  fprintf(stderr, "[E] ");
+  va_list argptr;
+  va_start(argptr, msg);
+  vfprintf(stderr, msg, argptr);
+  va_end(argptr);
+  fputc('\n', stderr);
+}
+
+namespace {
+
+  bool readFile(std::vector<char>& bytes, const char* path)
+  {
+    FILE* in = std::fopen(path, "rb");
+    if (!in) return false;
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), in)) > 0) bytes.insert(bytes.end(), buffer, buffer + n);
+    std::fclose(in);
+    return true;
+  }
+
+  // Record without the material, which depends on the order colors are met.
+  std::string recordKey(const ParametricRecord& rec)
+  {
+    ParametricRecord r = rec;
+    r.material = 0;
+    return std::string(reinterpret_cast<const char*>(&r), sizeof(r));
+  }
+
+  void collectPrimitives(std::vector<const Geometry*>& geos, Node* node)
+  {
+    if (node->kind == Node::Kind::Group) {
+      for (Geometry* geo = node->group.geometries.first; geo; geo = geo->next) {
+        std::fill(std::begin(geo->connections), std::end(geo->connections), nullptr);
+        if (isParametric(geo)) geos.push_back(geo);
+      }
+    }
+    for (Node* child = node->children.first; child; child = child->next) {
+      collectPrimitives(geos, child);
+    }
+  }
+
+  bool close(const float* a, const float* b, unsigned n)
+  {
+    for (unsigned i = 0; i < n; i++) {
+      if (!(std::abs(a[i] - b[i]) <= 1e-5f * std::max(1.f, std::abs(b[i])))) return false;
+    }
+    return true;
+  }
+
+  // Empty if the triangulations match, otherwise what differs.
+  const char* compare(const Triangulation* tri, const Triangulation* ref)
+  {
+    if (!tri || !ref) return tri == ref ? nullptr : "missing triangulation";
+    if (tri->vertices_n != ref->vertices_n) return "vertex count";
+    if (tri->triangles_n != ref->triangles_n) return "triangle count";
+    for (size_t i = 0; i < 3 * size_t(tri->triangles_n); i++) {
+      if (tri->index(i) != ref->index(i)) return "indices";
+    }
+    for (uint32_t i = 0; i < tri->vertices_n; i++) {
+      Vec3f p = tri->vertex(i);
+      Vec3f q = ref->vertex(i);
+      if (!close(p.data, q.data, 3)) return "positions";
+      Vec3f n = tri->normal(i);
+      Vec3f m = ref->normal(i);
+      if (!close(n.data, m.data, 3)) return "normals";
+    }
+    return nullptr;
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <out.glb> <file.rvm>...\n", argv[0]);
+    return 2;
+  }
+  const char* glbPath = argv[1];
+
+  Store* store = new Store();
+  for (int i = 2; i < argc; i++) {
+    std::vector<char> bytes;
+    if (!readFile(bytes, argv[i]) || !parseRVM(store, logger, argv[i], bytes.data(), bytes.size())) {
+      fprintf(stderr, "Failed to parse %s\n", argv[i]);
+      return 2;
+    }
+  }
+  store->updateCounts();
+  connect(store, logger);
+  align(store, logger);
+  if (!exportGLTF(store, logger, glbPath, 0, false, true, false, false, false, true)) {
+    fprintf(stderr, "Failed to write %s\n", glbPath);
+    return 2;
+  }
+
+  // The glb is a 12 byte header, a JSON chunk and a BIN chunk.
+  std::vector<char> glb;
+  uint32_t jsonLength = 0;
+  uint32_t binLength = 0;
+  if (readFile(glb, glbPath) && glb.size() >= 20) {
+    std::memcpy(&jsonLength, glb.data() + 12, 4);
+    if (20 + size_t(jsonLength) + 8 <= glb.size()) {
+      std::memcpy(&binLength, glb.data() + 20 + jsonLength, 4);
+    }
+  }
+  const char* bin = glb.data() + 20 + jsonLength + 8;
+  rapidjson::Document doc;
+  if (binLength == 0 || 28 + size_t(jsonLength) + binLength > glb.size() ||
+      doc.Parse(glb.data() + 20, jsonLength).HasParseError())
+  {
+    fprintf(stderr, "Failed to read %s\n", glbPath);
+    return 2;
+  }
+
+  Vec3f origin = makeVec3f(0.f);
+  const rapidjson::Value& rjOrigin = doc["asset"]["extras"]["rvmparser-origin"];
+  for (unsigned k = 0; k < 3; k++) origin[k] = rjOrigin[k].GetFloat();
+
+  std::vector<const Geometry*> geos;
+  for (Node* root = store->getFirstRoot(); root; root = root->next) {
+    collectPrimitives(geos, root);
+  }
+  std::multimap<std::string, const Geometry*> byKey;
+  for (const Geometry* geo : geos) {
+    ParametricRecord rec;
+    encodeParametric(rec, geo, 0, origin);
+    byKey.insert({ recordKey(rec), geo });
+  }
+
+  TriangulationFactory factory(store, logger, 0.1f, 3, 100);
+  Arena arena;
+  unsigned records = 0;
+  unsigned failed = 0;
+  const rapidjson::Value& bufferViews = doc["bufferViews"];
+  for (const rapidjson::Value& node : doc["nodes"].GetArray()) {
+    if (!node.HasMember("extras") || !node["extras"].HasMember("rvm-parametric")) continue;
+    const rapidjson::Value& parametric = node["extras"]["rvm-parametric"];
+    const rapidjson::Value& view = bufferViews[parametric["bufferView"].GetUint()];
+    size_t offset = view.HasMember("byteOffset") ? view["byteOffset"].GetUint64() : 0;
+    uint32_t count = parametric["count"].GetUint();
+    if (parametric["byteStride"].GetUint() != sizeof(ParametricRecord) ||
+        view["byteLength"].GetUint64() != count * sizeof(ParametricRecord) ||
+        offset + count * sizeof(ParametricRecord) > binLength)
+    {
+      fprintf(stderr, "FAILED: bad rvm-parametric buffer view\n");
+      return 1;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      ParametricRecord rec;
+      std::memcpy(&rec, bin + offset + i * sizeof(ParametricRecord), sizeof(rec));
+      records++;
+
+      auto it = byKey.find(recordKey(rec));
+      if (it == byKey.end()) {
+        if (failed++ < 20) fprintf(stderr, "FAILED: record %u of kind %u matches no primitive\n", i, rec.kind);
+        continue;
+      }
+      const Geometry* geo = it->second;
+      byKey.erase(it);
+
+      arena.reset();
+      const Triangulation* tri = decodeParametric(&factory, &arena, rec);
+      const Triangulation* ref = factory.geometry(&arena, geo, getScale(geo->M_3x4));
+      if (const char* what = compare(tri, ref); what && failed++ < 20) {
+        fprintf(stderr, "FAILED: record %u of kind %u differs from the factory in %s\n", i, rec.kind, what);
+      }
+    }
+  }
+  if (!byKey.empty()) {
+    fprintf(stderr, "FAILED: %zu primitives have no record\n", byKey.size());
+    failed += unsigned(byKey.size());
+  }
+
+  printf("%s: %u records of %zu primitives, %u failed\n", failed ? "FAILED" : "ok", records, geos.size(), failed);
+  delete store;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+# Consumer for --output-pipe on Linux that validates the framing of the stream.
+#
+# Usage: pipe-consumer.py <path> [credits] [--fifo]
+#
+# Listens on a unix domain socket at <path>, or creates a FIFO there with
+# --fifo, and reads one export. With credits > 0 it grants one frame per 888
+# message as it consumes them, which matches --output-pipe-credits=<credits>.
+#
+# Checks that the stream starts with the version message, that every frame
+# holds whole records of known types and sizes and ends with a 777 message,
+# that frames fit the 4MB frame buffer, that ids increase and refer to
+# records sent before, and that it ends with 999. Prints the number of frames
+# and records and a hash of the records, which must not depend on credits,
+# frame buffers or threads. Exits with status 1 on the first violation.
+import os, socket, struct, sys, hashlib
+
+args = [a for a in sys.argv[1:] if not a.startswith("--")]
+path = args[0]
+credits = int(args[1]) if len(args) > 1 else 0
+fifo = "--fifo" in sys.argv
+
+frameLimit = 4 * 1024 * 1024
+
+def fail(msg):
+    print("FAILED:", msg, flush=True)
+    sys.exit(1)
+
+if os.path.exists(path):
+    os.unlink(path)
+if fifo:
+    if credits:
+        fail("a FIFO is write-only, flow control needs a socket")
+    os.mkfifo(path)
+    print("ready", flush=True)
+    conn = None
+    stream = open(path, "rb")
+else:
+    srv = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    srv.bind(path)
+    srv.listen(1)
+    print("ready", flush=True)
+    conn, _ = srv.accept()
+    stream = conn.makefile("rb")
+
+def read(n):
+    b = stream.read(n)
+    if len(b) != n:
+        fail("stream ended in the middle of a message")
+    return b
+
+def header():
+    return struct.unpack("<ii", read(8))
+
+# Fixed part of the record of each message type, names and geometry follow.
+minSizes = {
+    1: 8 + 6 * 8,                     # Model: id, bounds
+    2: 8 + 8 + 1 + 6 * 8,             # Instance: id, parent, significant, bounds
+    3: 4 * 8 + 24 * 8 + 3 * 4,        # Shape: ids, bounds, matrix, counts
+    4: 8 + 3 * 4 + 3 * 4 + 5 * 4,     # Material
+}
+
+t, version = header()
+if t != 100:
+    fail("expected version message 100, got %d" % t)
+
+h = hashlib.sha1()
+counts = {}
+frames = 0
+frameBytes = 0
+instances = {0}
+materials = {0}
+lastInstance = 0
+lastShape = 0
+lastMaterial = 0
+while True:
+    t, l = header()
+    frameBytes += 8
+    if t == 999:
+        if frameBytes != 8:
+            fail("end message inside a frame")
+        break
+    if t == 777:
+        if l != 0:
+            fail("frame end with content length %d" % l)
+        if frameBytes == 8:
+            fail("empty frame")
+        if frameLimit < frameBytes:
+            fail("frame of %d bytes exceeds the frame buffer" % frameBytes)
+        frames += 1
+        frameBytes = 0
+        if credits:
+            # The exporter stops reading credits after its last frame.
+            try:
+                conn.sendall(struct.pack("<ii", 888, 1))
+            except (BrokenPipeError, ConnectionResetError):
+                pass
+        continue
+    if t not in minSizes:
+        fail("unknown message type %d" % t)
+    if l < minSizes[t] or (t == 4 and l != minSizes[t]):
+        fail("message type %d with content length %d" % (t, l))
+    body = read(l)
+    frameBytes += l
+
+    if t in (1, 2):
+        id_ = struct.unpack_from("<q", body, 0)[0]
+        if id_ <= lastInstance:
+            fail("instance id %d does not increase" % id_)
+        if t == 2 and struct.unpack_from("<q", body, 8)[0] not in instances:
+            fail("instance %d has an unknown parent" % id_)
+        instances.add(id_)
+        lastInstance = id_
+    elif t == 3:
+        shape, shapeInstance, instance, material = struct.unpack_from("<qqqq", body, 0)
+        if shape <= lastShape or shapeInstance <= lastInstance:
+            fail("shape ids %d, %d do not increase" % (shape, shapeInstance))
+        if instance not in instances or material not in materials:
+            fail("shape %d refers to an unknown instance or material" % shape)
+        lastShape = shape
+        lastInstance = shapeInstance
+    elif t == 4:
+        id_ = struct.unpack_from("<q", body, 0)[0]
+        if id_ <= lastMaterial:
+            fail("material id %d does not increase" % id_)
+        materials.add(id_)
+        lastMaterial = id_
+
+    h.update(struct.pack("<i", t))
+    h.update(body)
+    counts[t] = counts.get(t, 0) + 1
+
+# Credits the exporter did not read make its close reset the connection.
+try:
+    trailing = stream.read(1)
+except ConnectionResetError:
+    trailing = b""
+if trailing:
+    fail("data after the end message")
+
+print("version %d frames %d records %s sha1 %s" % (version, frames, dict(sorted(counts.items())), h.hexdigest()), flush=True)
@@ -0,0 +1,102 @@
+// Checks that the number formatters of src/ExportRev.cpp write the same bytes
+// as the %6u and %14.5f fprintf calls they replaced.
+//
+// Usage: rev-format [random values] [seed]
+//
+// Includes ExportRev.cpp to reach formatUint and formatFloat in its anonymous
+// namespace. Covers rounding ties and their neighbours, signed zeros,
+// infinities and NaNs, denormals, magnitudes at and above the 1e12 limit of
+// the integer path, and random bit patterns. Exits with status 1 if any value
+// differs from snprintf.
+#include "../src/ExportRev.cpp"
+
+#include <cfloat>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace {
+
+  unsigned checked = 0;
+  unsigned failed = 0;
+
+  void checkFloat(float x)
+  {
+    char expected[128];
+    snprintf(expected, sizeof(expected), "%14.5f", x);
+    char actual[128];
+    *formatFloat(actual, x) = '\0';
+    checked++;
+    if (std::strcmp(expected, actual) != 0 && failed++ < 20) {
+      fprintf(stderr, "FAILED: %a printf '%s' formatFloat '%s'\n", x, expected, actual);
+    }
+  }
+
+  void checkUint(uint32_t x)
+  {
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%6u", x);
+    char actual[32];
+    *formatUint(actual, x) = '\0';
+    checked++;
+    if (std::strcmp(expected, actual) != 0 && failed++ < 20) {
+      fprintf(stderr, "FAILED: %u printf '%s' formatUint '%s'\n", x, expected, actual);
+    }
+  }
+
+  // The value and its neighbours, with both signs.
+  void checkAround(float x)
+  {
+    for (float y : { std::nextafter(x, 0.f), x, std::nextafter(x, std::numeric_limits<float>::infinity()) }) {
+      checkFloat(y);
+      checkFloat(-y);
+    }
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  unsigned randomValues = argc > 1 ? unsigned(std::strtoul(argv[1], nullptr, 10)) : 2000000;
+  std::mt19937 rng(argc > 2 ? unsigned(std::strtoul(argv[2], nullptr, 10)) : 1);
+
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (float x : { 0.f, -0.f, inf, -inf, nan, -nan, FLT_MIN, -FLT_MIN, FLT_TRUE_MIN, FLT_MAX, -FLT_MAX,
+                   1e-5f, 5e-6f, 4.99999e-6f, 0.5f, 1.f, 99999.99999f, 1e11f, 1e12f, 1e13f, 1e20f, 1e38f }) {
+    checkAround(x);
+  }
+
+  // k / 64 with odd k ends in 5 at the sixth decimal, an exact tie that a
+  // float holds while k < 2^24.
+  for (uint32_t k = 1; k < (1u << 24); k += k < 65536 ? 2 : 2 * (1 + rng() % 256)) {
+    checkAround(float(k) / 64.f);
+  }
+  // Values near a tie that are not exactly representable, like 0.000005.
+  for (uint32_t k = 0; k < 200000; k++) {
+    checkAround(float((2.0 * k + 1.0) * 5e-6));
+  }
+  for (int e = -45; e <= 38; e++) {
+    checkAround(std::pow(10.f, float(e)));
+  }
+
+  for (unsigned i = 0; i < randomValues; i++) {
+    uint32_t bits = rng();
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    checkFloat(x);
+    // Random values in the range of model coordinates.
+    checkFloat((float(rng()) / 4294967296.f - 0.5f) * std::pow(10.f, float(rng() % 10)));
+  }
+
+  for (uint32_t x : { 0u, 1u, 9u, 10u, 99999u, 100000u, 999999u, 1000000u, 4294967295u }) {
+    checkUint(x);
+  }
+  for (unsigned i = 0; i < randomValues / 10; i++) {
+    checkUint(rng() >> (rng() % 32));
+  }
+
+  printf("%s: %u values, %u differ from printf\n", failed ? "FAILED" : "ok", checked, failed);
+  return failed ? 1 : 0;
+}
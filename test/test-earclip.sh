@@ -0,0 +1,24 @@
+#!/bin/bash
+# Builds and runs test/earclip-vs-libtess.cpp, the randomized check of the
+# fan and ear clipping facet paths against libtess2.
+#
+# Usage: test-earclip.sh [contours] [seed]
+#
+# Uses $CC and $CXX, or cc and c++.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+tess="$here/../rvmparser-linux/libs/libtess2"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for c in "$tess"/Source/*.c; do
+  ${CC:-cc} -O2 -I"$tess/Include" -c "$c" -o "$tmp/$(basename "$c" .c).o"
+done
+${CXX:-c++} -std=c++20 -O2 -I"$src" -I"$tess/Include" -o "$tmp/earclip-vs-libtess" \
+  "$here/earclip-vs-libtess.cpp" \
+  "$src/TriangulationFactory.cpp" "$src/Store.cpp" "$src/LinAlgOps.cpp" "$src/Common.cpp" \
+  "$tmp"/*.o
+
+"$tmp/earclip-vs-libtess" "$@"
@@ -0,0 +1,56 @@
+#!/bin/bash
+# Checks --keep-groups by comparing the --output-json hierarchy with and
+# without flattening.
+#
+# Usage: test-flatten-hierarchy.sh <rvmparser> [files...]
+#
+# <rvmparser> is the sample application, built with -DORIGINMAIN=1. Without
+# files, a synthetic model is generated. Keeping every group must not change
+# the json at all, and keeping a random tenth of the groups must give the
+# projection of the full hierarchy that test/check-flatten.py expects.
+set -e
+
+exe=$1
+shift || true
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+if [ -z "$exe" ]; then
+  echo "usage: $0 <rvmparser> [files...]"
+  exit 2
+fi
+
+if [ $# -eq 0 ]; then
+  python3 "$here/genrvm.py" "$tmp/model" 3 5 4
+  set -- "$tmp/model.rvm" "$tmp/model.att"
+fi
+
+"$exe" --output-json="$tmp/full.json" "$@" 2> "$tmp/full.log"
+
+python3 - "$tmp/full.json" "$tmp" <<'PY'
+import json, random, sys
+names = []
+def walk(n):
+    if n.get("name", "").startswith("/"):
+        names.append(n["name"])
+    for c in n.get("children", []):
+        walk(c)
+for f in json.load(open(sys.argv[1])):
+    walk(f)
+random.seed(1)
+open(sys.argv[2] + "/all.txt", "w").write("\n".join(names) + "\n")
+open(sys.argv[2] + "/some.txt", "w").write("\n".join(random.sample(names, max(1, len(names) // 10))) + "\n")
+PY
+
+for keep in all some; do
+  "$exe" --keep-groups="$tmp/$keep.txt" --output-json="$tmp/$keep.json" "$@" 2> "$tmp/$keep.log"
+done
+
+if ! cmp -s "$tmp/full.json" "$tmp/all.json"; then
+  echo "FAILED: keeping every group changed the hierarchy"
+  diff "$tmp/full.json" "$tmp/all.json" | head -20
+  exit 1
+fi
+python3 "$here/check-flatten.py" "$tmp/full.json" "$tmp/some.json" "$tmp/some.txt"
+echo "ok: flattened $(wc -l < "$tmp/all.txt") groups, keeping all and $(wc -l < "$tmp/some.txt") of them"
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Builds and runs test/gltf-parametric.cpp, which checks decodeParametric on
+# the records of a parametric glb export against TriangulationFactory.
+#
+# Usage: test-gltf-parametric.sh [files...]
+#
+# Without files, a synthetic model with every primitive kind is generated.
+# Uses $CC and $CXX, or cc and c++.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+libs="$here/../rvmparser-linux/libs"
+tess="$libs/libtess2"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+files=("$@")
+if [ ${#files[@]} -eq 0 ]; then
+  python3 "$here/genrvm.py" "$tmp/model" 10 1 3
+  files=("$tmp/model.rvm")
+fi
+
+for c in "$tess"/Source/*.c; do
+  ${CC:-cc} -O2 -I"$tess/Include" -c "$c" -o "$tmp/$(basename "$c" .c).o"
+done
+${CXX:-c++} -std=c++20 -O2 -I"$src" -I"$libs/rapidjson/include" -I"$tess/Include" -o "$tmp/gltf-parametric" \
+  "$here/gltf-parametric.cpp" \
+  "$src/ExportGLTF.cpp" "$src/GltfParametric.cpp" "$src/Connect.cpp" "$src/Align.cpp" "$src/ParserRVM.cpp" \
+  "$src/TriangulationFactory.cpp" "$src/Store.cpp" "$src/LinAlgOps.cpp" "$src/Common.cpp" \
+  "$tmp"/*.o
+
+"$tmp/gltf-parametric" "$tmp/model.glb" "${files[@]}"
@@ -0,0 +1,56 @@
+#!/bin/bash
+# Streams a model through --output-pipe to test/pipe-consumer.py and checks
+# that the records do not depend on credits, frame buffers, threads or on
+# whether the transport is a socket or a FIFO. Linux only.
+#
+# Usage: test-pipe.sh <rvmparser> [files...]
+#
+# <rvmparser> is either build of main.cpp. Without files, a synthetic model is
+# generated.
+set -e
+
+exe=$1
+shift || true
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+if [ -z "$exe" ]; then
+  echo "usage: $0 <rvmparser> [files...]"
+  exit 2
+fi
+
+if [ $# -eq 0 ]; then
+  python3 "$here/genrvm.py" "$tmp/model" 200 3 3
+  set -- "$tmp/model.rvm" "$tmp/model.att"
+fi
+
+run() {
+  local name=$1 credits=$2
+  shift 2
+  python3 "$here/pipe-consumer.py" "$tmp/$name.sock" $credits "$@" > "$tmp/$name.out" &
+  local consumer=$!
+  while ! grep -q ready "$tmp/$name.out" 2>/dev/null; do sleep 0.1; done
+  "$exe" --output-pipe="$tmp/$name.sock" --output-pipe-credits=$credits $options "${files[@]}" 2> "$tmp/$name.log" || {
+    echo "FAILED: $name, rvmparser returned an error"
+    tail -3 "$tmp/$name.log"
+    exit 1
+  }
+  wait $consumer || { echo "FAILED: $name"; tail -1 "$tmp/$name.out"; exit 1; }
+  tail -1 "$tmp/$name.out" | sed 's/^version [0-9]* //' > "$tmp/$name.sum"
+}
+
+files=("$@")
+options="--output-pipe-threads=1"; run free 0
+options="--output-pipe-threads=1"; run credit1 1
+options="--output-pipe-threads=4 --output-pipe-frame-buffers=4"; run credit4 4
+options="--output-pipe-threads=0"; run fifo 0 --fifo
+
+for name in credit1 credit4 fifo; do
+  if ! cmp -s "$tmp/free.sum" "$tmp/$name.sum"; then
+    echo "FAILED: records of $name differ from the free-running export"
+    cat "$tmp/free.sum" "$tmp/$name.sum"
+    exit 1
+  fi
+done
+echo "ok: $(cat "$tmp/free.sum")"
@@ -0,0 +1,17 @@
+#!/bin/bash
+# Builds and runs test/rev-format.cpp, which checks the rev number formatters
+# against the fprintf formats they replaced.
+#
+# Usage: test-rev-format.sh [random values] [seed]
+#
+# Uses $CXX, or c++.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+src="$here/../src"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+${CXX:-c++} -std=c++20 -O2 -I"$src" -o "$tmp/rev-format" \
+  "$here/rev-format.cpp" "$src/Store.cpp" "$src/Common.cpp" "$src/LinAlgOps.cpp"
+"$tmp/rev-format" "$@"